@@ -1,11 +1,22 @@
 ﻿#include "imd/parser.hpp"
+#include "imd/concurrent.hpp"
 #include "imd/executor.hpp"
+#include "imd/mapped_file.hpp"
+#include "imd/renderer.hpp"
+#include "imd/server.hpp"
+#include "imd/stream.hpp"
+#include "imd/thread_pool.hpp"
+#include "imd/wal.hpp"
 #include <iostream>
 #include <string>
 #include <thread>
 #include <chrono>
-#include <iterator>
 #include <cctype>
+#include <charconv>
+#include <climits>
+#include <csignal>
+#include <cstdlib>
+#include <memory>
 
 #ifdef _WIN32
 #include <io.h>
@@ -25,7 +36,9 @@ static void enableVT() {
         return;
     SetConsoleMode(hOut, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
 }
+static void raiseFdLimit() {}
 #else
+#include <sys/resource.h>
 #include <unistd.h>
 [[maybe_unused]] static bool isatty_stdin() {
     return isatty(fileno(stdin)) != 0;
@@ -34,6 +47,14 @@ static bool isatty_stdout() {
     return isatty(fileno(stdout)) != 0;
 }
 static void enableVT() {}
+// A server with thousands of clients needs as many descriptors.
+static void raiseFdLimit() {
+    rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < lim.rlim_max) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+}
 #endif
 
 // ---- Banner: MINISQL (Q has a clear tail) ----
@@ -92,29 +113,120 @@ static std::string upper_nowhitespace_nosemi(std::string s) {
     }
     return t;
 }
-static void exec_sql_blob(const std::string& sql) {
+// Whole-string decimal parse for numeric flags: "4x", " 4" and "" are rejected.
+static bool parseNumber(const std::string& s, long long& out) {
+    const char* end = s.data() + s.size();
+    auto [p, ec] = std::from_chars(s.data(), end, out);
+    return ec == std::errc() && p == end;
+}
+static imd::OutputFormat g_format = imd::OutputFormat::ASCII; // --format=
+static std::string g_walPath;                                  // --wal=
+static std::chrono::microseconds g_walWindow{1000};            // --wal-window= (group commit, microseconds)
+static std::string g_loadPath, g_savePath;                     // --load= / --save= snapshots
+
+// With --wal: replays the log into ex's database, then logs ex's writes to it.
+static std::unique_ptr<imd::Wal> open_wal(imd::Executor& ex, bool syncEach) {
+    if (g_walPath.empty())
+        return nullptr;
+    auto wal = std::make_unique<imd::Wal>(g_walPath, g_walWindow);
+    if (size_t n = ex.recover(*wal))
+        std::cerr << "Recovered " << n << " statement(s) from " << g_walPath << "\n";
+    ex.setWal(wal.get(), syncEach);
+    return wal;
+}
+
+// Runs body against a fresh database: restored from --load, then --wal on top
+// of it; on a clean finish, --save writes a snapshot (a WAL checkpoint too).
+template <class Body> static void with_database(bool syncEach, Body body) {
     imd::Database db;
-    imd::Parser p(sql);
-    auto stmts = p.parseAll();
     imd::Executor ex(db);
-    for (const auto& st : stmts)
-        ex.execute(st);
+    ex.setFormat(g_format);
+    if (!g_loadPath.empty())
+        ex.execute(imd::Statement(imd::LoadStmt{g_loadPath}));
+    auto wal = open_wal(ex, syncEach);
+    try {
+        body(ex);
+    } catch (...) {
+        ex.sync();
+        throw;
+    }
+    ex.sync();
+    if (!g_savePath.empty())
+        ex.execute(imd::Statement(imd::SaveStmt{g_savePath}));
+}
+
+// --listen: serves one shared database until SIGINT / SIGTERM. Sessions log
+// to the WAL and answer once their writes are durable.
+static imd::Server* g_server = nullptr;
+extern "C" void stop_server(int) {
+    if (g_server)
+        g_server->stop();
 }
-static void repl() {
+static void serve(const std::string& listen, unsigned workers) {
+    raiseFdLimit();
+    imd::ConcurrentDatabase db;
+    imd::Executor boot(db);
+    if (!g_loadPath.empty())
+        boot.execute(imd::Statement(imd::LoadStmt{g_loadPath}));
+    auto wal = open_wal(boot, true);
+    imd::ServerOptions opts;
+    opts.listen = listen;
+    opts.workers = workers;
+    opts.onSession = [&](imd::Executor& ex) {
+        if (wal)
+            ex.setWal(wal.get(), true);
+    };
+    imd::Server server(db, opts);
+    g_server = &server;
+    std::signal(SIGINT, stop_server);
+    std::signal(SIGTERM, stop_server);
+    std::cerr << "Listening on " << listen;
+    if (server.port())
+        std::cerr << " (port " << server.port() << ")";
+    std::cerr << "\n";
+    server.run();
+    g_server = nullptr;
+    boot.sync();
+    if (!g_savePath.empty())
+        boot.execute(imd::Statement(imd::SaveStmt{g_savePath}));
+}
+
+// Statements are parsed on a second thread while the previous ones execute.
+// A script's writes are group-committed and made durable once at the end.
+static void exec_stream(imd::StatementPipeline::Source source) {
+    with_database(false, [&](imd::Executor& ex) {
+        imd::StatementPipeline pipe(std::move(source));
+        for (imd::Statement st; pipe.next(st);)
+            ex.execute(std::move(st));
+    });
+}
+static void repl(imd::Executor& ex) {
     std::ios::sync_with_stdio(false);
     std::cin.tie(nullptr);
-    imd::Database db;
-    imd::Executor ex(db);
+    // dot-commands take a whole line and need no ';'
+    auto dot_command = [&](const std::string& cmd) {
+        std::string word = cmd.substr(0, cmd.find_first_of(" \t"));
+        std::string arg = trim(cmd.substr(word.size()));
+        if (word == ".quit" || word == ".exit")
+            return false;
+        imd::OutputFormat f;
+        if (word == ".format" && arg.empty())
+            std::cout << imd::formatName(ex.format()) << "\n";
+        else if (word == ".format" && imd::parseFormat(arg, f))
+            ex.setFormat(f);
+        else if (word == ".format")
+            std::cerr << "Unknown format: " << arg << " (ascii, csv, tsv, jsonl)\n";
+        else
+            std::cerr << "Unknown command: " << word << "\n";
+        return true;
+    };
     auto exec_one = [&](const std::string& stmt) {
         std::string t = trim(stmt);
         std::string u = upper_nowhitespace_nosemi(t);
         if (u == "EXIT" || u == "QUIT" || u == ".QUIT")
             return false;
         try {
-            imd::Parser p(t);
-            auto v = p.parseAll();
-            for (auto& s : v)
-                ex.execute(s);
+            ex.run(t); // repeated statement shapes reuse cached plans
         } catch (const std::exception& e) {
             std::cerr << "Parse/exec error: " << e.what() << "\n";
         }
@@ -124,6 +236,12 @@ static void repl() {
     std::string buf;
     std::cout << "mini> " << std::flush;
     for (std::string line; std::getline(std::cin, line);) {
+        if (trim(buf).empty() && trim(line).rfind('.', 0) == 0) {
+            if (!dot_command(trim(line)))
+                return;
+            std::cout << "mini> " << std::flush;
+            continue;
+        }
         buf += line;
         buf.push_back('\n');
         size_t start = 0;
@@ -148,23 +266,92 @@ static void repl() {
 
 int main(int argc, char** argv) {
     bool showBanner = true, forceColor = false;
+    std::string script; // positional argument
+    std::string listen; // --listen=
+    unsigned workers = 0;
     for (int i = 1; i < argc; ++i) {
         std::string a = argv[i];
+        if (a.rfind("--", 0) != 0) {
+            script = a;
+            continue;
+        }
         if (a == "--no-banner")
             showBanner = false;
         if (a == "--banner")
             showBanner = true;
         if (a == "--banner-color")
             forceColor = true;
+        if (a.rfind("--threads=", 0) == 0) {
+            long long n;
+            if (!parseNumber(a.substr(10), n) || n < 1 || n > INT_MAX) {
+                std::cerr << "Invalid --threads value: " << a.substr(10) << "\n";
+                return 1;
+            }
+            imd::ThreadPool::setSharedThreads(static_cast<unsigned>(n));
+        }
+        if (a.rfind("--listen=", 0) == 0)
+            listen = a.substr(9);
+        if (a.rfind("--workers=", 0) == 0) {
+            long long n;
+            if (!parseNumber(a.substr(10), n) || n < 1 || n > INT_MAX) {
+                std::cerr << "Invalid --workers value: " << a.substr(10) << "\n";
+                return 1;
+            }
+            workers = static_cast<unsigned>(n);
+        }
+        if (a.rfind("--wal=", 0) == 0)
+            g_walPath = a.substr(6);
+        if (a.rfind("--load=", 0) == 0)
+            g_loadPath = a.substr(7);
+        if (a.rfind("--save=", 0) == 0)
+            g_savePath = a.substr(7);
+        if (a.rfind("--wal-window=", 0) == 0) {
+            long long us;
+            if (!parseNumber(a.substr(13), us) || us < 0) {
+                std::cerr << "Invalid --wal-window value: " << a.substr(13) << "\n";
+                return 1;
+            }
+            g_walWindow = std::chrono::microseconds(us);
+        }
+        if (a.rfind("--format=", 0) == 0 && !imd::parseFormat(a.substr(9), g_format)) {
+            std::cerr << "Invalid --format value: " << a.substr(9) << " (ascii, csv, tsv, jsonl)\n";
+            return 1;
+        }
+    }
+    if (!listen.empty()) {
+        try {
+            serve(listen, workers);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            return 1;
+        }
+        return 0;
     }
     if (showBanner)
         printBannerOnce(forceColor);
+    if (!script.empty()) {
+        // db script.sql: run the file straight from its mapping
+        try {
+            imd::MappedFile file(script);
+            imd::Parser p(file.view());
+            exec_stream(imd::parseStatements(p));
+        } catch (const std::exception& e) {
+            std::cerr << "Parse/exec error: " << e.what() << "\n";
+            return 1;
+        }
+        return 0;
+    }
     if (isatty_stdin()) {
-        repl();
+        try {
+            with_database(true, repl);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            return 1;
+        }
     } else {
         try {
-            std::string sql((std::istreambuf_iterator<char>(std::cin)), std::istreambuf_iterator<char>());
-            exec_sql_blob(sql);
+            std::ios::sync_with_stdio(false);
+            exec_stream(imd::readStatements(std::cin));
         } catch (const std::exception& e) {
             std::cerr << "Parse/exec error: " << e.what() << "\n";
             return 1;
@@ -0,0 +1,76 @@
+﻿// Throughput of a ConcurrentDatabase shared by 1..64 threads, each with its
+// own Executor. The mix is point SELECTs (indexed) with a share of UPDATEs,
+// spread over several tables so readers and writers meet on the same latches.
+//
+//     bench_concurrent [rows per table] [ms per point] [update percent]
+#include "imd/concurrent.hpp"
+#include "imd/executor.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace imd;
+
+static constexpr int kTables = 4;
+
+int main(int argc, char** argv) {
+    const long rows = argc > 1 ? std::atol(argv[1]) : 100000;
+    const long millis = argc > 2 ? std::atol(argv[2]) : 1000;
+    const int updatePct = argc > 3 ? std::atoi(argv[3]) : 5;
+
+    ConcurrentDatabase db;
+    {
+        Executor ex(db);
+        for (int t = 0; t < kTables; ++t) {
+            const std::string name = "t" + std::to_string(t);
+            ex.run("CREATE TABLE " + name + " (id int, v int, s str) USING COLUMNAR;");
+            std::string sql = "INSERT INTO " + name + " (id, v, s) VALUES ";
+            for (long i = 0; i < rows; ++i)
+                sql += (i ? ", (" : "(") + std::to_string(i) + ", 0, \"row\")";
+            ex.run(sql + ";");
+            ex.run("CREATE INDEX " + name + "_id ON " + name + " (id) USING HASH;");
+        }
+    }
+
+    std::printf("threads,ops,ops_per_sec,speedup\n");
+    double base = 0;
+    for (int threads = 1; threads <= 64; threads *= 2) {
+        std::atomic<bool> stop{false};
+        std::atomic<long> total{0};
+        std::vector<std::thread> workers;
+        for (int w = 0; w < threads; ++w)
+            workers.emplace_back([&, w] {
+                std::ostream discard(nullptr);
+                Executor ex(db);
+                ex.setOutput(discard, OutputFormat::CSV);
+                std::mt19937_64 rng(w);
+                long ops = 0;
+                while (!stop.load(std::memory_order_relaxed)) {
+                    const std::string table = "t" + std::to_string(rng() % kTables);
+                    const std::string id = std::to_string(rng() % rows);
+                    if (static_cast<int>(rng() % 100) < updatePct)
+                        ex.run("UPDATE " + table + " SET v = " + std::to_string(ops) + " WHERE id = " + id + ";");
+                    else
+                        ex.run("SELECT v, s FROM " + table + " WHERE id = " + id + ";");
+                    ++ops;
+                }
+                total += ops;
+            });
+        const auto t0 = std::chrono::steady_clock::now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(millis));
+        stop = true;
+        for (auto& th : workers)
+            th.join();
+        const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        const double rate = total.load() / secs;
+        if (threads == 1)
+            base = rate;
+        std::printf("%d,%ld,%.0f,%.2f\n", threads, total.load(), rate, base > 0 ? rate / base : 0.0);
+    }
+    return 0;
+}
@@ -0,0 +1,57 @@
+﻿// Hash join of a build table with a larger probe table, on 1..N threads. Keys
+// are scattered over the build table's key range, so with the default sizes
+// every probe row matches one build row. Each run is timed as a whole
+// (build and probe) and reported with the matches found.
+//
+//     bench_join [build rows] [probe rows] [max threads]
+#include "imd/binder.hpp"
+#include "imd/executor.hpp"
+#include "imd/join.hpp"
+#include "imd/parser.hpp"
+#include "imd/thread_pool.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+using namespace imd;
+
+static void fill(Database& db, const std::string& name, long rows, long keys) {
+    Executor ex(db);
+    ex.run("CREATE TABLE " + name + " (k int, v int) USING COLUMNAR;");
+    Table& t = db.tables[name];
+    t.cols[0].ints.resize(rows);
+    t.cols[1].ints.resize(rows);
+    for (long i = 0; i < rows; ++i) {
+        t.cols[0].ints[i] = (i * 2654435761L) % keys; // scattered, so the build is not sorted by key
+        t.cols[1].ints[i] = i;
+    }
+}
+
+int main(int argc, char** argv) {
+    const long buildRows = argc > 1 ? std::atol(argv[1]) : 1000000;
+    const long probeRows = argc > 2 ? std::atol(argv[2]) : 10000000;
+    const unsigned maxThreads = argc > 3 ? static_cast<unsigned>(std::atoi(argv[3]))
+                                         : std::max(1u, std::thread::hardware_concurrency());
+
+    Database db;
+    fill(db, "dim", buildRows, buildRows);
+    fill(db, "fact", probeRows, buildRows);
+    const auto stmts = Parser("SELECT fact.v, dim.v FROM fact JOIN dim ON fact.k = dim.k;").parseAll();
+    const BoundJoin b = Binder(db).bindJoin(std::get<SelectStmt>(stmts[0]));
+
+    std::printf("threads,matches,ms,probe_rows_per_sec,speedup\n");
+    double base = 0;
+    for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+        ThreadPool pool(threads);
+        size_t matches = 0;
+        const auto start = std::chrono::steady_clock::now();
+        hashJoin(b, &pool, [&](const JoinPairs& pairs) { matches += pairs.size(); });
+        const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (threads == 1)
+            base = secs;
+        std::printf("%u,%zu,%.1f,%.0f,%.2f\n", threads, matches, secs * 1000, probeRows / secs, base / secs);
+    }
+    return 0;
+}
@@ -0,0 +1,227 @@
+﻿// Load generator for `db --listen=...`: opens many connections over loopback,
+// keeps a fixed number of requests in flight on each, and reports throughput
+// and latency percentiles.
+//
+//     loadgen --connect=127.0.0.1:7000 [--connections=1000] [--threads=4]
+//             [--seconds=5] [--pipeline=1] [--rows=10000] [--write-pct=10]
+//
+// The first run creates and fills table bench_kv; requests are indexed point
+// SELECTs and, --write-pct of the time, UPDATEs of one row.
+#include "imd/client.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string connect = "127.0.0.1:7000";
+    int connections = 1000, threads = 4, pipeline = 1, writePct = 10;
+    double seconds = 5;
+    long rows = 10000;
+};
+
+struct Conn {
+    int fd = -1;
+    std::string out, in;
+    size_t outOff = 0, inOff = 0;
+    std::deque<Clock::time_point> sent; // one per request in flight
+    bool wantOut = false;               // EPOLLOUT armed: output is waiting
+};
+
+struct Totals {
+    std::vector<uint32_t> micros; // latency of every completed request
+    long errors = 0;
+};
+
+static void setup(const Options& o) {
+    imd::Client c(o.connect);
+    if (c.query("CREATE TABLE bench_kv (k int, v str);").failed)
+        return; // filled by an earlier run
+    for (long from = 0; from < o.rows; from += 1000) {
+        std::string sql = "INSERT INTO bench_kv (k, v) VALUES ";
+        for (long k = from; k < std::min(o.rows, from + 1000); ++k)
+            sql += (k > from ? ", (" : "(") + std::to_string(k) + ", \"value\")";
+        c.query(sql + ";");
+    }
+    c.query("CREATE INDEX bench_kv_k ON bench_kv (k) USING HASH;");
+}
+
+static void queueRequest(Conn& c, std::mt19937_64& rng, const Options& o) {
+    const std::string k = std::to_string(rng() % static_cast<uint64_t>(o.rows));
+    if (static_cast<int>(rng() % 100) < o.writePct)
+        imd::appendRequest(c.out, "UPDATE bench_kv SET v = \"updated\" WHERE k = " + k + ";");
+    else
+        imd::appendRequest(c.out, "SELECT v FROM bench_kv WHERE k = " + k + ";");
+    c.sent.push_back(Clock::now());
+}
+
+static bool flushConn(Conn& c) {
+    while (c.outOff < c.out.size()) {
+        const ssize_t n = ::send(c.fd, c.out.data() + c.outOff, c.out.size() - c.outOff, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return true;
+        if (n <= 0)
+            return false;
+        c.outOff += static_cast<size_t>(n);
+    }
+    c.out.clear();
+    c.outOff = 0;
+    return true;
+}
+
+static void drive(const Options& o, int first, int count, Clock::time_point deadline, Totals& t) {
+    std::mt19937_64 rng(static_cast<uint64_t>(first) * 7919 + 1);
+    const int ep = ::epoll_create1(0);
+    std::vector<Conn> conns(static_cast<size_t>(count));
+    const imd::Endpoint e = imd::parseEndpoint(o.connect);
+    for (int i = 0; i < count; ++i) {
+        Conn& c = conns[static_cast<size_t>(i)];
+        c.fd = imd::connectSocket(e, true);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u32 = static_cast<uint32_t>(i);
+        ::epoll_ctl(ep, EPOLL_CTL_ADD, c.fd, &ev);
+        for (int p = 0; p < o.pipeline; ++p)
+            queueRequest(c, rng, o);
+        flushConn(c);
+    }
+    std::vector<epoll_event> evs(256);
+    char buf[64 * 1024];
+    while (Clock::now() < deadline) {
+        const int n = ::epoll_wait(ep, evs.data(), static_cast<int>(evs.size()), 10);
+        for (int i = 0; i < n; ++i) {
+            Conn& c = conns[evs[i].data.u32];
+            if (c.fd < 0)
+                continue;
+            if (evs[i].events & EPOLLIN) {
+                for (ssize_t r; (r = ::recv(c.fd, buf, sizeof(buf), 0)) > 0;)
+                    c.in.append(buf, static_cast<size_t>(r));
+                std::string payload;
+                while (imd::nextResponse(c.in, c.inOff, payload)) {
+                    const auto now = Clock::now();
+                    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(now - c.sent.front());
+                    c.sent.pop_front();
+                    t.micros.push_back(static_cast<uint32_t>(us.count()));
+                    if (imd::decodeResponse(payload).failed)
+                        ++t.errors;
+                    if (now < deadline)
+                        queueRequest(c, rng, o);
+                }
+                c.in.erase(0, c.inOff);
+                c.inOff = 0;
+            }
+            if (!flushConn(c) || (evs[i].events & (EPOLLHUP | EPOLLERR))) {
+                ++t.errors;
+                ::close(c.fd);
+                c.fd = -1;
+                continue;
+            }
+            if (c.wantOut != (c.outOff < c.out.size())) {
+                c.wantOut = !c.wantOut;
+                epoll_event ev{};
+                ev.events = EPOLLIN | (c.wantOut ? uint32_t(EPOLLOUT) : 0);
+                ev.data.u32 = evs[i].data.u32;
+                ::epoll_ctl(ep, EPOLL_CTL_MOD, c.fd, &ev);
+            }
+        }
+    }
+    for (auto& c : conns)
+        if (c.fd >= 0)
+            ::close(c.fd);
+    ::close(ep);
+}
+
+static bool flag(const char* arg, const char* name, std::string& value) {
+    const size_t n = std::strlen(name);
+    if (std::strncmp(arg, name, n) != 0)
+        return false;
+    value = arg + n;
+    return true;
+}
+
+int main(int argc, char** argv) {
+    Options o;
+    for (int i = 1; i < argc; ++i) {
+        std::string v;
+        if (flag(argv[i], "--connect=", v))
+            o.connect = v;
+        else if (flag(argv[i], "--connections=", v))
+            o.connections = std::max(1, std::atoi(v.c_str()));
+        else if (flag(argv[i], "--threads=", v))
+            o.threads = std::max(1, std::atoi(v.c_str()));
+        else if (flag(argv[i], "--seconds=", v))
+            o.seconds = std::atof(v.c_str());
+        else if (flag(argv[i], "--pipeline=", v))
+            o.pipeline = std::max(1, std::atoi(v.c_str()));
+        else if (flag(argv[i], "--rows=", v))
+            o.rows = std::max(1L, std::atol(v.c_str()));
+        else if (flag(argv[i], "--write-pct=", v))
+            o.writePct = std::atoi(v.c_str());
+        else {
+            std::fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    rlimit lim;
+    if (::getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < lim.rlim_max) {
+        lim.rlim_cur = lim.rlim_max; // thousands of connections need thousands of descriptors
+        ::setrlimit(RLIMIT_NOFILE, &lim);
+    }
+    try {
+        setup(o);
+        o.threads = std::min(o.threads, o.connections);
+        const auto start = Clock::now();
+        const auto deadline = start +
+                              std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(o.seconds));
+        std::vector<Totals> totals(static_cast<size_t>(o.threads));
+        std::vector<std::thread> threads;
+        std::atomic<int> failed{0};
+        for (int t = 0; t < o.threads; ++t) {
+            const int first = o.connections * t / o.threads, last = o.connections * (t + 1) / o.threads;
+            threads.emplace_back([&, t, first, last] {
+                try {
+                    drive(o, first, last - first, deadline, totals[static_cast<size_t>(t)]);
+                } catch (const std::exception& e) {
+                    std::fprintf(stderr, "%s\n", e.what());
+                    ++failed;
+                }
+            });
+        }
+        for (auto& th : threads)
+            th.join();
+        const double secs = std::chrono::duration<double>(Clock::now() - start).count();
+        std::vector<uint32_t> all;
+        long errors = failed.load();
+        for (auto& t : totals) {
+            all.insert(all.end(), t.micros.begin(), t.micros.end());
+            errors += t.errors;
+        }
+        std::sort(all.begin(), all.end());
+        auto pct = [&](double p) { return all.empty() ? 0u : all[std::min(all.size() - 1, size_t(p * all.size()))]; };
+        std::printf("connections=%d pipeline=%d requests=%zu errors=%ld seconds=%.2f throughput=%.0f/s\n",
+                    o.connections, o.pipeline, all.size(), errors, secs, all.size() / secs);
+        std::printf("latency_us p50=%u p90=%u p99=%u p999=%u max=%u\n", pct(0.50), pct(0.90), pct(0.99),
+                    pct(0.999), all.empty() ? 0u : all.back());
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "loadgen: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,47 @@
+﻿#ifndef IMD_AGGREGATE_HPP
+#define IMD_AGGREGATE_HPP
+
+#include "ast.hpp"
+#include "binder.hpp"
+#include <climits>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace imd {
+
+class ThreadPool;
+
+// ----- Aggregates -----
+// Running count, exact sum, min and max of a run of INT values.
+struct IntSummary {
+    size_t count = 0;
+    __int128 sum = 0;
+    long long min = LLONG_MAX;
+    long long max = LLONG_MIN;
+
+    void merge(const IntSummary& o) {
+        count += o.count;
+        sum += o.sum;
+        min = o.min < min ? o.min : min;
+        max = o.max > max ? o.max : max;
+    }
+};
+
+// Folds v[0, n) into s. Sums wrap in 64-bit lanes and are made exact afterwards
+// from the chunk's min and max, so the inner loops stay vectorized.
+void summarizeInts(const long long* v, size_t n, IntSummary& s);
+// Same over v[rows[0]], ..., v[rows[n - 1]].
+void summarizeInts(const long long* v, const size_t* rows, size_t n, IntSummary& s);
+
+// Evaluates b.aggs with b.where fused into the scan. Without GROUP BY the
+// result is one row, and empty inputs give NULL for SUM, MIN, MAX and AVG
+// (flagged in nulls, one entry per column; left empty when nothing is NULL);
+// with it there is one row per group, in key order. types are the result
+// types either way.
+void aggregate(const BoundSelect& b, ThreadPool* pool, std::vector<std::vector<Value>>& rows,
+               std::vector<ColType>& types, std::vector<uint8_t>& nulls);
+
+} // namespace imd
+
+#endif
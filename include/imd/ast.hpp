@@ -1,7 +1,13 @@
 ﻿#ifndef IMD_AST_HPP
 #define IMD_AST_HPP
 
+#include "value.hpp"
+#include "column.hpp"
+#include "index.hpp"
+#include <functional>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 #include <unordered_map>
@@ -9,61 +15,105 @@
 
 namespace imd {
 
-// ----- Types and values -----
-enum class ColType { INT, STR };
-
-struct Value {
-    std::variant<long long, std::string> data;
-
-    static Value makeInt(long long x) {
-        return Value{x};
-    }
-    static Value makeStr(std::string s) {
-        return Value{std::move(s)};
-    }
-
-    bool isInt() const {
-        return std::holds_alternative<long long>(data);
-    }
-    bool isStr() const {
-        return std::holds_alternative<std::string>(data);
-    }
-
-    long long asInt() const {
-        return std::get<long long>(data);
-    }
-    const std::string& asStr() const {
-        return std::get<std::string>(data);
-    }
-
-    std::string toString() const {
-        if (isInt())
-            return std::to_string(asInt());
-        return asStr();
-    }
-};
+class BackgroundSave;
 
 struct Column {
     std::string name;
     ColType type;
+    bool dict = false; // str DICT: rows keep codes into the table's dictionary for the column
 };
 
 using Row = std::vector<Value>;
 
+// ROW keeps the cells of all records in one row-major array, long strings in
+// the table's arena; COLUMNAR keeps one ColumnData per column.
+enum class Layout { ROW, COLUMNAR };
+
 struct Table {
     std::string name;
     std::vector<Column> columns;
     std::unordered_map<std::string, int> colIndex; // exact (case-sensitive) names
-    std::vector<Row> rows;
+    Layout layout{Layout::ROW};
+    std::vector<Value> cells;     // Layout::ROW: row r is cells[r * columns.size(), (r + 1) * columns.size())
+    StringArena arena;            // Layout::ROW: text of long STR cells, which borrow it
+    size_t arenaGarbage = 0;      // arena bytes no longer referenced
+    std::vector<ColumnData> cols; // Layout::COLUMNAR (one per column)
+    std::vector<StrDict> dicts;   // one per column, used by DICT columns in either layout
+    std::vector<std::unique_ptr<Index>> indexes;
 
     int indexOf(const std::string& col) const {
         auto it = colIndex.find(col);
         return (it == colIndex.end()) ? -1 : it->second;
     }
+
+    // Layout-independent cell access; column j must have the matching type.
+    size_t rowCount() const {
+        if (layout == Layout::ROW)
+            return columns.empty() ? 0 : cells.size() / columns.size();
+        if (cols.empty())
+            return 0;
+        if (columns[0].type == ColType::INT)
+            return cols[0].ints.size();
+        return columns[0].dict ? cols[0].codes.size() : cols[0].strs.size();
+    }
+    size_t capacity() const { // rows that fit before the next reallocation
+        if (layout == Layout::ROW)
+            return columns.empty() ? 0 : cells.capacity() / columns.size();
+        if (cols.empty())
+            return 0;
+        if (columns[0].type == ColType::INT)
+            return cols[0].ints.capacity();
+        return columns[0].dict ? cols[0].codes.capacity() : cols[0].strs.capacity();
+    }
+    long long intAt(size_t r, int j) const {
+        return layout == Layout::ROW ? cell(r, j).asInt() : cols[j].ints[r];
+    }
+    std::string_view strAt(size_t r, int j) const {
+        if (columns[j].dict)
+            return dicts[j].at(codeAt(r, j));
+        return layout == Layout::ROW ? cell(r, j).asStr() : cols[j].strs.at(r);
+    }
+    uint32_t codeAt(size_t r, int j) const { // DICT column
+        return layout == Layout::ROW ? static_cast<uint32_t>(cell(r, j).asInt()) : cols[j].codes[r];
+    }
+    const Value& cell(size_t r, int j) const { // Layout::ROW; long strings borrow from arena, DICT cells are codes
+        return cells[r * columns.size() + j];
+    }
+    const Index* findIndex(int col, IndexKind kind) const {
+        for (const auto& ix : indexes)
+            if (ix->column() == col && ix->kind() == kind)
+                return ix.get();
+        return nullptr;
+    }
+
+    Value get(size_t r, int j) const;  // owns its string
+    Value peek(size_t r, int j) const; // borrows its string, valid while the table is unchanged
+
+    void set(size_t r, int j, const Value& v);
+    void append(Row&& r);
+    void reserve(size_t n);
+    void clear();
+    size_t compact(const std::vector<uint8_t>& keep, ThreadPool* pool = nullptr); // drops rows with keep[i] == 0
+    void addIndex(std::unique_ptr<Index> ix);           // fills it from the current rows
+    Value storeStr(std::string_view s);                 // Layout::ROW: s as a cell value, long text copied to arena
+
+  private:
+    void repackArena();
 };
 
 struct Database {
     std::unordered_map<std::string, Table> tables; // exact names
+    // Tables restored from a snapshot start as catalog entries (no rows, no
+    // indexes); their filler copies the data in from the mapped file on first use.
+    std::unordered_map<std::string, std::function<void(Table&)>> pending;
+    // Bumped whenever tables are added or replaced, so plans bound against an
+    // older catalog (cached table pointers) know to bind again.
+    uint64_t epoch = 0;
+    // BGSAVE state, shared by every Executor (session) on this database; see backgroundSave().
+    std::shared_ptr<BackgroundSave> bgsave;
+
+    Table* find(const std::string& name); // fills a pending table first; null when absent
+    void loadAll();                        // fills every pending table
 };
 
 // ----- WHERE condition -----
@@ -72,36 +122,126 @@ enum class CmpOp { EQ, NE, LT, LE, GT, GE };
 struct Condition {
     std::string column;
     CmpOp op{CmpOp::EQ};
-    Value literal; // int or string
+    Value literal;  // int or string
+    int param = -1; // index of the '?' placeholder that supplies literal, or -1
+};
+
+// Boolean combination of comparisons. AND/OR are n-ary (parser flattens chains).
+enum class ExprKind { CMP, AND, OR, NOT };
+struct Expr {
+    ExprKind kind{ExprKind::CMP};
+    Condition cmp;          // CMP
+    std::vector<Expr> kids; // AND/OR: two or more, NOT: one
 };
 
 // ----- Statements -----
 struct CreateStmt {
     std::string table;
-    std::vector<std::pair<std::string, ColType>> columns;
+    std::vector<Column> columns;
+    Layout layout{Layout::ROW}; // USING ROW | USING COLUMNAR
 };
 struct InsertStmt {
     std::string table;
     std::vector<std::string> cols;
     std::vector<std::vector<Value>> rows;
+    std::vector<std::pair<size_t, size_t>> params; // (row, value) of each '?' placeholder, in order
+    size_t rowsHint = 0; // streamed batch: tuples expected from this batch to the end of the statement
+    // Streamed statements arrive as a FIRST batch, MIDDLE batches and the LAST
+    // remainder (Parser::setInsertSink); anything else is WHOLE.
+    enum class Part : uint8_t { WHOLE, FIRST, MIDDLE, LAST };
+    Part part = Part::WHOLE;
 };
 struct DeleteStmt {
     std::string table;
-    std::optional<Condition> where;
+    std::optional<Expr> where;
 };
 struct UpdateStmt {
     std::string table;
     std::vector<std::pair<std::string, Value>> assignments;
-    std::optional<Condition> where;
+    std::vector<int> params; // per assignment: index of its '?' placeholder or -1 (may stop short)
+    std::optional<Expr> where;
+};
+struct CreateIndexStmt {
+    std::string name;
+    std::string table;
+    std::string column;
+    IndexKind kind{IndexKind::HASH};
+};
+struct DropIndexStmt {
+    std::string name;
+};
+// COUNT(*) | COUNT(col) | SUM(col) | MIN(col) | MAX(col) | AVG(col)
+enum class AggFn { COUNT, SUM, MIN, MAX, AVG };
+struct Aggregate {
+    AggFn fn{AggFn::COUNT};
+    std::string column; // empty for COUNT(*)
+    size_t pos{0};      // position in the select list
+};
+// FROM a JOIN b ON left = right; either side may be written first.
+struct JoinClause {
+    std::string table;
+    std::string left, right; // <column> or <table>.<column>
 };
 struct SelectStmt {
     bool selectAll{false};
     std::vector<std::string> cols; // ignored if selectAll==true
+    std::vector<Aggregate> aggregates; // select list items that are aggregates
+    std::string table;
+    std::optional<JoinClause> join;
+    std::optional<Expr> where;
+    std::string groupBy; // empty: no GROUP BY
+    std::string orderBy; // empty: table order
+    bool desc{false};
+    std::optional<Value> limit; // int; absent: no LIMIT
+    Value offset;               // int
+    int limitParam = -1;        // '?' placeholders supplying limit / offset, or -1
+    int offsetParam = -1;
+};
+
+// PREPARE <name> AS <statement with '?' placeholders>
+struct PreparedBody;
+struct PrepareStmt {
+    std::string name;
+    std::shared_ptr<const PreparedBody> body;
+};
+// EXECUTE <name> [( <literal>, ... )]
+struct ExecuteStmt {
+    std::string name;
+    std::vector<Value> args;
+};
+// DEALLOCATE <name>
+struct DeallocateStmt {
+    std::string name;
+};
+
+// COPY <table> FROM "<file.csv>" | COPY <table> TO "<file.csv>"
+struct CopyStmt {
     std::string table;
-    std::optional<Condition> where;
+    std::string path;
+    bool from{true}; // false: export
 };
 
-using Statement = std::variant<CreateStmt, InsertStmt, DeleteStmt, UpdateStmt, SelectStmt>;
+// SAVE "<file>" | LOAD "<file>": whole-database snapshots
+struct SaveStmt {
+    std::string path;
+};
+struct LoadStmt {
+    std::string path;
+};
+// BGSAVE "<file>" | BGSAVE STATUS
+struct BgSaveStmt {
+    std::string path;
+    bool status{false};
+};
+
+using Statement = std::variant<CreateStmt, InsertStmt, DeleteStmt, UpdateStmt, SelectStmt, CreateIndexStmt,
+                               DropIndexStmt, PrepareStmt, ExecuteStmt, DeallocateStmt, CopyStmt, SaveStmt, LoadStmt,
+                               BgSaveStmt>;
+
+struct PreparedBody {
+    Statement stmt; // INSERT / DELETE / UPDATE / SELECT
+    size_t params{0};
+};
 
 } // namespace imd
 
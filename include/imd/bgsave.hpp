@@ -0,0 +1,64 @@
+﻿#ifndef IMD_BGSAVE_HPP
+#define IMD_BGSAVE_HPP
+
+#include "ast.hpp"
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace imd {
+
+// ----- Background snapshots -----
+// BGSAVE forks: the child writes a snapshot from its copy-on-write view of
+// memory while the parent keeps executing statements. The parent prepares a
+// SnapshotWriter first, so the child of this multithreaded process makes only
+// async-signal-safe calls and never allocates. The parent pauses only for
+// fork() itself, which is measured. Progress is shared through an anonymous
+// MAP_SHARED page. POSIX only.
+//
+// There is one per Database (backgroundSave()), so every session sees the same
+// save and a second BGSAVE is refused while one runs. Its methods may be called
+// from any thread. The child is reaped without blocking by status() and start();
+// only wait() and the destructor (when the database goes away) block on it.
+class BackgroundSave {
+  public:
+    enum class State { IDLE, RUNNING, DONE, FAILED };
+    struct Status {
+        State state = State::IDLE;
+        std::string path;
+        uint64_t cellsDone = 0, cellsTotal = 0;
+        uint64_t forkMicros = 0; // parent pause for fork()
+        double seconds = 0;      // elapsed so far, or total once finished
+        std::string error;       // FAILED
+    };
+
+    BackgroundSave();
+    ~BackgroundSave(); // waits for a running child, so its snapshot is complete
+    BackgroundSave(const BackgroundSave&) = delete;
+    BackgroundSave& operator=(const BackgroundSave&) = delete;
+
+    void start(Database& db, const std::string& path); // throws if a save is running or fork fails
+    Status status();                                    // reaps the child once it has exited
+    Status wait();                                      // blocks until the running save (if any) ends
+
+  private:
+    struct Shared;
+    std::mutex m_;
+    Shared* shared_ = nullptr;
+    long pid_ = -1;
+    Status last_;
+    std::chrono::steady_clock::time_point started_;
+
+    Status poll(); // status() with m_ held
+    void finish(int waitStatus);
+};
+
+// db's BackgroundSave, created on first use.
+BackgroundSave& backgroundSave(Database& db);
+
+const char* stateName(BackgroundSave::State s);
+
+} // namespace imd
+
+#endif
@@ -0,0 +1,120 @@
+﻿#ifndef IMD_BINDER_HPP
+#define IMD_BINDER_HPP
+
+#include "ast.hpp"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace imd {
+
+// ----- Bound plans -----
+// The binder resolves a parsed statement against the catalog once: table
+// pointers, column ordinals and type-checked literals. Executing a bound plan
+// does no name lookups. Plans borrow literals from the statement they were
+// bound from, which must outlive them.
+
+// A comparison with its column resolved and its literal checked against the
+// column type. Mixed-type EQ / NE fold to a constant; other mixed ops are errors.
+struct BoundCmp {
+    enum class Fold { NONE, ALWAYS, NEVER };
+    int col = -1;
+    ColType type{ColType::INT};
+    CmpOp op{CmpOp::EQ};
+    Fold fold{Fold::NONE};
+    const Value* literal = nullptr; // for index probes
+    long long ival = 0;             // INT column
+    std::string_view sval;          // STR column
+    bool (*strCmp)(std::string_view v, std::string_view lit) = nullptr; // STR column, op != EQ / NE
+};
+
+struct BoundExpr {
+    ExprKind kind{ExprKind::CMP};
+    BoundCmp cmp;
+    std::vector<BoundExpr> kids;
+};
+
+struct BoundCreate {
+    Table table; // empty, schema filled in
+};
+struct BoundInsert {
+    Table* table = nullptr;
+    Row defaults;         // one value per table column
+    std::vector<int> pos; // table ordinal of each VALUES position
+    const std::vector<std::vector<Value>>* rows = nullptr; // every value already type-checked
+};
+struct BoundDelete {
+    Table* table = nullptr;
+    std::optional<BoundExpr> where;
+};
+struct BoundUpdate {
+    Table* table = nullptr;
+    std::vector<std::pair<int, const Value*>> sets; // (ordinal, value)
+    std::optional<BoundExpr> where;
+};
+struct BoundAgg {
+    AggFn fn{AggFn::COUNT};
+    int col = -1;     // -1: COUNT(*)
+    bool key = false; // the GROUP BY column itself rather than an aggregate
+};
+
+struct BoundSelect {
+    const Table* table = nullptr;
+    std::vector<int> proj;
+    std::vector<BoundAgg> aggs; // select list of an aggregate query; proj is empty then
+    int groupCol = -1;          // GROUP BY column, -1 when absent
+    int orderCol = -1;          // ORDER BY column, -1 for table order
+    bool desc = false;
+    size_t offset = 0;
+    size_t limit = SIZE_MAX; // SIZE_MAX: no LIMIT
+    std::vector<std::string> headers;
+    std::optional<BoundExpr> where;
+};
+
+// FROM side[0] JOIN side[1] ON side[0].key[0] = side[1].key[1]. Every output
+// column and WHERE conjunct reads one side; conjuncts are applied to their
+// side before the join.
+struct BoundJoin {
+    const Table* side[2] = {nullptr, nullptr};
+    int key[2] = {-1, -1};
+    std::optional<BoundExpr> where[2];
+    std::vector<std::pair<int, int>> proj; // (side, column)
+    std::vector<std::string> headers;
+    size_t offset = 0;
+    size_t limit = SIZE_MAX;
+};
+
+BoundCmp bindCmp(const Table& t, const Condition& c);
+BoundExpr bindExpr(const Table& t, const Expr& e);
+
+class Binder {
+  public:
+    explicit Binder(Database& db) : db_(db) {}
+
+    Table& table(const std::string& name) const; // throws "No such table"
+
+    BoundCreate bind(const CreateStmt& s) const;
+    BoundInsert bind(const InsertStmt& s) const;
+    BoundDelete bind(const DeleteStmt& s) const;
+    BoundUpdate bind(const UpdateStmt& s) const;
+    BoundSelect bind(const SelectStmt& s) const; // single-table SELECT
+    BoundJoin bindJoin(const SelectStmt& s) const; // SELECT with JOIN
+
+    // Redoes what b took from the literals of s (type checks, folds, string
+    // kernels, LIMIT / OFFSET) after they were overwritten in place, e.g. by
+    // a plan-cache hit. Names stay resolved, so the catalog must not have
+    // changed since b was bound (Database::epoch).
+    void rebind(BoundInsert& b, const InsertStmt& s) const;
+    void rebind(BoundDelete& b, const DeleteStmt& s) const;
+    void rebind(BoundUpdate& b, const UpdateStmt& s) const;
+    void rebind(BoundSelect& b, const SelectStmt& s) const;
+
+  private:
+    Database& db_;
+};
+
+} // namespace imd
+
+#endif
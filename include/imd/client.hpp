@@ -0,0 +1,38 @@
+﻿#ifndef IMD_CLIENT_HPP
+#define IMD_CLIENT_HPP
+
+#include "protocol.hpp"
+#include <string>
+#include <string_view>
+
+namespace imd {
+
+// Connected, blocking (or non-blocking) socket to a server endpoint; throws on failure.
+int connectSocket(const Endpoint& e, bool nonBlocking = false);
+
+// ----- Client -----
+// A blocking connection to a Server. query() is one round trip; for
+// pipelining, send() several requests (buffered until the next receive() or
+// flush()) and receive() their responses in the same order.
+class Client {
+  public:
+    explicit Client(const std::string& endpoint); // unix:/path or host:port
+    ~Client();
+    Client(const Client&) = delete;
+    Client& operator=(const Client&) = delete;
+
+    Response query(std::string_view sql);
+    void send(std::string_view sql);
+    void flush();
+    Response receive(); // throws when the server closes the connection
+
+  private:
+    int fd_ = -1;
+    std::string out_; // requests not yet written
+    std::string in_;  // received, not yet decoded
+    size_t inOff_ = 0;
+};
+
+} // namespace imd
+
+#endif
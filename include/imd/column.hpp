@@ -0,0 +1,117 @@
+﻿#ifndef IMD_COLUMN_HPP
+#define IMD_COLUMN_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace imd {
+
+class ThreadPool;
+
+// ----- Column-major storage -----
+// Strings of one STR column live back to back in a single heap; each row keeps
+// (offset, length) into it. Overwrites that do not fit in place append to the
+// heap, and the dead bytes are reclaimed once they outweigh the live ones.
+class StrColumn {
+  public:
+    size_t size() const {
+        return offs_.size();
+    }
+    size_t capacity() const {
+        return offs_.capacity();
+    }
+    std::string_view at(size_t i) const {
+        return std::string_view(heap_.data() + offs_[i], lens_[i]);
+    }
+
+    void reserve(size_t n) {
+        offs_.reserve(n);
+        lens_.reserve(n);
+    }
+    void push_back(std::string_view s);
+    void assign(const uint64_t* offs, size_t n, std::string_view heap); // string i is heap[offs[i], offs[i + 1])
+    void set(size_t i, std::string_view s);
+    void clear();
+    void compact(const std::vector<uint8_t>& keep, ThreadPool* pool = nullptr); // keep[i] != 0 -> row i survives
+
+  private:
+    std::vector<uint64_t> offs_;
+    std::vector<uint32_t> lens_;
+    std::string heap_;
+    size_t garbage_ = 0; // bytes in heap_ no longer referenced
+
+    void repack();
+};
+
+struct ColumnData {
+    std::vector<long long> ints; // ColType::INT
+    StrColumn strs;              // ColType::STR
+    std::vector<uint32_t> codes; // ColType::STR, dictionary encoded
+};
+
+// ----- Row-major string storage -----
+// Bump allocator for the long strings of a ROW table's cells, which borrow
+// them (Value::borrowStr). Blocks never move, so copies stay valid until
+// clear(); dead bytes are only reclaimed by copying the live ones to a new arena.
+class StringArena {
+  public:
+    std::string_view copy(std::string_view s);
+    size_t bytes() const { // handed out since the last clear()
+        return used_;
+    }
+    void clear();
+
+  private:
+    static constexpr size_t kBlock = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char* cur_ = nullptr;
+    size_t left_ = 0; // free bytes at cur_
+    size_t used_ = 0;
+};
+
+// ----- Dictionary encoding -----
+// The distinct strings of a DICT column, each stored once; rows keep a code.
+// Codes are handed out in order of first appearance. Ranks order the codes
+// like their strings, so comparisons against a literal become integer
+// comparisons on codes or ranks. Adding strings only marks the ranks stale;
+// the first reader that needs them re-sorts once (readers may be concurrent).
+class StrDict {
+  public:
+    StrDict() = default;
+    StrDict(StrDict&& o) noexcept;
+    StrDict& operator=(StrDict&& o) noexcept;
+
+    size_t size() const {
+        return strs_.size();
+    }
+    std::string_view at(uint32_t code) const {
+        return strs_[code];
+    }
+
+    uint32_t encode(std::string_view s);          // adds s when new
+    long long find(std::string_view s) const;     // code of s, or -1
+    const uint32_t* ranks() const;                // rank of each code, sorting first when stale
+    uint32_t lowerRank(std::string_view s) const; // entries ordering before s
+    uint32_t upperRank(std::string_view s) const; // entries ordering before s or equal to it
+    void clear();
+
+  private:
+    StringArena text_;
+    std::vector<std::string_view> strs_; // by code
+    std::unordered_map<std::string_view, uint32_t> codes_;
+    mutable std::vector<uint32_t> sorted_; // codes in string order
+    mutable std::vector<uint32_t> ranks_;  // position of each code in sorted_
+    mutable std::atomic<bool> stale_{false};
+    mutable std::mutex sortM_;
+};
+
+} // namespace imd
+
+#endif
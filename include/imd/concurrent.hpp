@@ -0,0 +1,72 @@
+﻿#ifndef IMD_CONCURRENT_HPP
+#define IMD_CONCURRENT_HPP
+
+#include "ast.hpp"
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+namespace imd {
+
+// ----- Sharded reader-writer lock -----
+// Readers lock only the shard of their thread, so readers on different cores
+// never write the same cache line; a writer takes every shard.
+class ShardedSharedMutex {
+  public:
+    void lock();
+    void unlock();
+    void lock_shared();
+    void unlock_shared();
+
+  private:
+    static constexpr size_t kShards = 64;
+    struct alignas(64) Shard {
+        std::shared_mutex m;
+    };
+    Shard shards_[kShards];
+    static size_t shardOfThisThread();
+};
+
+// ----- Shared database -----
+// A Database used by several threads at once, each through its own Executor:
+//
+//     ConcurrentDatabase db;
+//     Executor ex(db); // one per thread
+//     ex.run("SELECT ...");
+//
+// Every statement first takes the catalog latch: shared for statements on one
+// table, exclusive for CREATE TABLE / INDEX, DROP INDEX, SAVE, LOAD and BGSAVE.
+// Statements on one table then take that table's reader-writer latch: SELECT
+// and COPY TO share it, INSERT / UPDATE / DELETE / COPY FROM hold it alone.
+// A JOIN shares the latches of both its tables. Readers and writers of one
+// table therefore wait for each other; MvccDatabase (mvcc.hpp) is the store
+// whose readers never wait, for the statements it supports.
+class ConcurrentDatabase {
+  public:
+    // Latches held for one statement, released in reverse order.
+    struct Guard {
+        std::shared_lock<ShardedSharedMutex> catalogShared;
+        std::unique_lock<ShardedSharedMutex> catalogExclusive;
+        std::shared_lock<std::shared_mutex> tableShared;
+        std::unique_lock<std::shared_mutex> tableExclusive;
+        std::shared_lock<std::shared_mutex> joinShared; // second table of a JOIN
+    };
+    Guard lock(const Statement& st);
+
+    // Unsynchronized access: only while no other thread uses the database.
+    Database& data() {
+        return db_;
+    }
+
+  private:
+    Database db_;
+    ShardedSharedMutex catalog_;
+    // One latch per table; entries are added under the exclusive catalog latch and never removed.
+    std::unordered_map<std::string, std::unique_ptr<std::shared_mutex>> latches_;
+};
+
+} // namespace imd
+
+#endif
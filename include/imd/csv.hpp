@@ -0,0 +1,32 @@
+﻿#ifndef IMD_CSV_HPP
+#define IMD_CSV_HPP
+
+#include "ast.hpp"
+#include <cstddef>
+#include <string>
+
+namespace imd {
+
+class ThreadPool;
+
+// ----- CSV scanning kernels (AVX2 / SSE4.2 / scalar, per simdLevel()) -----
+size_t countByte(const char* p, size_t n, char c);
+// First ',', '"', CR or LF in [p, end); end when there is none.
+const char* findCsvSpecial(const char* p, const char* end);
+
+// ----- COPY -----
+// CSV with a header row naming table columns (any order; missing columns get
+// defaults). Quoted fields may hold commas, newlines and "" escapes; blank
+// lines are skipped.
+//
+// copyFrom maps the file, cuts it into chunks at record boundaries (found
+// from quote parity, so newlines inside quotes are handled), then parses and
+// type-checks the chunks in parallel. Rows are appended only if every record
+// is valid. Returns the number of rows loaded.
+size_t copyFrom(Table& t, const std::string& path, ThreadPool* pool = nullptr);
+// Writes t as CSV with a header row, formatting morsels in parallel. Returns the row count.
+size_t copyTo(const Table& t, const std::string& path, ThreadPool* pool = nullptr);
+
+} // namespace imd
+
+#endif
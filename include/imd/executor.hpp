@@ -2,25 +2,111 @@
 #define IMD_EXECUTOR_HPP
 
 #include "ast.hpp"
+#include "concurrent.hpp"
+#include "prepared.hpp"
+#include "renderer.hpp"
+#include "thread_pool.hpp"
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 
 namespace imd {
 
+class Wal;
+
 class Executor {
   public:
-    explicit Executor(Database& db) : db_(db) {}
+    explicit Executor(Database& db) : db_(db), pool_(&ThreadPool::shared()), out_(&std::cout) {}
+    // Shares db with executors on other threads; each statement holds db's latches while it runs.
+    explicit Executor(ConcurrentDatabase& db);
     void execute(const Statement& st);
+    // INSERT values are moved into the table instead of copied. The partial
+    // batches of a streamed INSERT (Parser::setInsertSink) and its closing
+    // remainder apply as one statement: the table latch is held from the first
+    // batch to the last, and the WAL logs the batches so that replay drops them
+    // unless the closing record made it to disk too.
+    void execute(Statement&& st);
+
+    // Large scans, updates and deletes run on this pool (ThreadPool::shared() by default).
+    void setThreadPool(ThreadPool& pool) {
+        pool_ = &pool;
+    }
+
+    // SELECT results stream to out (std::cout by default) in the given format.
+    void setOutput(std::ostream& out, OutputFormat format = OutputFormat::ASCII) {
+        out_ = &out;
+        format_ = format;
+    }
+    void setFormat(OutputFormat format) {
+        format_ = format;
+    }
+    OutputFormat format() const {
+        return format_;
+    }
+
+    // Runs ';'-terminated statements from sql. INSERT/DELETE/UPDATE/SELECT go
+    // through the plan cache: once their shape repeats, a lexer pass and a
+    // rebind of the new literals replace parsing and binding.
+    void run(std::string_view sql);
+    const PlanCache& planCache() const {
+        return cache_;
+    }
+
+    // ----- Prepared statements (also reachable via PREPARE / EXECUTE / DEALLOCATE) -----
+    void prepare(const std::string& name, const std::string& sql); // one statement with '?' placeholders
+    void executePrepared(const std::string& name, std::vector<Value> args);
+    void deallocate(const std::string& name);
+
+    // ----- Write-ahead log -----
+    // Mutating statements are appended to wal once they bind. With syncEach,
+    // each one returns when durable (run() waits once per call); otherwise only
+    // sync() waits, and the log trails memory by at most one group-commit window.
+    void setWal(Wal* wal, bool syncEach = true) {
+        wal_ = wal;
+        syncEach_ = syncEach;
+    }
+    size_t recover(Wal& wal); // replays wal into the database without logging it again
+    void sync();              // waits until everything logged so far is durable
 
   private:
     Database& db_;
+    ConcurrentDatabase* shared_ = nullptr;
+    ThreadPool* pool_;
+    std::ostream* out_;
+    OutputFormat format_ = OutputFormat::ASCII;
+    std::unordered_map<std::string, std::unique_ptr<PreparedStmt>> prepared_;
+    PlanCache cache_;
+    std::optional<ConcurrentDatabase::Guard> streamLatch_; // held across a streamed INSERT's batches
+    Wal* wal_ = nullptr;
+    bool syncEach_ = true;
+    int deferSync_ = 0; // > 0 inside run(): one wait at the end
+    void commit(uint64_t lsn);
+    void runStatements(std::string_view sql);
     void exec(const CreateStmt& s);
+    void execute(PreparedStmt& p, std::vector<Value>&& args); // reuses p's bound plan
+    template <class B, class S> void execPlan(PreparedStmt& p, const S& s);
     void exec(const InsertStmt& s);
+    void exec(const BoundInsert& b, const InsertStmt& s);
+    void exec(InsertStmt&& s);
     void exec(const DeleteStmt& s);
+    void exec(const BoundDelete& b, const DeleteStmt& s);
     void exec(const UpdateStmt& s);
+    void exec(const BoundUpdate& b, const UpdateStmt& s);
     void exec(const SelectStmt& s);
-
-    static Value defaultFor(ColType t);
-    static bool rowMatches(const Table& t, const Row& r, const Condition& c);
-    static void ensureTableExists(const Database& db, const std::string& name);
+    void exec(const BoundSelect& b);
+    void execJoin(const SelectStmt& s);
+    void exec(const CreateIndexStmt& s);
+    void exec(const DropIndexStmt& s);
+    void exec(const PrepareStmt& s);
+    void exec(const ExecuteStmt& s);
+    void exec(const DeallocateStmt& s);
+    void exec(const CopyStmt& s);
+    void exec(const SaveStmt& s);
+    void exec(const LoadStmt& s);
+    void exec(const BgSaveStmt& s);
 };
 
 } // namespace imd
@@ -0,0 +1,57 @@
+﻿#ifndef IMD_FILTER_HPP
+#define IMD_FILTER_HPP
+
+#include "ast.hpp"
+#include "binder.hpp"
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+namespace imd {
+
+class ThreadPool;
+
+// ----- Vectorized filtering -----
+// WHERE is evaluated a batch at a time into a bitmask, which is then turned
+// into a selection vector: ascending row positions that passed.
+enum class SimdLevel { SCALAR, SSE42, AVX2 };
+
+SimdLevel detectSimd();          // best level this CPU supports (CPUID, checked once)
+SimdLevel simdLevel();           // level in use
+void setSimdLevel(SimdLevel lv); // clamped to detectSimd(); mainly for tests
+
+// Bit i of mask is set when vals[i] <op> lit. mask holds (n + 63) / 64 words.
+void cmpInt(const long long* vals, size_t n, CmpOp op, long long lit, uint64_t* mask);
+// Equality that rejects on length, then on the first 8 bytes, before comparing the rest.
+void eqStr(const std::string_view* vals, size_t n, std::string_view lit, uint64_t* mask);
+
+// Appends rows of t satisfying c to out. Candidates are all rows, or only the
+// (ascending) positions in *in when given.
+void filterRows(const Table& t, const BoundCmp& c, const std::vector<size_t>* in, std::vector<size_t>& out);
+
+// Appends rows answered by an index on c's column; false when c needs a scan.
+bool probeIndex(const Table& t, const BoundCmp& c, std::vector<size_t>& out);
+
+// Appends rows of t satisfying e, ascending. A comparison that an index can
+// answer (alone or as a conjunct) seeds the candidates; the rest is evaluated
+// chunk by chunk with short-circuiting, re-ordering AND/OR operands between
+// chunks so cheap, selective predicates run first. Large scans are split into
+// morsels and filtered on the pool; results keep table order.
+void filterRows(const Table& t, const BoundExpr& e, std::vector<size_t>& out, ThreadPool* pool = nullptr);
+
+// Streaming form of filterRows: calls emit with consecutive, ascending slices
+// of the result (all rows when e is null). Candidates are processed a window
+// of one morsel per pool thread at a time, so memory stays bounded. The scan
+// stops once limit rows have been emitted; windows then start at one morsel
+// and grow, so a small limit reads little of the table.
+void scanRows(const Table& t, const BoundExpr* e, ThreadPool* pool,
+              const std::function<void(const std::vector<size_t>& rows)>& emit, size_t limit = SIZE_MAX);
+
+// Convenience overloads that bind c / e against t first.
+void filterRows(const Table& t, const Condition& c, const std::vector<size_t>* in, std::vector<size_t>& out);
+void filterRows(const Table& t, const Expr& e, std::vector<size_t>& out, ThreadPool* pool = nullptr);
+
+} // namespace imd
+
+#endif
@@ -0,0 +1,177 @@
+﻿#ifndef IMD_INDEX_HPP
+#define IMD_INDEX_HPP
+
+#include "value.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace imd {
+
+// ----- Secondary indexes -----
+// Indexes map a column value to row positions in the owning Table. The table
+// keeps them in sync (append/set/compact/clear), so statements never touch
+// them directly except to probe.
+enum class IndexKind { HASH, BTREE };
+
+class Index {
+  public:
+    Index(std::string name, int column, ColType type) : name_(std::move(name)), column_(column), type_(type) {}
+    virtual ~Index() = default;
+
+    const std::string& name() const {
+        return name_;
+    }
+    int column() const {
+        return column_;
+    }
+    ColType type() const {
+        return type_;
+    }
+    virtual IndexKind kind() const = 0;
+
+    virtual void insert(const Value& key, size_t row) = 0;
+    virtual void erase(const Value& key, size_t row) = 0;
+    virtual void compact(const std::vector<uint8_t>& keep) = 0; // same mask as Table::compact
+    virtual void clear() = 0;
+
+    // Appends rows whose value equals key, in ascending row order.
+    virtual void equal(const Value& key, std::vector<size_t>& out) const = 0;
+
+  private:
+    std::string name_;
+    int column_;
+    ColType type_;
+};
+
+namespace detail {
+
+// murmur3's 64-bit finalizer. A bijection, so equal INT hashes mean equal keys;
+// hash indexes, hash joins and GROUP BY tables probe with it.
+inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    return x ^ (x >> 33);
+}
+
+// Open-addressing (linear probing) multimap from key to row positions.
+// Most keys have one row, which is stored inline in the slot. String keys are
+// probed by string_view, so only a key new to the table is copied.
+template <class K> class OpenTable {
+  public:
+    using KeyArg = std::conditional_t<std::is_same_v<K, std::string>, std::string_view, K>;
+    struct Slot {
+        K key{};
+        size_t row = 0;
+        std::vector<size_t> more; // further rows with the same key
+        uint8_t state = 0;        // 0 empty, 1 full, 2 tombstone
+    };
+
+    void insert(KeyArg key, size_t row);
+    void erase(KeyArg key, size_t row);
+    const Slot* find(KeyArg key) const;
+    void compact(const std::vector<size_t>& newPos, const std::vector<uint8_t>& keep);
+    void clear();
+
+  private:
+    std::vector<Slot> slots_;
+    size_t used_ = 0;  // full slots
+    size_t tombs_ = 0; // tombstones
+
+    size_t probe(KeyArg key) const; // slot holding key, or slots_.size()
+    void rehash(size_t cap);
+};
+
+// B+-tree over (key, row) pairs, so duplicate keys need no posting lists.
+// Nodes are cache-line aligned and sized to a fixed byte budget; leaves are
+// chained for range walks. Erase does not merge nodes: once more entries were
+// erased than are left, it rebuilds the tree bottom-up, as compact() does
+// (every row position after a deletion shifts anyway).
+template <class K> class BPlusTree {
+  public:
+    BPlusTree();
+    ~BPlusTree();
+    BPlusTree(const BPlusTree&) = delete;
+    BPlusTree& operator=(const BPlusTree&) = delete;
+
+    void insert(const K& key, size_t row);
+    void erase(const K& key, size_t row);
+    void clear();
+    void compact(const std::vector<size_t>& newPos, const std::vector<uint8_t>& keep);
+
+    // Rows with key in the given bounds (nullptr = unbounded), in (key, row)
+    // order; at most limit of them.
+    void range(const K* lo, bool loIncl, const K* hi, bool hiIncl, std::vector<size_t>& out,
+               size_t limit = SIZE_MAX) const;
+
+    size_t size() const {
+        return size_;
+    }
+    size_t leaves() const; // walks the leaf chain
+
+  private:
+    struct Node;
+    struct Leaf;
+    struct Inner;
+    Node* root_;
+    size_t size_ = 0;   // entries
+    size_t erased_ = 0; // erases since the tree was last built
+
+    Leaf* leftmost() const;
+    void build(std::vector<K>& keys, std::vector<size_t>& rows);
+    void rebuild(); // from the leaf chain, at build()'s fill
+};
+
+} // namespace detail
+
+class HashIndex : public Index {
+  public:
+    using Index::Index;
+
+    IndexKind kind() const override {
+        return IndexKind::HASH;
+    }
+    void insert(const Value& key, size_t row) override;
+    void erase(const Value& key, size_t row) override;
+    void compact(const std::vector<uint8_t>& keep) override;
+    void clear() override;
+    void equal(const Value& key, std::vector<size_t>& out) const override;
+
+  private:
+    detail::OpenTable<long long> ints_;  // ColType::INT
+    detail::OpenTable<std::string> strs_; // ColType::STR
+};
+
+class BTreeIndex : public Index {
+  public:
+    using Index::Index;
+
+    IndexKind kind() const override {
+        return IndexKind::BTREE;
+    }
+    void insert(const Value& key, size_t row) override;
+    void erase(const Value& key, size_t row) override;
+    void compact(const std::vector<uint8_t>& keep) override;
+    void clear() override;
+    void equal(const Value& key, std::vector<size_t>& out) const override;
+
+    // Appends up to limit rows whose value lies within the bounds (nullptr =
+    // unbounded). KEY keeps the tree's (key, row) order, e.g. for ORDER BY;
+    // ROW sorts them into table order, as filters expect. Bounds must have the
+    // index's type.
+    enum class Order { KEY, ROW };
+    void range(const Value* lo, bool loIncl, const Value* hi, bool hiIncl, std::vector<size_t>& out, Order order,
+               size_t limit = SIZE_MAX) const;
+
+  private:
+    detail::BPlusTree<long long> ints_;
+    detail::BPlusTree<std::string> strs_;
+};
+
+} // namespace imd
+
+#endif
@@ -0,0 +1,31 @@
+﻿#ifndef IMD_JOIN_HPP
+#define IMD_JOIN_HPP
+
+#include "binder.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace imd {
+
+class ThreadPool;
+
+// ----- Hash join -----
+// Each side is filtered by its own WHERE terms; the smaller result is built
+// into a hash table and the other side probes it a morsel per task. Builds
+// larger than kJoinCacheBytes are radix-partitioned on the top hash bits
+// first, so every partition's table is built (in parallel) within cache.
+constexpr size_t kJoinCacheBytes = size_t{1} << 20;
+
+using JoinPairs = std::vector<std::pair<size_t, size_t>>; // (side[0] row, side[1] row)
+
+// Calls emit with consecutive slices of matches, in probe-side order (matches
+// of one probe row in build-side order), at most limit pairs in total.
+void hashJoin(const BoundJoin& b, ThreadPool* pool, const std::function<void(const JoinPairs& pairs)>& emit,
+              size_t limit = SIZE_MAX);
+
+} // namespace imd
+
+#endif
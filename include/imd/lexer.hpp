@@ -2,6 +2,7 @@
 #define IMD_LEXER_HPP
 
 #include <string>
+#include <string_view>
 #include <stdexcept>
 
 namespace imd {
@@ -21,23 +22,33 @@ enum class TokType {
     Less,
     LessEq,
     Greater,
-    GreaterEq // <, <=, >, >=   <-- added
+    GreaterEq, // <, <=, >, >=   <-- added
+    Question,  // ? (parameter placeholder)
+    Dot        // . (qualified column names)
 };
 
+// text is a slice of the lexer's source (for strings: between the quotes).
 struct Token {
     TokType type{TokType::End};
-    std::string text;
+    std::string_view text;
     int line{1};
     int col{1};
+    size_t pos{0}; // byte offset of the token in the source
 };
 
+// Lexes src in place; the buffer (a string, or a mapped file) must outlive
+// the lexer and every token it returns.
 class Lexer {
   public:
-    explicit Lexer(std::string src);
+    explicit Lexer(std::string_view src);
     Token next();
+    void skipTo(size_t pos); // resumes after bytes another pass consumed (pos >= the current offset)
+    std::string_view source() const {
+        return s_;
+    }
 
   private:
-    std::string s_;
+    std::string_view s_;
     size_t i_ = 0;
     int line_ = 1, col_ = 1;
 
@@ -54,8 +65,11 @@ class Lexer {
     Token readIdent();  // [A-Za-z_][A-Za-z0-9_]*
 };
 
-bool isUpperKeyword(const std::string& w); // CREATE/TABLE/INSERT/INTO/VALUES/SELECT/FROM/WHERE/DELETE/UPDATE/SET
-bool isTypeWord(const std::string& w);     // int / str (lowercase per spec)
+bool isUpperKeyword(std::string_view w); // CREATE/TABLE/.../SET/USING/INDEX/ON/DROP/PREPARE/...
+bool isTypeWord(std::string_view w);     // int / str (lowercase per spec)
+long long parseInt(std::string_view digits); // [-]?[0-9]+ via from_chars; throws when out of range
+// Offset just past the ';' ending the statement that contains from (or src.size()).
+size_t statementEnd(std::string_view src, size_t from);
 
 } // namespace imd
 
@@ -0,0 +1,36 @@
+﻿#ifndef IMD_MAPPED_FILE_HPP
+#define IMD_MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace imd {
+
+// Read-only view of a whole file, memory-mapped (POSIX mmap / Win32 file
+// mapping) so a large script is paged in as the lexer walks it, not copied.
+class MappedFile {
+  public:
+    explicit MappedFile(const std::string& path); // throws std::runtime_error
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const {
+        return data_;
+    }
+    size_t size() const {
+        return size_;
+    }
+    std::string_view view() const {
+        return std::string_view(data_ ? data_ : "", size_);
+    }
+
+  private:
+    const char* data_ = nullptr; // null for an empty file
+    size_t size_ = 0;
+};
+
+} // namespace imd
+
+#endif
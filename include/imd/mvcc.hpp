@@ -0,0 +1,127 @@
+﻿#ifndef IMD_MVCC_HPP
+#define IMD_MVCC_HPP
+
+#include "ast.hpp"
+#include "renderer.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace imd {
+
+// ----- Multi-version concurrency control -----
+// A standalone concurrent store for embedding in multithreaded services. It
+// is separate from Database / ConcurrentDatabase and the Executor: it has no
+// WAL, snapshots, indexes, JOIN, ORDER BY or aggregates, and Executor's
+// SELECT on a ConcurrentDatabase still takes the table's shared latch.
+//
+// Every row version carries begin/end commit timestamps; a reader takes a
+// snapshot timestamp S and sees exactly the versions with begin <= S < end.
+//
+// Versions live in immutable segments (a Table plus timestamp arrays). A
+// writer never touches published rows: INSERT and UPDATE add new segments,
+// and UPDATE / DELETE only stamp end timestamps (atomics) on old versions.
+// The segment list is swapped atomically, so readers take no lock at all.
+// Writers commit one at a time. A background collector drops versions no
+// snapshot can see and merges small segments.
+
+constexpr uint64_t kLiveTs = ~uint64_t{0}; // end timestamp of a version not yet deleted
+
+struct MvccSegment {
+    Table data;                                   // same schema as the table; never modified once published
+    std::vector<uint64_t> begin;                  // commit that created each version
+    std::unique_ptr<std::atomic<uint64_t>[]> end; // commit that deleted it, or kLiveTs
+
+    bool visible(size_t i, uint64_t ts) const {
+        return begin[i] <= ts && ts < end[i].load(std::memory_order_acquire);
+    }
+};
+using MvccSegments = std::vector<std::shared_ptr<MvccSegment>>;
+
+class MvccTable {
+  public:
+    MvccTable();
+
+    std::shared_ptr<const MvccSegments> segments() const {
+        return std::atomic_load(&segs_);
+    }
+    void publish(std::shared_ptr<const MvccSegments> segs) {
+        std::atomic_store(&segs_, std::move(segs));
+    }
+    size_t versions() const; // stored versions, live and dead
+
+  private:
+    std::shared_ptr<const MvccSegments> segs_;
+};
+
+class MvccDatabase {
+  public:
+    // The collector runs every gcEvery (0: only when collectGarbage() is called).
+    explicit MvccDatabase(std::chrono::milliseconds gcEvery = std::chrono::milliseconds(50));
+    ~MvccDatabase();
+    MvccDatabase(const MvccDatabase&) = delete;
+    MvccDatabase& operator=(const MvccDatabase&) = delete;
+
+    // CREATE TABLE / INSERT / UPDATE / DELETE commit atomically, one writer at
+    // a time. SELECT reads a snapshot, never waits for writers and streams to
+    // sink. Other statements are rejected.
+    void execute(const Statement& st, ResultSink* sink = nullptr);
+    // Parses and executes ';'-terminated statements; SELECT results go to out.
+    void run(std::string_view sql, std::ostream& out, OutputFormat format = OutputFormat::ASCII);
+
+    uint64_t commitTs() const {
+        return visible_.load();
+    }
+    size_t versions(const std::string& table) const; // stored versions, live and dead
+    size_t collectGarbage();                         // returns versions reclaimed
+
+    // A registered read timestamp; versions it can see are kept until it ends.
+    class Snapshot {
+      public:
+        explicit Snapshot(const MvccDatabase& db);
+        ~Snapshot();
+        Snapshot(const Snapshot&) = delete;
+        Snapshot& operator=(const Snapshot&) = delete;
+        uint64_t ts() const {
+            return ts_;
+        }
+
+      private:
+        std::atomic<uint64_t>* slot_ = nullptr;
+        uint64_t ts_ = 0;
+    };
+
+  private:
+    struct Catalog;
+    static constexpr size_t kSlots = 256;
+
+    std::shared_ptr<const Catalog> catalog_;
+    mutable std::atomic<uint64_t> slots_[kSlots] = {}; // read timestamps of live snapshots (0 = free)
+    std::atomic<uint64_t> visible_{0};                 // last committed timestamp
+    std::mutex writer_;                                // one writer (or collector) at a time
+
+    std::chrono::milliseconds gcEvery_;
+    std::mutex gcM_;
+    std::condition_variable gcCv_;
+    bool stop_ = false;
+    std::thread gc_;
+
+    std::shared_ptr<const Catalog> catalog() const;
+    MvccTable& table(const Catalog& c, const std::string& name) const;
+    void select(const SelectStmt& s, ResultSink* sink) const;
+    void write(const Statement& st);
+    uint64_t horizon() const; // oldest timestamp any snapshot may read
+    size_t collect(const Table& schema, MvccTable& mt, uint64_t horizon); // writer lock held
+    void gcLoop();
+};
+
+} // namespace imd
+
+#endif
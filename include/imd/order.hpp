@@ -0,0 +1,24 @@
+﻿#ifndef IMD_ORDER_HPP
+#define IMD_ORDER_HPP
+
+#include "ast.hpp"
+#include "binder.hpp"
+#include <cstddef>
+#include <vector>
+
+namespace imd {
+
+class ThreadPool;
+
+// ----- ORDER BY -----
+// Rows of t matched by e (all rows when null), ordered by column col; ties
+// keep table order. Only the first keep rows are produced. Ascending order on
+// a B+-tree column (with no WHERE or one comparison on it) walks the tree.
+// Otherwise small keeps run bounded top-k heaps per morsel, merged after each
+// scan window, and larger ones gather (key, row) pairs and sort in parallel.
+std::vector<size_t> orderRows(const Table& t, const BoundExpr* e, int col, bool desc, size_t keep,
+                              ThreadPool* pool = nullptr);
+
+} // namespace imd
+
+#endif
@@ -3,21 +3,60 @@
 
 #include "ast.hpp"
 #include "lexer.hpp"
+#include <functional>
+#include <string>
+#include <string_view>
 #include <vector>
 
 namespace imd {
 
+// Tokens are slices of the source; only string literals are copied, once,
+// into the Values of the parsed statement.
 class Parser {
   public:
-    explicit Parser(std::string src);
+    explicit Parser(std::string src);      // parser keeps its own copy
+    explicit Parser(std::string_view src); // caller's buffer (e.g. a mapped file) must outlive the parser
+    explicit Parser(const char* src) : Parser(std::string(src)) {}
+    // Tokens another pass already lexed (their source must outlive the parser); End follows the last.
+    explicit Parser(std::vector<Token> tokens);
+    Parser(const Parser&) = delete; // the lexer points into src_
+    Parser& operator=(const Parser&) = delete;
+
     std::vector<Statement> parseAll();
+    // Parses the next ';'-terminated statement into out; false at end of input.
+    bool next(Statement& out);
+
+    // Streams long INSERTs: every batchRows tuples go to sink as their own
+    // InsertStmt while parsing continues, and the statement from next() keeps
+    // only the remainder. Not applied inside PREPARE. The pieces are marked
+    // (InsertStmt::Part), and the rest of the statement is checked before the
+    // first batch is sent, so a bad tuple anywhere throws while nothing has
+    // reached the sink. The Executor keeps the statement atomic from there.
+    void setInsertSink(std::function<void(InsertStmt&& batch)> sink, size_t batchRows = 4096) {
+        insertSink_ = std::move(sink);
+        insertBatch_ = batchRows ? batchRows : 1;
+    }
+
+    // Parses a single statement (optionally ';'-terminated) that may contain '?'
+    // placeholders, and requires the input to end there.
+    PreparedBody parseTemplate();
 
   private:
+    std::string src_; // owned source, when constructed from a std::string
     Lexer lx_;
     Token cur_;
+    int nParams_ = -1; // '?' placeholders seen so far; -1 when they are not allowed
+    std::function<void(InsertStmt&& batch)> insertSink_;
+    size_t insertBatch_ = 4096;
+
+    std::vector<Token> toks_; // pre-lexed input, when not empty
+    size_t nextTok_ = 0;
 
     void advance() {
-        cur_ = lx_.next();
+        if (toks_.empty())
+            cur_ = lx_.next();
+        else
+            cur_ = nextTok_ < toks_.size() ? toks_[nextTok_++] : Token{};
     }
     bool accept(TokType t);
     void expect(TokType t, const char* msg);
@@ -25,15 +64,30 @@ class Parser {
     void expectWord(const char* w, const char* msg);
 
     std::string parseIdent(const char* what);
-    imd::Value parseLiteral(); // number or string
+    std::string parseColumn(const char* what); // <column> or <table>.<column>
+    imd::Value parseLiteral(int* param = nullptr); // number or string; '?' (sets *param) when allowed
+
+    Statement parseStatement();    // dispatch on the leading keyword
+    PreparedBody parseWithParams(); // one statement with '?' placeholders enabled
 
-    CreateStmt parseCreate();
+    Statement parseCreate(); // CREATE TABLE or CREATE INDEX
+    CreateIndexStmt parseCreateIndex();
+    DropIndexStmt parseDrop();
     InsertStmt parseInsert();
+    void checkRemainingTuples(const InsertStmt& s, const std::vector<imd::Value>& first) const;
     DeleteStmt parseDelete();
     UpdateStmt parseUpdate();
     SelectStmt parseSelect();
+    PrepareStmt parsePrepare();
+    ExecuteStmt parseExecute();
+    DeallocateStmt parseDeallocate();
+    CopyStmt parseCopy();
+    std::string parsePath(const char* stmt); // the quoted file name after SAVE / LOAD / COPY
 
-    Condition parseCondition(); // <ident> ( '=' | '!=' ) <literal>
+    Expr parseExpr(); // OR of ANDs of [NOT] (comparison | '(' expr ')')
+    Expr parseAnd();
+    Expr parseNot();
+    Condition parseCondition(); // <ident> ( '=' | '!=' | '<' | '<=' | '>' | '>=' ) <literal>
 };
 
 } // namespace imd
@@ -0,0 +1,73 @@
+﻿#ifndef IMD_PREPARED_HPP
+#define IMD_PREPARED_HPP
+
+#include "ast.hpp"
+#include "binder.hpp"
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace imd {
+
+// ----- Prepared statements -----
+// A parsed INSERT/DELETE/UPDATE/SELECT plus pointers to the literals its '?'
+// placeholders stand for. Running it only overwrites those literals.
+// The executor also keeps the statement's bound plan here, so a run re-derives
+// only what depends on the literals (Binder::rebind) instead of binding again.
+using BoundPlan = std::variant<std::monostate, BoundInsert, BoundDelete, BoundUpdate, BoundSelect>;
+
+class PreparedStmt {
+  public:
+    explicit PreparedStmt(PreparedBody body);
+    PreparedStmt(const PreparedStmt&) = delete; // slots_ and the bound plan point into stmt_
+    PreparedStmt& operator=(const PreparedStmt&) = delete;
+
+    size_t paramCount() const {
+        return slots_.size();
+    }
+    // Moves args into the placeholder literals and returns the statement to run.
+    const Statement& bind(std::vector<Value>&& args);
+
+    BoundPlan plan;     // monostate until first run (and for JOINs)
+    uint64_t epoch = 0; // Database::epoch plan was bound in
+
+  private:
+    Statement stmt_;
+    std::vector<Value*> slots_; // by placeholder index
+};
+
+// ----- Plan cache -----
+// Ad-hoc statements keyed on their token text with literals replaced by '?',
+// so "... WHERE id = 1" and "... WHERE id = 2" share one parsed plan.
+// Least recently used entries are evicted past capacity.
+class PlanCache {
+  public:
+    explicit PlanCache(size_t capacity = 256) : cap_(capacity ? capacity : 1) {}
+
+    PreparedStmt* find(const std::string& key); // nullptr on a miss
+    PreparedStmt& insert(const std::string& key, std::unique_ptr<PreparedStmt> plan);
+    void clear();
+
+    size_t size() const {
+        return map_.size();
+    }
+    size_t hits() const {
+        return hits_;
+    }
+    size_t misses() const {
+        return misses_;
+    }
+
+  private:
+    using Entry = std::pair<std::string, std::unique_ptr<PreparedStmt>>;
+    size_t cap_;
+    std::list<Entry> lru_; // most recent first
+    std::unordered_map<std::string, std::list<Entry>::iterator> map_;
+    size_t hits_ = 0, misses_ = 0;
+};
+
+} // namespace imd
+
+#endif
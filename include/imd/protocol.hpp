@@ -0,0 +1,72 @@
+﻿#ifndef IMD_PROTOCOL_HPP
+#define IMD_PROTOCOL_HPP
+
+#include "renderer.hpp"
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace imd {
+
+// ----- Wire protocol -----
+// Every message is a frame: a little-endian u32 payload length, then the
+// payload. Counts and lengths inside payloads are unsigned LEB128 varints.
+//
+// Request:   'Q' sql                  one or more ';'-terminated statements
+// Response:  one per request, in request order, holding a result set per SELECT
+//            'T' ncols {type name}    column types (0 INT, 1 STR) and names
+//            'D' {cell} ...           a row: INT as zigzag varint, STR as length + bytes
+//            'N' bitmap {cell} ...    a row with NULLs: (ncols + 7) / 8 bytes, bit j set
+//                                     for a NULL cell j, then only the other cells
+//            'E' nrows                end of the result set
+//            then 'K' when every statement ran, or '!' message when one failed
+//            (the statements before it ran; their results are included).
+// A response spans several frames so that it never has to fit in one: its
+// result sets are cut into 'R' frames (split anywhere, each sent as soon as
+// it fills), and a last frame holds the 'K' or '!' trailer alone.
+constexpr uint32_t kMaxFrame = 64u << 20;
+
+void putVarint(std::string& out, uint64_t v);
+bool getVarint(std::string_view& in, uint64_t& v); // consumes; false when truncated
+
+void appendFrame(std::string& out, std::string_view payload); // throws when payload exceeds kMaxFrame
+void appendRequest(std::string& out, std::string_view sql);    // a whole 'Q' frame; throws like appendFrame
+// When buf[off..] starts with a whole frame, points payload at it and moves
+// off past it. Throws when the announced length exceeds kMaxFrame.
+bool nextFrame(std::string_view buf, size_t& off, std::string_view& payload);
+// When buf[off..] holds every frame of a response, sets payload to its
+// result sets and trailer joined (what decodeResponse takes) and moves off
+// past them; otherwise leaves off alone.
+bool nextResponse(std::string_view buf, size_t& off, std::string& payload);
+
+// Writes SELECT results in the response encoding above (OutputFormat::BINARY).
+std::unique_ptr<ResultSink> makeBinarySink(std::ostream& out);
+
+struct ResultSet {
+    std::vector<std::string> headers;
+    std::vector<ColType> types;
+    std::vector<std::vector<std::string>> rows; // INT cells in decimal, NULL cells "NULL"
+    std::vector<std::vector<uint8_t>> nulls;    // per row: NULL flags, empty when the row has none
+};
+struct Response {
+    std::vector<ResultSet> results;
+    bool failed = false;
+    std::string error;
+};
+Response decodeResponse(std::string_view payload); // throws on a malformed payload
+
+// "unix:/path/to/socket" or "host:port" (IPv4, numeric host).
+struct Endpoint {
+    bool isUnix = false;
+    std::string path; // unix
+    std::string host; // tcp
+    uint16_t port = 0;
+};
+Endpoint parseEndpoint(std::string_view spec); // throws on malformed specs
+
+} // namespace imd
+
+#endif
@@ -1,14 +1,50 @@
 ﻿#ifndef IMD_RENDERER_HPP
 #define IMD_RENDERER_HPP
 
+#include "value.hpp"
+#include <cstdint>
+#include <memory>
+#include <ostream>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <ostream>
 
 namespace imd {
 
 void printAscii(const std::vector<std::string>& headers, const std::vector<std::vector<std::string>>& rows,
                 std::ostream& out);
+void printCsv(const std::vector<std::string>& headers, const std::vector<std::vector<std::string>>& rows,
+              std::ostream& out);
+std::string csvEscape(std::string_view s); // quotes s when it holds , " CR or LF
+
+// ----- Result sinks -----
+// SELECT hands rows to a sink as they are produced. CSV, TSV and JSON lines
+// write each row immediately; ASCII needs column widths, so it buffers a
+// sample and, past that, keeps streaming with the sampled widths. BINARY is
+// the server's wire encoding (protocol.hpp).
+//
+// Cells are typed: an INT column's cells hold ints, which BINARY encodes as
+// is and the text formats print in decimal. They may borrow their strings
+// from a table, so a sink copies what it keeps past row(). A row may flag SQL
+// NULL cells (nulls[j] != 0). Their cell holds the text "NULL", which the text
+// formats print as is; JSON lines writes null and BINARY marks them.
+enum class OutputFormat { ASCII, CSV, TSV, JSONL, BINARY };
+
+bool parseFormat(std::string_view name, OutputFormat& out); // ascii / csv / tsv / jsonl (text formats only)
+const char* formatName(OutputFormat f);
+
+class ResultSink {
+  public:
+    virtual ~ResultSink() = default;
+    virtual void begin(const std::vector<std::string>& headers, const std::vector<ColType>& types) = 0;
+    virtual void row(const std::vector<Value>& cells, const std::vector<uint8_t>* nulls) = 0;
+    void row(const std::vector<Value>& cells) {
+        row(cells, nullptr);
+    }
+    virtual void end() = 0;
+};
+
+std::unique_ptr<ResultSink> makeSink(OutputFormat f, std::ostream& out);
 
 } // namespace imd
 
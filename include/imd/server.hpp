@@ -0,0 +1,89 @@
+﻿#ifndef IMD_SERVER_HPP
+#define IMD_SERVER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace imd {
+
+class ConcurrentDatabase;
+class Executor;
+
+// ----- Server -----
+// Serves a ConcurrentDatabase over TCP or a Unix socket (protocol.hpp).
+// One thread runs an epoll loop that accepts, reads requests and writes
+// responses but never executes SQL; statements run on a pool of workers.
+// Each connection is a session with its own Executor (prepared statements,
+// plan cache), used by one worker at a time. Clients may pipeline: requests
+// that arrive while their session is busy queue up and run as one batch, and
+// responses always come back in request order. Results reach the event loop
+// frame by frame while a statement runs; a worker waits while its client has
+// too much output unsent, and the loop stops reading from a client with too
+// many requests queued, so a slow or flooding client is held back, not buffered.
+struct ServerOptions {
+    std::string listen;                       // unix:/path or host:port (port 0 picks a free one)
+    unsigned workers = 0;                     // 0: one per hardware thread
+    std::function<void(Executor&)> onSession; // configures each new session (e.g. its WAL)
+};
+
+class Server {
+  public:
+    Server(ConcurrentDatabase& db, ServerOptions opts); // binds and listens; throws on failure
+    ~Server();
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    void run();  // serves until stop(); open connections are closed on return
+    void stop(); // callable from any thread or a signal handler
+    uint16_t port() const {
+        return port_;
+    }
+
+  private:
+    struct Conn;
+    struct Job {
+        std::shared_ptr<Conn> conn;
+        std::vector<std::string> requests; // SQL, in arrival order
+    };
+
+    ConcurrentDatabase& db_;
+    ServerOptions opts_;
+    int listenFd_ = -1, epollFd_ = -1, wakeFd_ = -1;
+    uint16_t port_ = 0;
+    std::atomic<bool> stop_{false};
+    std::unordered_map<int, std::shared_ptr<Conn>> conns_; // event loop only
+
+    std::vector<std::thread> workers_;
+    std::mutex jobsM_;
+    std::condition_variable jobsCv_;
+    std::deque<Job> jobs_;
+    bool quit_ = false;
+    std::mutex doneM_;
+    std::vector<Job> done_;                    // finished jobs, handed back to the loop
+    std::vector<std::shared_ptr<Conn>> ready_; // connections with response frames to pick up
+
+    void workerLoop();
+    void acceptAll();
+    void readFrom(const std::shared_ptr<Conn>& c);
+    void flush(const std::shared_ptr<Conn>& c);
+    void dispatch(const std::shared_ptr<Conn>& c);
+    void finishJobs();
+    void post(const std::shared_ptr<Conn>& c, std::string&& frame); // worker: hands a frame to the loop
+    void take(Conn& c);                                              // loop: moves posted frames to c.out
+    void wake();
+    void watch(Conn& c); // re-arms epoll interest for c
+    void close(Conn& c);
+};
+
+} // namespace imd
+
+#endif
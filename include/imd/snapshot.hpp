@@ -0,0 +1,63 @@
+﻿#ifndef IMD_SNAPSHOT_HPP
+#define IMD_SNAPSHOT_HPP
+
+#include "ast.hpp"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace imd {
+
+// ----- Snapshots -----
+// Versioned binary image of a whole Database:
+//   header   magic, version, byte-order tag, catalog offset/length/CRC-32C
+//   sections one per column, 64-byte aligned: INT as int64[rows]; STR as
+//            uint64 offsets[rows + 1] followed by the string heap
+//   catalog  tables (name, layout, rows), columns (name, type with the high
+//            bit set for DICT, section offset/length/CRC-32C) and index
+//            definitions
+// Index contents are not stored; they are rebuilt when a table is filled.
+// DICT columns are written as plain STR sections and re-encoded on fill.
+
+// Writes db to path (via a temporary file renamed into place, then synced).
+// progress, when given, is called as column cells are written. Returns the
+// number of tables written.
+using SnapshotProgress = std::function<void(uint64_t cellsDone, uint64_t cellsTotal)>;
+size_t saveSnapshot(Database& db, const std::string& path, const SnapshotProgress& progress = nullptr);
+
+// saveSnapshot in two steps, for BGSAVE's forked child. The constructor does
+// everything that allocates: it fills pending tables, lays out the catalog and
+// reserves the staging buffer. write() then only copies into that buffer and
+// calls open/write/fsync/close/rename, all async-signal-safe, so it may run in
+// a child forked from a multithreaded process (provided progress is safe too).
+// It returns nullptr on success, or a message owned by the writer with errno
+// describing the cause. db must not change between the two.
+class SnapshotWriter {
+  public:
+    SnapshotWriter(Database& db, const std::string& path);
+    const char* write(const SnapshotProgress& progress = nullptr);
+    size_t tables() const {
+        return tables_.size();
+    }
+
+  private:
+    std::vector<const Table*> tables_;
+    std::string path_, tmp_, dir_;
+    std::string cat_;                 // catalog, section fields patched in by write()
+    std::vector<size_t> patch_;       // per column, in order: offset of its off/len/crc fields in cat_
+    std::unique_ptr<char[]> staging_; // sections are copied through this
+    uint64_t totalCells_ = 0;
+    std::string cannotWrite_, cannotRename_, cannotSyncDir_;
+};
+
+// Replaces db's tables with the snapshot's. Only the header and catalog are
+// read here: the file stays mapped and each table is filled from it on first
+// use (Database::find), so its pages are faulted in lazily and sections are
+// checksummed then. Returns the number of tables.
+size_t loadSnapshot(Database& db, const std::string& path);
+
+} // namespace imd
+
+#endif
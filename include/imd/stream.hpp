@@ -0,0 +1,78 @@
+﻿#ifndef IMD_STREAM_HPP
+#define IMD_STREAM_HPP
+
+#include "ast.hpp"
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <istream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace imd {
+
+class Parser;
+
+// ----- Streaming scripts -----
+// Cuts a SQL stream into ';'-terminated statement texts, reading chunk bytes
+// at a time. Memory is one chunk plus the longest statement.
+class StatementReader {
+  public:
+    explicit StatementReader(std::istream& in, size_t chunk = size_t{1} << 20) : in_(in), chunk_(chunk) {}
+
+    // Next statement text, ';' included. Trailing text without ';' comes back
+    // as a last statement so the parser can report it. False at end of input.
+    bool next(std::string& stmt);
+
+  private:
+    std::istream& in_;
+    size_t chunk_;
+    std::string buf_;
+    size_t head_ = 0;  // start of the current statement in buf_
+    size_t scan_ = 0;  // bytes of buf_ already scanned for ';'
+    bool inStr_ = false;
+};
+
+// Runs a statement source (e.g. reader + Parser) on a second thread, at most
+// depth statements ahead of the consumer, so parsing overlaps execution.
+class StatementPipeline {
+  public:
+    using Emit = std::function<void(Statement&& st)>;
+    // Parses the next statement and emits it, preceded by any INSERT batches
+    // streamed out of it (Parser::setInsertSink); false at end of input.
+    using Source = std::function<bool(const Emit& emit)>;
+
+    explicit StatementPipeline(Source source, size_t depth = 2);
+    ~StatementPipeline(); // stops and joins the producer
+    StatementPipeline(const StatementPipeline&) = delete;
+    StatementPipeline& operator=(const StatementPipeline&) = delete;
+
+    // Next statement in script order; false at the end. A parse error is
+    // rethrown here once the statements before it have been consumed.
+    bool next(Statement& out);
+
+  private:
+    struct Stopped {}; // unwinds the producer when the pipeline is destroyed early
+    Source source_;
+    size_t depth_;
+    std::mutex m_;
+    std::condition_variable cv_;
+    std::deque<Statement> queue_;
+    std::exception_ptr error_;
+    bool done_ = false, stop_ = false;
+    std::thread producer_;
+
+    void produce();
+    void push(Statement&& st); // blocks while the queue is full
+};
+
+// Source that reads statements from in with a StatementReader and parses them one by one.
+StatementPipeline::Source readStatements(std::istream& in, size_t chunk = size_t{1} << 20);
+// Source over a parser holding the whole script (e.g. a mapped file); p must outlive the pipeline.
+StatementPipeline::Source parseStatements(Parser& p);
+
+} // namespace imd
+
+#endif
@@ -0,0 +1,125 @@
+﻿#ifndef IMD_THREAD_POOL_HPP
+#define IMD_THREAD_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace imd {
+
+// ----- Work-stealing thread pool -----
+// Each worker owns a deque: it pops its own tasks from the front and steals
+// from the back of the others when idle. The thread that calls parallelFor
+// steals too, so nested calls from inside a task cannot deadlock.
+class ThreadPool {
+  public:
+    explicit ThreadPool(unsigned threads); // total parallelism, including the calling thread
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const {
+        return static_cast<unsigned>(workers_.size()) + 1;
+    }
+
+    // Runs fn(task) for task in [0, n) and returns when all have finished.
+    // The first exception thrown by a task is rethrown.
+    void parallelFor(size_t n, const std::function<void(size_t task)>& fn);
+
+    // Process-wide pool used by Executor; sized to the hardware by default.
+    static ThreadPool& shared();
+    static void setSharedThreads(unsigned threads); // call before executors run
+
+  private:
+    struct Job;
+    struct Task {
+        Job* job;
+        size_t index;
+    };
+    struct Queue {
+        std::mutex m;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues_; // one per worker
+    std::vector<std::thread> workers_;
+    std::mutex sleepM_;
+    std::condition_variable sleepCv_;
+    std::atomic<size_t> queued_{0};
+    bool stop_ = false;
+
+    void workerLoop(size_t self);
+    bool runOne(size_t self); // pops (or steals) and runs one task; false if none was found
+};
+
+// Rows per parallel work unit.
+constexpr size_t kMorsel = 65536;
+
+// Splits [0, n) into morsels; runs sequentially when the pool is null or n is small.
+inline void forMorsels(ThreadPool* pool, size_t n, const std::function<void(size_t from, size_t to)>& fn) {
+    const size_t parts = (n + kMorsel - 1) / kMorsel;
+    if (!pool || parts <= 1 || pool->size() == 1) {
+        for (size_t p = 0; p < parts; ++p)
+            fn(p * kMorsel, std::min(n, (p + 1) * kMorsel));
+        return;
+    }
+    pool->parallelFor(parts, [&](size_t p) { fn(p * kMorsel, std::min(n, (p + 1) * kMorsel)); });
+}
+
+// Stable compaction of v to the elements with keep[i] != 0: survivors per
+// morsel are counted, prefix-summed into offsets, then moved in parallel.
+template <class T> void parallelCompact(ThreadPool* pool, std::vector<T>& v, const std::vector<uint8_t>& keep) {
+    const size_t n = v.size();
+    const size_t parts = (n + kMorsel - 1) / kMorsel;
+    std::vector<size_t> offs(parts + 1, 0);
+    forMorsels(pool, n, [&](size_t from, size_t to) {
+        size_t c = 0;
+        for (size_t i = from; i < to; ++i)
+            c += keep[i] ? 1 : 0;
+        offs[from / kMorsel + 1] = c;
+    });
+    for (size_t p = 0; p < parts; ++p)
+        offs[p + 1] += offs[p];
+    std::vector<T> out(offs[parts]);
+    forMorsels(pool, n, [&](size_t from, size_t to) {
+        size_t w = offs[from / kMorsel];
+        for (size_t i = from; i < to; ++i)
+            if (keep[i])
+                out[w++] = std::move(v[i]);
+    });
+    v.swap(out);
+}
+
+// Sorts v by less, like std::sort (equal elements may be reordered): morsels
+// are sorted in parallel, then runs are merged pairwise, each round's merges
+// running in parallel.
+template <class T, class Less> void parallelSort(ThreadPool* pool, std::vector<T>& v, Less less) {
+    const size_t n = v.size();
+    if (!pool || pool->size() == 1 || n <= kMorsel) {
+        std::sort(v.begin(), v.end(), less);
+        return;
+    }
+    forMorsels(pool, n, [&](size_t from, size_t to) { std::sort(v.begin() + from, v.begin() + to, less); });
+    std::vector<T> buf(n);
+    for (size_t run = kMorsel; run < n; run *= 2) {
+        pool->parallelFor((n + 2 * run - 1) / (2 * run), [&](size_t p) {
+            const size_t lo = p * 2 * run, mid = std::min(n, lo + run), hi = std::min(n, lo + 2 * run);
+            std::merge(std::make_move_iterator(v.begin() + lo), std::make_move_iterator(v.begin() + mid),
+                       std::make_move_iterator(v.begin() + mid), std::make_move_iterator(v.begin() + hi),
+                       buf.begin() + lo, less);
+        });
+        v.swap(buf);
+    }
+}
+
+} // namespace imd
+
+#endif
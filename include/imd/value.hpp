@@ -0,0 +1,204 @@
+﻿#ifndef IMD_VALUE_HPP
+#define IMD_VALUE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace imd {
+
+// ----- Types and values -----
+enum class ColType { INT, STR };
+
+// Column type as one byte in WAL CREATE records and snapshot catalogs: the
+// ColType, with kDictTypeBit set for a DICT column.
+constexpr uint8_t kDictTypeBit = 0x80;
+
+inline uint8_t encodeColType(ColType type, bool dict) {
+    return static_cast<uint8_t>(static_cast<uint8_t>(type) | (dict ? kDictTypeBit : 0));
+}
+// Throws unless b is INT, STR or STR with the DICT bit.
+inline void decodeColType(uint8_t b, ColType& type, bool& dict) {
+    dict = (b & kDictTypeBit) != 0;
+    const uint8_t t = b & static_cast<uint8_t>(~kDictTypeBit);
+    if (t > static_cast<uint8_t>(ColType::STR) || (dict && t != static_cast<uint8_t>(ColType::STR)))
+        throw std::runtime_error("Bad column type byte " + std::to_string(b));
+    type = static_cast<ColType>(t);
+}
+
+// A 16-byte tagged cell. The first 4 bytes hold the kind and, for strings, the
+// length. An int sits in bytes [8, 16). Strings of up to kInline bytes are
+// stored inline after the header, zero padded; longer ones keep their first 4
+// bytes there as a prefix and point at the full text in [8, 16). That text is
+// an owned heap copy, or borrowed (borrowStr) from storage such as a table's
+// StringArena, which must outlive the value and its copies.
+struct Value {
+    static constexpr size_t kInline = 12;
+
+    Value() = default; // INT 0
+    Value(const Value& o) {
+        copyFrom(o);
+    }
+    Value(Value&& o) noexcept {
+        std::memcpy(b_, o.b_, sizeof(b_));
+        std::memset(o.b_, 0, sizeof(b_));
+    }
+    Value& operator=(const Value& o) {
+        if (this != &o) {
+            release();
+            copyFrom(o);
+        }
+        return *this;
+    }
+    Value& operator=(Value&& o) noexcept {
+        if (this != &o) {
+            release();
+            std::memcpy(b_, o.b_, sizeof(b_));
+            std::memset(o.b_, 0, sizeof(b_));
+        }
+        return *this;
+    }
+    ~Value() {
+        release();
+    }
+
+    static Value makeInt(long long x) {
+        Value v;
+        std::memcpy(v.b_ + 8, &x, sizeof(x));
+        return v;
+    }
+    static Value makeStr(std::string_view s) { // copies s
+        Value v = borrowStr(s);
+        if (s.size() > kInline) {
+            char* p = new char[s.size()];
+            std::memcpy(p, s.data(), s.size());
+            v.setHead(kStr | static_cast<uint32_t>(s.size()));
+            std::memcpy(v.b_ + 8, &p, sizeof(p));
+        }
+        return v;
+    }
+    static Value borrowStr(std::string_view s) { // short strings are still copied inline
+        if (s.size() > kMaxLen)
+            throw std::runtime_error("String value too long");
+        Value v;
+        v.setHead(kStr | (s.size() > kInline ? kBorrowed : 0) | static_cast<uint32_t>(s.size()));
+        if (s.size() <= kInline) {
+            std::memcpy(v.b_ + 4, s.data(), s.size());
+        } else {
+            std::memcpy(v.b_ + 4, s.data(), 4);
+            const char* p = s.data();
+            std::memcpy(v.b_ + 8, &p, sizeof(p));
+        }
+        return v;
+    }
+
+    bool isInt() const {
+        return !(head() & kStr);
+    }
+    bool isStr() const {
+        return (head() & kStr) != 0;
+    }
+    bool borrowed() const { // a long string pointing at storage it does not own
+        return (head() & kBorrowed) != 0;
+    }
+    size_t strSize() const {
+        return head() & kMaxLen;
+    }
+
+    long long asInt() const {
+        long long x;
+        std::memcpy(&x, b_ + 8, sizeof(x));
+        return x;
+    }
+    std::string_view asStr() const { // points into this value when inline
+        const size_t n = strSize();
+        if (n <= kInline)
+            return std::string_view(b_ + 4, n);
+        const char* p;
+        std::memcpy(&p, b_ + 8, sizeof(p));
+        return std::string_view(p, n);
+    }
+
+    std::string toString() const {
+        if (isInt())
+            return std::to_string(asInt());
+        return std::string(asStr());
+    }
+
+  private:
+    static constexpr uint32_t kStr = 1u << 31;
+    static constexpr uint32_t kBorrowed = 1u << 30;
+    static constexpr uint32_t kMaxLen = kBorrowed - 1;
+
+    alignas(8) char b_[16] = {};
+
+    uint32_t head() const {
+        uint32_t h;
+        std::memcpy(&h, b_, sizeof(h));
+        return h;
+    }
+    void setHead(uint32_t h) {
+        std::memcpy(b_, &h, sizeof(h));
+    }
+    bool ownsHeap() const {
+        return isStr() && !borrowed() && strSize() > kInline;
+    }
+    void copyFrom(const Value& o) { // this holds nothing to release
+        if (o.ownsHeap()) {
+            Value v = makeStr(o.asStr());
+            std::memcpy(b_, v.b_, sizeof(b_));
+            std::memset(v.b_, 0, sizeof(b_));
+            return;
+        }
+        std::memcpy(b_, o.b_, sizeof(b_));
+    }
+    void release() {
+        if (ownsHeap()) {
+            const char* p;
+            std::memcpy(&p, b_ + 8, sizeof(p));
+            delete[] p;
+        }
+    }
+
+    friend bool equalValues(const Value& a, const Value& b);
+    friend int compareValues(const Value& a, const Value& b);
+};
+
+static_assert(sizeof(Value) == 16, "Value must stay 16 bytes");
+
+// True when a and b have the same type and contents. Lengths and the 4-byte
+// prefix settle most string pairs; short strings never leave the value.
+inline bool equalValues(const Value& a, const Value& b) {
+    if ((a.head() ^ b.head()) & ~Value::kBorrowed)
+        return false; // type or length differ
+    if (a.isInt())
+        return a.asInt() == b.asInt();
+    if (a.strSize() <= Value::kInline)
+        return std::memcmp(a.b_ + 4, b.b_ + 4, 12) == 0; // zero padded
+    if (std::memcmp(a.b_ + 4, b.b_ + 4, 4) != 0)
+        return false;
+    return std::memcmp(a.asStr().data() + 4, b.asStr().data() + 4, a.strSize() - 4) == 0;
+}
+
+// Negative, zero or positive as a orders before, equal to or after b. Ints
+// compare numerically and before every string; strings compare bytewise, and
+// the zero-padded prefixes decide whenever they differ.
+inline int compareValues(const Value& a, const Value& b) {
+    if (a.isInt() || b.isInt()) {
+        if (a.isInt() && b.isInt())
+            return a.asInt() < b.asInt() ? -1 : (a.asInt() > b.asInt() ? 1 : 0);
+        return a.isInt() ? -1 : 1;
+    }
+    if (const int c = std::memcmp(a.b_ + 4, b.b_ + 4, 4))
+        return c;
+    const std::string_view x = a.asStr(), y = b.asStr();
+    const size_t skip = std::min<size_t>({4, x.size(), y.size()});
+    return x.substr(skip).compare(y.substr(skip));
+}
+
+} // namespace imd
+
+#endif
@@ -0,0 +1,95 @@
+﻿#ifndef IMD_WAL_HPP
+#define IMD_WAL_HPP
+
+#include "ast.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace imd {
+
+// CRC-32C (Castagnoli); SSE4.2 crc32 instructions when simdLevel() allows.
+uint32_t crc32c(const void* data, size_t n, uint32_t crc = 0);
+
+// rename swaps the target atomically; syncing the directory then makes the new
+// entry durable. Both only make async-signal-safe calls (a forked BGSAVE child
+// uses them) and return false with errno set on failure.
+bool renameFile(const char* from, const char* to);
+bool syncDir(const char* dir);
+std::string parentDir(const std::string& path); // "." for a bare file name
+
+// ----- Record encoding -----
+// Mutating statements in a compact binary form (little-endian, length-prefixed strings).
+void encodeStatement(const CreateStmt& s, std::string& out);
+void encodeStatement(const InsertStmt& s, std::string& out);
+void encodeStatement(const DeleteStmt& s, std::string& out);
+void encodeStatement(const UpdateStmt& s, std::string& out);
+void encodeStatement(const CreateIndexStmt& s, std::string& out);
+void encodeStatement(const DropIndexStmt& s, std::string& out);
+void encodeStatement(const LoadStmt& s, std::string& out);
+// Rows [from, to) of t as an INSERT of every column. Bulk loads log one such
+// record per kAppendRows rows, so no record outgrows its u32 length and count;
+// a load of several records tags them as the parts of one streamed INSERT.
+constexpr size_t kAppendRows = 65536;
+void encodeAppend(const Table& t, size_t from, size_t to, InsertStmt::Part part, std::string& out);
+Statement decodeStatement(std::string_view rec); // throws on a malformed record
+
+// ----- Write-ahead log -----
+// File: an 8-byte magic, then records of [u32 length][u32 crc32c][payload].
+// append() only buffers; a flusher thread writes everything buffered with one
+// write + fsync per group-commit window, so concurrent or back-to-back commits
+// share a sync. waitDurable() blocks until a record is on disk.
+class Wal {
+  public:
+    // Opens or creates path. A torn or corrupt tail (from a crash mid-write) is
+    // truncated away; everything before it is kept for replay().
+    explicit Wal(const std::string& path, std::chrono::microseconds window = std::chrono::microseconds(1000));
+    ~Wal(); // flushes what is buffered
+    Wal(const Wal&) = delete;
+    Wal& operator=(const Wal&) = delete;
+
+    // Calls apply on each record in log order; returns how many there were.
+    size_t replay(const std::function<void(std::string_view rec)>& apply) const;
+
+    uint64_t append(std::string_view rec); // log sequence number of rec (1, 2, ...)
+    void waitDurable(uint64_t lsn);        // throws if the log could not be written
+    void sync() {
+        waitDurable(appended());
+    }
+    // Checkpoint: once everything so far is durable, replaces the log with one
+    // holding only rec (e.g. a LOAD of the snapshot just saved). The new log is
+    // written and synced as path.tmp, then renamed over the old one, so a crash
+    // at any point leaves one of the two complete logs.
+    void restart(std::string_view rec);
+
+    uint64_t appended() const;
+    uint64_t durable() const;
+    uint64_t syncs() const; // fsync calls so far
+    const std::string& path() const {
+        return path_;
+    }
+
+  private:
+    std::string path_;
+    std::chrono::microseconds window_;
+    int fd_ = -1;
+    size_t recovered_ = 0; // bytes of valid records at open
+    mutable std::mutex m_;
+    std::condition_variable work_, done_;
+    std::string buf_; // framed records not yet written
+    uint64_t appended_ = 0, durable_ = 0, syncs_ = 0;
+    std::string error_;
+    bool stop_ = false;
+    std::thread flusher_;
+
+    void flushLoop();
+};
+
+} // namespace imd
+
+#endif
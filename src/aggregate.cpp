@@ -0,0 +1,640 @@
+﻿#include "imd/aggregate.hpp"
+#include "imd/filter.hpp"
+#include "imd/index.hpp"
+#include "imd/thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IMD_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace imd {
+
+// ----- Kernels -----
+// One chunk folds into a wrapping 64-bit sum plus min and max; summarize() turns
+// that into an exact sum. Chunks are at most kChunk values long.
+namespace {
+
+constexpr size_t kChunk = 65536;
+
+struct Chunk {
+    unsigned long long wrapped = 0;
+    long long lo = LLONG_MAX;
+    long long hi = LLONG_MIN;
+};
+
+template <bool kGather> void chunkScalar(const long long* v, const size_t* rows, size_t n, Chunk& c) {
+    unsigned long long sum = 0;
+    long long lo = c.lo, hi = c.hi;
+    for (size_t i = 0; i < n; ++i) {
+        const long long x = kGather ? v[rows[i]] : v[i];
+        sum += static_cast<unsigned long long>(x);
+        lo = x < lo ? x : lo;
+        hi = x > hi ? x : hi;
+    }
+    c.wrapped += sum;
+    c.lo = lo;
+    c.hi = hi;
+}
+
+#ifdef IMD_X86_SIMD
+template <bool kGather>
+__attribute__((target("avx2"))) void chunkAvx2(const long long* v, const size_t* rows, size_t n, Chunk& c) {
+    __m256i sum = _mm256_setzero_si256();
+    __m256i lo = _mm256_set1_epi64x(LLONG_MAX);
+    __m256i hi = _mm256_set1_epi64x(LLONG_MIN);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i x;
+        if constexpr (kGather)
+            x = _mm256_i64gather_epi64(v, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows + i)), 8);
+        else
+            x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + i));
+        sum = _mm256_add_epi64(sum, x);
+        lo = _mm256_blendv_epi8(lo, x, _mm256_cmpgt_epi64(lo, x));
+        hi = _mm256_blendv_epi8(hi, x, _mm256_cmpgt_epi64(x, hi));
+    }
+    alignas(32) long long s[4], l[4], h[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(s), sum);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(l), lo);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(h), hi);
+    for (int k = 0; k < 4; ++k) {
+        c.wrapped += static_cast<unsigned long long>(s[k]);
+        c.lo = std::min(c.lo, l[k]);
+        c.hi = std::max(c.hi, h[k]);
+    }
+    if constexpr (kGather)
+        chunkScalar<true>(v, rows + i, n - i, c);
+    else
+        chunkScalar<false>(v + i, nullptr, n - i, c);
+}
+
+template <bool kGather>
+__attribute__((target("sse4.2"))) void chunkSse42(const long long* v, const size_t* rows, size_t n, Chunk& c) {
+    __m128i sum = _mm_setzero_si128();
+    __m128i lo = _mm_set1_epi64x(LLONG_MAX);
+    __m128i hi = _mm_set1_epi64x(LLONG_MIN);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i x;
+        if constexpr (kGather)
+            x = _mm_set_epi64x(v[rows[i + 1]], v[rows[i]]);
+        else
+            x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + i));
+        sum = _mm_add_epi64(sum, x);
+        lo = _mm_blendv_epi8(lo, x, _mm_cmpgt_epi64(lo, x));
+        hi = _mm_blendv_epi8(hi, x, _mm_cmpgt_epi64(x, hi));
+    }
+    alignas(16) long long s[2], l[2], h[2];
+    _mm_store_si128(reinterpret_cast<__m128i*>(s), sum);
+    _mm_store_si128(reinterpret_cast<__m128i*>(l), lo);
+    _mm_store_si128(reinterpret_cast<__m128i*>(h), hi);
+    for (int k = 0; k < 2; ++k) {
+        c.wrapped += static_cast<unsigned long long>(s[k]);
+        c.lo = std::min(c.lo, l[k]);
+        c.hi = std::max(c.hi, h[k]);
+    }
+    if constexpr (kGather)
+        chunkScalar<true>(v, rows + i, n - i, c);
+    else
+        chunkScalar<false>(v + i, nullptr, n - i, c);
+}
+#endif
+
+template <bool kGather> void chunk(SimdLevel lv, const long long* v, const size_t* rows, size_t n, Chunk& c) {
+#ifdef IMD_X86_SIMD
+    switch (lv) {
+    case SimdLevel::AVX2:
+        chunkAvx2<kGather>(v, rows, n, c);
+        return;
+    case SimdLevel::SSE42:
+        chunkSse42<kGather>(v, rows, n, c);
+        return;
+    case SimdLevel::SCALAR:
+        break;
+    }
+#else
+    (void)lv;
+#endif
+    chunkScalar<kGather>(v, rows, n, c);
+}
+
+// v[i] for i in [0, n), or v[rows[i]] when rows is given.
+void summarize(const long long* v, const size_t* rows, size_t n, IntSummary& s) {
+    const SimdLevel lv = simdLevel();
+    for (size_t from = 0; from < n; from += kChunk) {
+        const size_t m = std::min(kChunk, n - from);
+        const long long* base = rows ? v : v + from;
+        const size_t* idx = rows ? rows + from : nullptr;
+        Chunk c;
+        if (idx)
+            chunk<true>(lv, base, idx, m, c);
+        else
+            chunk<false>(lv, base, nullptr, m, c);
+        // sum - m * lo = sum of (x - lo), which lies in [0, m * (hi - lo)]: when
+        // that fits in 64 bits the wrapped sum determines it exactly
+        const unsigned long long span = static_cast<unsigned long long>(c.hi) - static_cast<unsigned long long>(c.lo);
+        if (span <= ULLONG_MAX / m) {
+            const unsigned long long offset =
+                static_cast<unsigned long long>(m) * static_cast<unsigned long long>(c.lo);
+            s.sum += static_cast<__int128>(m) * c.lo + static_cast<__int128>(c.wrapped - offset);
+        } else {
+            __int128 exact = 0;
+            for (size_t i = 0; i < m; ++i)
+                exact += idx ? base[idx[i]] : base[i];
+            s.sum += exact;
+        }
+        s.count += m;
+        s.min = std::min(s.min, c.lo);
+        s.max = std::max(s.max, c.hi);
+    }
+}
+
+} // namespace
+
+void summarizeInts(const long long* v, size_t n, IntSummary& s) {
+    summarize(v, nullptr, n, s);
+}
+
+void summarizeInts(const long long* v, const size_t* rows, size_t n, IntSummary& s) {
+    summarize(v, rows, n, s);
+}
+
+// ----- Query -----
+namespace {
+
+struct StrSummary {
+    size_t count = 0;
+    std::string_view min, max;
+
+    void add(std::string_view x) {
+        if (count++ == 0 || x < min)
+            min = x;
+        if (count == 1 || x > max)
+            max = x;
+    }
+    void merge(const StrSummary& o) {
+        if (o.count == 0)
+            return;
+        if (count == 0 || o.min < min)
+            min = o.min;
+        if (count == 0 || o.max > max)
+            max = o.max;
+        count += o.count;
+    }
+};
+
+// Columns the aggregates read; each is summarized once, however many aggregates use it.
+struct Inputs {
+    std::vector<int> ints, strs;
+
+    Inputs(const Table& t, const std::vector<BoundAgg>& aggs) {
+        for (const auto& a : aggs) {
+            if (a.key || a.col < 0 || a.fn == AggFn::COUNT)
+                continue;
+            auto& v = t.columns[a.col].type == ColType::INT ? ints : strs;
+            if (std::find(v.begin(), v.end(), a.col) == v.end())
+                v.push_back(a.col);
+        }
+    }
+    static size_t slot(const std::vector<int>& v, int col) {
+        return std::find(v.begin(), v.end(), col) - v.begin();
+    }
+};
+
+// Partial result over one morsel: the matching rows and a summary per input column.
+struct Partial {
+    size_t count = 0;
+    std::vector<IntSummary> ints;
+    std::vector<StrSummary> strs;
+
+    void merge(const Partial& o) {
+        count += o.count;
+        for (size_t k = 0; k < ints.size(); ++k)
+            ints[k].merge(o.ints[k]);
+        for (size_t k = 0; k < strs.size(); ++k)
+            strs[k].merge(o.strs[k]);
+    }
+};
+
+std::string formatAvg(__int128 sum, size_t count) {
+    char buf[64];
+    const double avg = static_cast<double>(sum) / static_cast<double>(count);
+    auto r = std::to_chars(buf, buf + sizeof(buf), avg);
+    return std::string(buf, r.ptr);
+}
+
+// Value of a over a non-empty input of count rows.
+Value finish(const Table& t, const BoundAgg& a, size_t count, const IntSummary* is, const StrSummary* ss) {
+    if (a.fn == AggFn::COUNT)
+        return Value::makeInt(static_cast<long long>(count));
+    if (ss)
+        return Value::makeStr(a.fn == AggFn::MIN ? ss->min : ss->max);
+    switch (a.fn) {
+    case AggFn::SUM:
+        if (is->sum < LLONG_MIN || is->sum > LLONG_MAX)
+            throw std::runtime_error("SUM overflows int: " + t.columns[a.col].name);
+        return Value::makeInt(static_cast<long long>(is->sum));
+    case AggFn::MIN:
+        return Value::makeInt(is->min);
+    case AggFn::MAX:
+        return Value::makeInt(is->max);
+    case AggFn::AVG:
+        return Value::makeStr(formatAvg(is->sum, is->count));
+    case AggFn::COUNT:
+        break;
+    }
+    return Value();
+}
+
+ColType resultType(const Table& t, const BoundAgg& a) {
+    if (a.key)
+        return t.columns[a.col].type;
+    switch (a.fn) {
+    case AggFn::COUNT:
+    case AggFn::SUM:
+        return ColType::INT;
+    case AggFn::MIN:
+    case AggFn::MAX:
+        return t.columns[a.col].type;
+    case AggFn::AVG:
+        break;
+    }
+    return ColType::STR;
+}
+
+void aggregateAll(const BoundSelect& b, ThreadPool* pool, std::vector<std::vector<Value>>& rows,
+                  std::vector<ColType>& types, std::vector<uint8_t>& nulls) {
+    const Table& t = *b.table;
+    const Inputs in(t, b.aggs);
+    auto fresh = [&] {
+        Partial p;
+        p.ints.resize(in.ints.size());
+        p.strs.resize(in.strs.size());
+        return p;
+    };
+    // folds rows [from, to) of t, or rows[from, to) when rows is given
+    auto fold = [&](Partial& p, const size_t* rows, size_t from, size_t to) {
+        p.count += to - from;
+        for (size_t k = 0; k < in.ints.size(); ++k) {
+            const int j = in.ints[k];
+            if (t.layout == Layout::COLUMNAR) {
+                const long long* v = t.cols[j].ints.data();
+                if (rows)
+                    summarizeInts(v, rows + from, to - from, p.ints[k]);
+                else
+                    summarizeInts(v + from, to - from, p.ints[k]);
+                continue;
+            }
+            IntSummary& s = p.ints[k];
+            for (size_t i = from; i < to; ++i) {
+                const long long x = t.intAt(rows ? rows[i] : i, j);
+                s.sum += x;
+                s.min = std::min(s.min, x);
+                s.max = std::max(s.max, x);
+            }
+            s.count += to - from;
+        }
+        for (size_t k = 0; k < in.strs.size(); ++k)
+            for (size_t i = from; i < to; ++i)
+                p.strs[k].add(t.strAt(rows ? rows[i] : i, in.strs[k]));
+    };
+    // morsels are folded in parallel, then merged in order
+    Partial total = fresh();
+    const bool columns = !in.ints.empty() || !in.strs.empty();
+    auto run = [&](const size_t* rows, size_t n) {
+        if (!columns) {
+            total.count += n;
+            return;
+        }
+        std::vector<Partial> parts((n + kMorsel - 1) / kMorsel, fresh());
+        forMorsels(pool, n, [&](size_t from, size_t to) { fold(parts[from / kMorsel], rows, from, to); });
+        for (const auto& p : parts)
+            total.merge(p);
+    };
+    if (b.where)
+        scanRows(t, &*b.where, pool, [&](const std::vector<size_t>& hits) { run(hits.data(), hits.size()); });
+    else
+        run(nullptr, t.rowCount()); // COUNT(*) alone never touches the rows
+
+    rows.assign(1, {});
+    types.clear();
+    nulls.clear();
+    for (const auto& a : b.aggs) {
+        types.push_back(resultType(t, a));
+        if (total.count == 0 && a.fn != AggFn::COUNT) {
+            rows[0].push_back(Value::makeStr("NULL"));
+            nulls.resize(b.aggs.size());
+            nulls[rows[0].size() - 1] = 1;
+            continue;
+        }
+        const bool str = a.col >= 0 && t.columns[a.col].type == ColType::STR;
+        const IntSummary* is = (a.col < 0 || str) ? nullptr : &total.ints[Inputs::slot(in.ints, a.col)];
+        const StrSummary* ss = (a.col >= 0 && str) ? &total.strs[Inputs::slot(in.strs, a.col)] : nullptr;
+        rows[0].push_back(finish(t, a, total.count, is, ss));
+    }
+}
+
+// ----- GROUP BY -----
+// Groups live in an open-addressing table with linear probing. A slot is 16
+// bytes (the key itself for INT keys, its hash for STR keys, plus the group
+// id), so a probe usually costs one cache line; per-group state is kept column
+// by column and updated a batch of rows at a time. INT keys spanning fewer
+// than kDirectSpan values skip hashing and index the groups directly.
+constexpr size_t kDirectSpan = 4096;
+constexpr size_t kBatch = 1024;
+constexpr uint32_t kNoGroup = UINT32_MAX;
+
+class GroupTable {
+  public:
+    std::vector<long long> intKeys;            // INT key of each group
+    std::vector<std::string_view> strKeys;     // STR key of each group
+    std::vector<size_t> counts;                // rows per group (0: unused direct slot)
+    std::vector<std::vector<IntSummary>> ints; // [input][group]
+    std::vector<std::vector<StrSummary>> strs; // [input][group]
+
+    GroupTable(const Inputs& in, bool strKey, bool direct, long long base, size_t span)
+        : ints(in.ints.size()), strs(in.strs.size()), strKey_(strKey), direct_(direct), base_(base) {
+        if (direct_) {
+            for (size_t g = 0; g < span; ++g) {
+                add();
+                intKeys.push_back(base_ + static_cast<long long>(g));
+            }
+        } else {
+            slots_.assign(1024, Slot{0, kNoGroup});
+        }
+    }
+
+    size_t size() const {
+        return counts.size();
+    }
+
+    uint32_t find(long long k) {
+        if (direct_)
+            return static_cast<uint32_t>(static_cast<unsigned long long>(k) - static_cast<unsigned long long>(base_));
+        if ((counts.size() + 1) * 2 > slots_.size())
+            grow();
+        const uint64_t tag = static_cast<uint64_t>(k);
+        const size_t mask = slots_.size() - 1;
+        for (size_t i = detail::mix64(tag) & mask;; i = (i + 1) & mask) {
+            Slot& s = slots_[i];
+            if (s.group == kNoGroup) {
+                s = Slot{tag, add()};
+                intKeys.push_back(k);
+                return s.group;
+            }
+            if (s.tag == tag)
+                return s.group;
+        }
+    }
+
+    uint32_t find(std::string_view k) {
+        if ((counts.size() + 1) * 2 > slots_.size())
+            grow();
+        const uint64_t tag = std::hash<std::string_view>{}(k);
+        const size_t mask = slots_.size() - 1;
+        for (size_t i = tag & mask;; i = (i + 1) & mask) {
+            Slot& s = slots_[i];
+            if (s.group == kNoGroup) {
+                s = Slot{tag, add()};
+                strKeys.push_back(k);
+                return s.group;
+            }
+            if (s.tag == tag && strKeys[s.group] == k)
+                return s.group;
+        }
+    }
+
+    void merge(const GroupTable& o) {
+        for (size_t g = 0; g < o.size(); ++g) {
+            if (o.counts[g] == 0)
+                continue;
+            const uint32_t id = strKey_ ? find(o.strKeys[g]) : find(o.intKeys[g]);
+            counts[id] += o.counts[g];
+            for (size_t k = 0; k < ints.size(); ++k)
+                ints[k][id].merge(o.ints[k][g]);
+            for (size_t k = 0; k < strs.size(); ++k)
+                strs[k][id].merge(o.strs[k][g]);
+        }
+    }
+
+  private:
+    struct Slot {
+        uint64_t tag;
+        uint32_t group;
+    };
+    std::vector<Slot> slots_; // power-of-two sized, at most half full
+    bool strKey_;
+    bool direct_;
+    long long base_;
+
+    uint32_t add() {
+        counts.push_back(0);
+        for (auto& v : ints)
+            v.emplace_back();
+        for (auto& v : strs)
+            v.emplace_back();
+        return static_cast<uint32_t>(counts.size() - 1);
+    }
+
+    void grow() {
+        std::vector<Slot> old(slots_.size() * 2, Slot{0, kNoGroup});
+        old.swap(slots_);
+        const size_t mask = slots_.size() - 1;
+        for (const Slot& s : old) {
+            if (s.group == kNoGroup)
+                continue;
+            size_t i = (strKey_ ? s.tag : detail::mix64(s.tag)) & mask;
+            while (slots_[i].group != kNoGroup)
+                i = (i + 1) & mask;
+            slots_[i] = s;
+        }
+    }
+};
+
+// Min and max of INT column j, for choosing the direct path.
+IntSummary columnRange(const Table& t, int j, ThreadPool* pool) {
+    const size_t n = t.rowCount();
+    std::vector<IntSummary> parts((n + kMorsel - 1) / kMorsel);
+    forMorsels(pool, n, [&](size_t from, size_t to) {
+        IntSummary& s = parts[from / kMorsel];
+        if (t.layout == Layout::COLUMNAR) {
+            summarizeInts(t.cols[j].ints.data() + from, to - from, s);
+            return;
+        }
+        for (size_t i = from; i < to; ++i) {
+            const long long x = t.intAt(i, j);
+            s.min = std::min(s.min, x);
+            s.max = std::max(s.max, x);
+        }
+        s.count += to - from;
+    });
+    IntSummary all;
+    for (const auto& s : parts)
+        all.merge(s);
+    return all;
+}
+
+void aggregateGroups(const BoundSelect& b, ThreadPool* pool, std::vector<std::vector<Value>>& out,
+                     std::vector<ColType>& types) {
+    const Table& t = *b.table;
+    const Inputs in(t, b.aggs);
+    const int key = b.groupCol;
+    // a DICT key groups by code, an INT key over the dense range [0, dictionary size)
+    const bool codeKey = t.columns[key].dict;
+    const bool strKey = t.columns[key].type == ColType::STR && !codeKey;
+    bool direct = false;
+    long long base = 0;
+    size_t span = 0;
+    if (codeKey) {
+        span = t.dicts[key].size();
+        direct = span < kDirectSpan;
+        span = direct ? span : 0;
+    } else if (!strKey) {
+        const IntSummary r = columnRange(t, key, pool);
+        const unsigned long long width =
+            static_cast<unsigned long long>(r.max) - static_cast<unsigned long long>(r.min);
+        direct = r.count > 0 && width < kDirectSpan;
+        base = r.min;
+        span = direct ? static_cast<size_t>(width) + 1 : 0;
+    }
+
+    // folds rows [from, to) of t (or rows[from, to)) into gt, a batch at a time:
+    // group ids first, then each input column in a tight loop over them
+    auto fold = [&](GroupTable& gt, const size_t* rows, size_t from, size_t to) {
+        uint32_t gid[kBatch];
+        const bool intCol = !strKey && !codeKey && t.layout == Layout::COLUMNAR;
+        const long long* keys = intCol ? t.cols[key].ints.data() : nullptr;
+        for (size_t at = from; at < to; at += kBatch) {
+            const size_t n = std::min(kBatch, to - at);
+            const size_t* r = rows ? rows + at : nullptr;
+            for (size_t i = 0; i < n; ++i) {
+                const size_t row = r ? r[i] : at + i;
+                if (strKey)
+                    gid[i] = gt.find(t.strAt(row, key));
+                else if (codeKey)
+                    gid[i] = gt.find(static_cast<long long>(t.codeAt(row, key)));
+                else
+                    gid[i] = gt.find(keys ? keys[row] : t.intAt(row, key));
+            }
+            for (size_t i = 0; i < n; ++i)
+                ++gt.counts[gid[i]];
+            for (size_t k = 0; k < in.ints.size(); ++k) {
+                const int j = in.ints[k];
+                const long long* v = t.layout == Layout::COLUMNAR ? t.cols[j].ints.data() : nullptr;
+                IntSummary* acc = gt.ints[k].data();
+                for (size_t i = 0; i < n; ++i) {
+                    const size_t row = r ? r[i] : at + i;
+                    const long long x = v ? v[row] : t.intAt(row, j);
+                    IntSummary& s = acc[gid[i]];
+                    ++s.count;
+                    s.sum += x;
+                    s.min = std::min(s.min, x);
+                    s.max = std::max(s.max, x);
+                }
+            }
+            for (size_t k = 0; k < in.strs.size(); ++k) {
+                StrSummary* acc = gt.strs[k].data();
+                for (size_t i = 0; i < n; ++i)
+                    acc[gid[i]].add(t.strAt(r ? r[i] : at + i, in.strs[k]));
+            }
+        }
+    };
+
+    // One task per pool thread pulls morsels and folds them into its own
+    // partial table, so no group state is shared while scanning. Partials are
+    // created on first use and merged at the end.
+    const size_t workers = pool ? pool->size() : 1;
+    std::vector<std::optional<GroupTable>> partials(workers);
+    auto run = [&](const size_t* rows, size_t n) {
+        const size_t morsels = (n + kMorsel - 1) / kMorsel;
+        std::atomic<size_t> next{0};
+        auto work = [&](size_t w) {
+            for (size_t m; (m = next++) < morsels;) {
+                if (!partials[w])
+                    partials[w].emplace(in, strKey, direct, base, span);
+                fold(*partials[w], rows, m * kMorsel, std::min(n, (m + 1) * kMorsel));
+            }
+        };
+        if (!pool || workers == 1 || morsels <= 1)
+            work(0);
+        else
+            pool->parallelFor(std::min(workers, morsels), work);
+    };
+    if (b.where)
+        scanRows(t, &*b.where, pool, [&](const std::vector<size_t>& hits) { run(hits.data(), hits.size()); });
+    else
+        run(nullptr, t.rowCount());
+
+    types.clear();
+    for (const auto& a : b.aggs)
+        types.push_back(resultType(t, a));
+    out.clear();
+    GroupTable* all = nullptr;
+    for (auto& p : partials) {
+        if (!p)
+            continue;
+        if (!all)
+            all = &*p;
+        else
+            all->merge(*p);
+    }
+    if (!all)
+        return;
+
+    // groups come out in key order
+    std::vector<uint32_t> order;
+    for (size_t g = 0; g < all->size(); ++g)
+        if (all->counts[g] > 0)
+            order.push_back(static_cast<uint32_t>(g));
+    const GroupTable& gt = *all;
+    if (strKey) {
+        std::sort(order.begin(), order.end(), [&](uint32_t x, uint32_t y) { return gt.strKeys[x] < gt.strKeys[y]; });
+    } else if (codeKey) {
+        const uint32_t* ranks = t.dicts[key].ranks();
+        auto rank = [&](uint32_t g) { return ranks[gt.intKeys[g]]; };
+        std::sort(order.begin(), order.end(), [&](uint32_t x, uint32_t y) { return rank(x) < rank(y); });
+    } else if (!direct) { // direct groups are already in key order
+        std::sort(order.begin(), order.end(), [&](uint32_t x, uint32_t y) { return gt.intKeys[x] < gt.intKeys[y]; });
+    }
+    out.reserve(order.size());
+    for (uint32_t g : order) {
+        std::vector<Value> cells;
+        for (const auto& a : b.aggs) {
+            if (a.key) {
+                if (strKey)
+                    cells.push_back(Value::makeStr(all->strKeys[g]));
+                else if (codeKey)
+                    cells.push_back(Value::makeStr(t.dicts[key].at(static_cast<uint32_t>(all->intKeys[g]))));
+                else
+                    cells.push_back(Value::makeInt(all->intKeys[g]));
+                continue;
+            }
+            const bool str = a.col >= 0 && t.columns[a.col].type == ColType::STR;
+            const IntSummary* is = (a.col < 0 || str) ? nullptr : &all->ints[Inputs::slot(in.ints, a.col)][g];
+            const StrSummary* ss = (a.col >= 0 && str) ? &all->strs[Inputs::slot(in.strs, a.col)][g] : nullptr;
+            cells.push_back(finish(t, a, all->counts[g], is, ss));
+        }
+        out.push_back(std::move(cells));
+    }
+}
+
+} // namespace
+
+void aggregate(const BoundSelect& b, ThreadPool* pool, std::vector<std::vector<Value>>& rows,
+               std::vector<ColType>& types, std::vector<uint8_t>& nulls) {
+    nulls.clear();
+    if (b.groupCol >= 0)
+        aggregateGroups(b, pool, rows, types);
+    else
+        aggregateAll(b, pool, rows, types, nulls);
+}
+
+} // namespace imd
@@ -0,0 +1,182 @@
+﻿#include "imd/bgsave.hpp"
+#include "imd/snapshot.hpp"
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace imd {
+
+// Lives in a MAP_SHARED page, written by the child and read by the parent.
+struct BackgroundSave::Shared {
+    std::atomic<uint64_t> done{0}, total{0};
+    char error[256] = {};
+    int err = 0; // errno behind error
+};
+
+BackgroundSave& backgroundSave(Database& db) {
+    static std::mutex m; // BGSAVE STATUS runs without latches
+    std::lock_guard<std::mutex> lk(m);
+    if (!db.bgsave)
+        db.bgsave = std::make_shared<BackgroundSave>();
+    return *db.bgsave;
+}
+
+const char* stateName(BackgroundSave::State s) {
+    switch (s) {
+    case BackgroundSave::State::IDLE:
+        return "idle";
+    case BackgroundSave::State::RUNNING:
+        return "running";
+    case BackgroundSave::State::DONE:
+        return "done";
+    case BackgroundSave::State::FAILED:
+        return "failed";
+    }
+    return "?";
+}
+
+#ifdef _WIN32
+BackgroundSave::BackgroundSave() = default;
+BackgroundSave::~BackgroundSave() = default;
+
+void BackgroundSave::start(Database&, const std::string&) {
+    throw std::runtime_error("BGSAVE needs fork(), which this platform lacks; use SAVE");
+}
+
+BackgroundSave::Status BackgroundSave::status() {
+    return last_;
+}
+
+BackgroundSave::Status BackgroundSave::wait() {
+    return last_;
+}
+
+BackgroundSave::Status BackgroundSave::poll() {
+    return last_;
+}
+
+void BackgroundSave::finish(int) {}
+#else
+BackgroundSave::BackgroundSave() {
+    void* p = mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        throw std::runtime_error("BGSAVE: cannot map shared progress page");
+    shared_ = new (p) Shared();
+}
+
+BackgroundSave::~BackgroundSave() {
+    wait();
+    shared_->~Shared();
+    munmap(shared_, sizeof(Shared));
+}
+
+void BackgroundSave::start(Database& db, const std::string& path) {
+    std::lock_guard<std::mutex> lk(m_);
+    if (poll().state == State::RUNNING)
+        throw std::runtime_error("BGSAVE already in progress (" + last_.path + ")");
+    shared_->done = 0;
+    shared_->total = 0;
+    shared_->error[0] = '\0';
+    shared_->err = 0;
+    // Everything that allocates happens here, before fork: other threads may
+    // hold the allocator's or a latch's lock at that moment, and the child
+    // would inherit it locked with nobody left to release it.
+    SnapshotWriter writer(db, path);
+    const SnapshotProgress progress = [this](uint64_t done, uint64_t total) {
+        shared_->total.store(total, std::memory_order_relaxed);
+        shared_->done.store(done, std::memory_order_relaxed);
+    };
+
+    const auto t0 = std::chrono::steady_clock::now();
+    const pid_t pid = fork();
+    if (pid == 0) {
+        // Child: one thread, a frozen copy of the database, async-signal-safe
+        // calls only. _exit skips atexit handlers and static destructors that
+        // belong to the parent.
+        if (const char* err = writer.write(progress)) {
+            shared_->err = errno;
+            std::strncpy(shared_->error, err, sizeof(shared_->error) - 1);
+            _exit(1);
+        }
+        _exit(0);
+    }
+    const auto t1 = std::chrono::steady_clock::now();
+    if (pid < 0)
+        throw std::runtime_error(std::string("BGSAVE: fork failed: ") + std::strerror(errno));
+    pid_ = pid;
+    started_ = t0;
+    last_ = Status{};
+    last_.state = State::RUNNING;
+    last_.path = path;
+    last_.forkMicros =
+        static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count());
+}
+
+void BackgroundSave::finish(int waitStatus) {
+    pid_ = -1;
+    last_.cellsDone = shared_->done.load();
+    last_.cellsTotal = shared_->total.load();
+    last_.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started_).count();
+    if (WIFEXITED(waitStatus) && WEXITSTATUS(waitStatus) == 0) {
+        last_.state = State::DONE;
+        return;
+    }
+    last_.state = State::FAILED;
+    last_.error = shared_->error[0] ? std::string(shared_->error) + ": " + std::strerror(shared_->err)
+                  : WIFSIGNALED(waitStatus) ? "killed by signal " + std::to_string(WTERMSIG(waitStatus))
+                                            : "child exited with status " + std::to_string(WEXITSTATUS(waitStatus));
+}
+
+BackgroundSave::Status BackgroundSave::status() {
+    std::lock_guard<std::mutex> lk(m_);
+    return poll();
+}
+
+BackgroundSave::Status BackgroundSave::poll() {
+    if (pid_ < 0)
+        return last_;
+    int st = 0;
+    const pid_t r = waitpid(static_cast<pid_t>(pid_), &st, WNOHANG);
+    if (r == static_cast<pid_t>(pid_)) {
+        finish(st);
+    } else if (r < 0) {
+        pid_ = -1;
+        last_.state = State::FAILED;
+        last_.error = "lost track of the child process";
+    } else {
+        last_.cellsDone = shared_->done.load(std::memory_order_relaxed);
+        last_.cellsTotal = shared_->total.load(std::memory_order_relaxed);
+        last_.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started_).count();
+    }
+    return last_;
+}
+
+BackgroundSave::Status BackgroundSave::wait() {
+    std::lock_guard<std::mutex> lk(m_);
+    if (pid_ < 0)
+        return last_;
+    int st = 0;
+    pid_t r;
+    do
+        r = waitpid(static_cast<pid_t>(pid_), &st, 0);
+    while (r < 0 && errno == EINTR);
+    if (r == static_cast<pid_t>(pid_)) {
+        finish(st);
+    } else {
+        pid_ = -1;
+        last_.state = State::FAILED;
+        last_.error = "lost track of the child process";
+    }
+    return last_;
+}
+#endif
+
+} // namespace imd
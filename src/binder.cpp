@@ -0,0 +1,423 @@
+﻿#include "imd/binder.hpp"
+#include <stdexcept>
+
+namespace imd {
+
+static Value defaultFor(ColType t) {
+    if (t == ColType::INT)
+        return Value::makeInt(0);
+    return Value::makeStr("");
+}
+
+static void typeCheckAssign(const Column& col, const Value& v) {
+    if (col.type == ColType::INT && !v.isInt())
+        throw std::runtime_error("Type error: expected int for column '" + col.name + "'");
+    if (col.type == ColType::STR && !v.isStr())
+        throw std::runtime_error("Type error: expected str for column '" + col.name + "'");
+}
+
+// ----- Predicates -----
+static bool strLt(std::string_view v, std::string_view lit) {
+    return v < lit;
+}
+static bool strLe(std::string_view v, std::string_view lit) {
+    return v <= lit;
+}
+static bool strGt(std::string_view v, std::string_view lit) {
+    return v > lit;
+}
+static bool strGe(std::string_view v, std::string_view lit) {
+    return v >= lit;
+}
+
+// The parts of b that depend on c.literal, given its resolved column.
+static void bindLiteral(BoundCmp& b, const Condition& c) {
+    b.literal = &c.literal;
+    b.fold = BoundCmp::Fold::NONE;
+    b.strCmp = nullptr;
+    if ((b.type == ColType::INT) != c.literal.isInt()) {
+        // mixed types: never equal, not ordered
+        if (c.op == CmpOp::EQ)
+            b.fold = BoundCmp::Fold::NEVER;
+        else if (c.op == CmpOp::NE)
+            b.fold = BoundCmp::Fold::ALWAYS;
+        else
+            throw std::runtime_error("Type mismatch in comparison");
+        return;
+    }
+    if (b.type == ColType::INT) {
+        b.ival = c.literal.asInt();
+        return;
+    }
+    b.sval = c.literal.asStr();
+    switch (c.op) {
+    case CmpOp::LT:
+        b.strCmp = strLt;
+        break;
+    case CmpOp::LE:
+        b.strCmp = strLe;
+        break;
+    case CmpOp::GT:
+        b.strCmp = strGt;
+        break;
+    case CmpOp::GE:
+        b.strCmp = strGe;
+        break;
+    default: // EQ / NE use the equality kernel
+        break;
+    }
+}
+
+BoundCmp bindCmp(const Table& t, const Condition& c) {
+    BoundCmp b;
+    b.col = t.indexOf(c.column);
+    if (b.col < 0)
+        throw std::runtime_error("Unknown column in WHERE: " + c.column);
+    b.type = t.columns[b.col].type;
+    b.op = c.op;
+    bindLiteral(b, c);
+    return b;
+}
+
+BoundExpr bindExpr(const Table& t, const Expr& e) {
+    BoundExpr b;
+    b.kind = e.kind;
+    if (e.kind == ExprKind::CMP) {
+        b.cmp = bindCmp(t, e.cmp);
+        return b;
+    }
+    b.kids.reserve(e.kids.size());
+    for (const auto& k : e.kids)
+        b.kids.push_back(bindExpr(t, k));
+    return b;
+}
+
+static std::optional<BoundExpr> bindWhere(const Table& t, const std::optional<Expr>& where) {
+    if (!where)
+        return std::nullopt;
+    return bindExpr(t, *where);
+}
+
+// bindExpr for an e whose literals changed since b was bound from it.
+static void rebindExpr(BoundExpr& b, const Expr& e) {
+    if (e.kind == ExprKind::CMP) {
+        bindLiteral(b.cmp, e.cmp);
+        return;
+    }
+    for (size_t k = 0; k < e.kids.size(); ++k)
+        rebindExpr(b.kids[k], e.kids[k]);
+}
+
+static void rebindWhere(std::optional<BoundExpr>& b, const std::optional<Expr>& where) {
+    if (where)
+        rebindExpr(*b, *where);
+}
+
+// ----- Statements -----
+Table& Binder::table(const std::string& name) const {
+    Table* t = db_.find(name);
+    if (!t)
+        throw std::runtime_error("No such table: " + name);
+    return *t;
+}
+
+BoundCreate Binder::bind(const CreateStmt& s) const {
+    if (db_.tables.count(s.table))
+        throw std::runtime_error("Table already exists: " + s.table);
+    BoundCreate b;
+    Table& t = b.table;
+    t.name = s.table;
+    t.layout = s.layout;
+    for (size_t i = 0; i < s.columns.size(); ++i) {
+        if (!t.colIndex.emplace(s.columns[i].name, static_cast<int>(i)).second)
+            throw std::runtime_error("Duplicate column: " + s.columns[i].name);
+        t.columns.push_back(s.columns[i]);
+    }
+    if (t.layout == Layout::COLUMNAR)
+        t.cols.resize(t.columns.size());
+    t.dicts.resize(t.columns.size());
+    return b;
+}
+
+BoundInsert Binder::bind(const InsertStmt& s) const {
+    BoundInsert b;
+    b.table = &table(s.table);
+    const Table& t = *b.table;
+    b.defaults.reserve(t.columns.size());
+    for (const auto& col : t.columns)
+        b.defaults.push_back(defaultFor(col.type));
+    b.pos.reserve(s.cols.size());
+    for (const auto& cn : s.cols) {
+        int j = t.indexOf(cn);
+        if (j < 0)
+            throw std::runtime_error("Unknown column: " + cn);
+        b.pos.push_back(j);
+    }
+    rebind(b, s);
+    return b;
+}
+
+void Binder::rebind(BoundInsert& b, const InsertStmt& s) const {
+    const Table& t = *b.table;
+    // checked up front so a bad row cannot leave the statement half applied
+    for (const auto& values : s.rows) {
+        if (values.size() != b.pos.size())
+            throw std::runtime_error("VALUES count does not match column list");
+        for (size_t k = 0; k < values.size(); ++k)
+            typeCheckAssign(t.columns[b.pos[k]], values[k]);
+    }
+    b.rows = &s.rows;
+}
+
+BoundDelete Binder::bind(const DeleteStmt& s) const {
+    BoundDelete b;
+    b.table = &table(s.table);
+    b.where = bindWhere(*b.table, s.where);
+    return b;
+}
+
+void Binder::rebind(BoundDelete& b, const DeleteStmt& s) const {
+    rebindWhere(b.where, s.where);
+}
+
+BoundUpdate Binder::bind(const UpdateStmt& s) const {
+    BoundUpdate b;
+    b.table = &table(s.table);
+    const Table& t = *b.table;
+    b.sets.reserve(s.assignments.size());
+    for (const auto& [cn, v] : s.assignments) {
+        int j = t.indexOf(cn);
+        if (j < 0)
+            throw std::runtime_error("Unknown column in SET: " + cn);
+        typeCheckAssign(t.columns[j], v);
+        b.sets.push_back({j, &v});
+    }
+    b.where = bindWhere(t, s.where);
+    return b;
+}
+
+void Binder::rebind(BoundUpdate& b, const UpdateStmt& s) const {
+    for (const auto& [j, v] : b.sets)
+        typeCheckAssign(b.table->columns[j], *v);
+    rebindWhere(b.where, s.where);
+}
+
+static const char* aggName(AggFn fn) {
+    switch (fn) {
+    case AggFn::COUNT:
+        return "COUNT";
+    case AggFn::SUM:
+        return "SUM";
+    case AggFn::MIN:
+        return "MIN";
+    case AggFn::MAX:
+        return "MAX";
+    case AggFn::AVG:
+        return "AVG";
+    }
+    return "?";
+}
+
+static size_t bindCount(const Value& v, const char* what) {
+    if (!v.isInt() || v.asInt() < 0)
+        throw std::runtime_error(std::string(what) + " needs a non-negative int");
+    return static_cast<size_t>(v.asInt());
+}
+
+BoundSelect Binder::bind(const SelectStmt& s) const {
+    if (s.join)
+        throw std::runtime_error("JOIN is not supported here");
+    BoundSelect b;
+    b.table = &table(s.table);
+    const Table& t = *b.table;
+    if (!s.orderBy.empty()) {
+        b.orderCol = t.indexOf(s.orderBy);
+        if (b.orderCol < 0)
+            throw std::runtime_error("Unknown column: " + s.orderBy);
+        b.desc = s.desc;
+    }
+    if (s.limit)
+        b.limit = bindCount(*s.limit, "LIMIT");
+    b.offset = bindCount(s.offset, "OFFSET");
+    if (!s.aggregates.empty() || !s.groupBy.empty()) {
+        if (s.selectAll)
+            throw std::runtime_error("SELECT * cannot be grouped");
+        if (!s.orderBy.empty() && s.orderBy != s.groupBy)
+            throw std::runtime_error("ORDER BY of an aggregate query must name the GROUP BY column");
+        if (!s.groupBy.empty()) {
+            b.groupCol = t.indexOf(s.groupBy);
+            if (b.groupCol < 0)
+                throw std::runtime_error("Unknown column: " + s.groupBy);
+        }
+        const size_t n = s.cols.size() + s.aggregates.size();
+        b.aggs.resize(n);
+        b.headers.resize(n);
+        std::vector<bool> taken(n, false);
+        for (const auto& a : s.aggregates) {
+            BoundAgg& ba = b.aggs[a.pos];
+            ba.fn = a.fn;
+            if (!a.column.empty()) {
+                ba.col = t.indexOf(a.column);
+                if (ba.col < 0)
+                    throw std::runtime_error("Unknown column: " + a.column);
+                if ((a.fn == AggFn::SUM || a.fn == AggFn::AVG) && t.columns[ba.col].type != ColType::INT)
+                    throw std::runtime_error(std::string(aggName(a.fn)) + " needs an int column: " + a.column);
+            }
+            b.headers[a.pos] = std::string(aggName(a.fn)) + "(" + (a.column.empty() ? "*" : a.column) + ")";
+            taken[a.pos] = true;
+        }
+        // plain columns fill the remaining positions, and may only name the GROUP BY column
+        size_t pos = 0;
+        for (const auto& cn : s.cols) {
+            while (taken[pos])
+                ++pos;
+            if (b.groupCol < 0)
+                throw std::runtime_error("Cannot select columns together with aggregates");
+            if (cn != s.groupBy)
+                throw std::runtime_error("Column must appear in GROUP BY: " + cn);
+            b.aggs[pos].key = true;
+            b.aggs[pos].col = b.groupCol;
+            b.headers[pos++] = cn;
+        }
+        b.where = bindWhere(t, s.where);
+        return b;
+    }
+    if (s.selectAll) {
+        for (size_t j = 0; j < t.columns.size(); ++j)
+            b.proj.push_back(static_cast<int>(j));
+    } else {
+        for (const auto& cn : s.cols) {
+            int j = t.indexOf(cn);
+            if (j < 0)
+                throw std::runtime_error("Unknown column: " + cn);
+            b.proj.push_back(j);
+        }
+    }
+    for (int j : b.proj)
+        b.headers.push_back(t.columns[j].name);
+    b.where = bindWhere(t, s.where);
+    return b;
+}
+
+void Binder::rebind(BoundSelect& b, const SelectStmt& s) const {
+    if (s.limit)
+        b.limit = bindCount(*s.limit, "LIMIT");
+    b.offset = bindCount(s.offset, "OFFSET");
+    rebindWhere(b.where, s.where);
+}
+
+// ----- JOIN -----
+// Side and column of name, which is <column> (unique across both sides) or <table>.<column>.
+static std::pair<int, int> joinColumn(const Table* const side[2], const std::string& name) {
+    const size_t dot = name.find('.');
+    if (dot != std::string::npos) {
+        const std::string q = name.substr(0, dot), c = name.substr(dot + 1);
+        for (int k = 0; k < 2; ++k) {
+            if (side[k]->name != q)
+                continue;
+            const int j = side[k]->indexOf(c);
+            if (j < 0)
+                throw std::runtime_error("Unknown column: " + name);
+            return {k, j};
+        }
+        throw std::runtime_error("Unknown table in column: " + name);
+    }
+    const int j0 = side[0]->indexOf(name), j1 = side[1]->indexOf(name);
+    if (j0 >= 0 && j1 >= 0)
+        throw std::runtime_error("Ambiguous column: " + name);
+    if (j0 < 0 && j1 < 0)
+        throw std::runtime_error("Unknown column: " + name);
+    return j0 >= 0 ? std::make_pair(0, j0) : std::make_pair(1, j1);
+}
+
+// Side every comparison in e reads, or -1 when e reads both.
+static int joinSide(const Table* const side[2], const Expr& e) {
+    if (e.kind == ExprKind::CMP)
+        return joinColumn(side, e.cmp.column).first;
+    int k = joinSide(side, e.kids[0]);
+    for (size_t m = 1; m < e.kids.size(); ++m)
+        if (joinSide(side, e.kids[m]) != k)
+            k = -1;
+    return k;
+}
+
+// bindExpr for side k of a JOIN: names may be qualified; literals stay borrowed from e.
+static BoundExpr bindSide(const Table* const side[2], int k, const Expr& e) {
+    BoundExpr b;
+    b.kind = e.kind;
+    if (e.kind == ExprKind::CMP) {
+        Condition c = e.cmp;
+        c.column = side[k]->columns[joinColumn(side, c.column).second].name;
+        b.cmp = bindCmp(*side[k], c);
+        b.cmp.literal = &e.cmp.literal;
+        if (e.cmp.literal.isStr())
+            b.cmp.sval = e.cmp.literal.asStr();
+        return b;
+    }
+    for (const auto& kid : e.kids)
+        b.kids.push_back(bindSide(side, k, kid));
+    return b;
+}
+
+BoundJoin Binder::bindJoin(const SelectStmt& s) const {
+    if (!s.aggregates.empty() || !s.groupBy.empty() || !s.orderBy.empty())
+        throw std::runtime_error("Aggregates, GROUP BY and ORDER BY are not supported with JOIN");
+    BoundJoin b;
+    b.side[0] = &table(s.table);
+    b.side[1] = &table(s.join->table);
+    if (b.side[0] == b.side[1])
+        throw std::runtime_error("Cannot join a table with itself");
+    const auto l = joinColumn(b.side, s.join->left), r = joinColumn(b.side, s.join->right);
+    if (l.first == r.first)
+        throw std::runtime_error("JOIN condition must compare columns of both tables");
+    b.key[l.first] = l.second;
+    b.key[r.first] = r.second;
+    if (b.side[0]->columns[b.key[0]].type != b.side[1]->columns[b.key[1]].type)
+        throw std::runtime_error("JOIN columns must have the same type");
+
+    if (s.selectAll) {
+        for (int k = 0; k < 2; ++k)
+            for (size_t j = 0; j < b.side[k]->columns.size(); ++j) {
+                b.proj.push_back({k, static_cast<int>(j)});
+                b.headers.push_back(b.side[k]->name + "." + b.side[k]->columns[j].name);
+            }
+    } else {
+        for (const auto& cn : s.cols) {
+            b.proj.push_back(joinColumn(b.side, cn));
+            b.headers.push_back(cn);
+        }
+    }
+
+    // each AND term goes below the join, to the side it reads
+    if (s.where) {
+        std::vector<const Expr*> terms[2];
+        auto push = [&](const Expr& e) {
+            const int k = joinSide(b.side, e);
+            if (k < 0)
+                throw std::runtime_error("WHERE terms under OR / NOT must read one side of the JOIN");
+            terms[k].push_back(&e);
+        };
+        if (s.where->kind == ExprKind::AND)
+            for (const auto& e : s.where->kids)
+                push(e);
+        else
+            push(*s.where);
+        for (int k = 0; k < 2; ++k) {
+            if (terms[k].size() == 1) {
+                b.where[k] = bindSide(b.side, k, *terms[k][0]);
+            } else if (!terms[k].empty()) {
+                BoundExpr all;
+                all.kind = ExprKind::AND;
+                for (const Expr* e : terms[k])
+                    all.kids.push_back(bindSide(b.side, k, *e));
+                b.where[k] = std::move(all);
+            }
+        }
+    }
+    if (s.limit)
+        b.limit = bindCount(*s.limit, "LIMIT");
+    b.offset = bindCount(s.offset, "OFFSET");
+    return b;
+}
+
+} // namespace imd
@@ -0,0 +1,444 @@
+﻿#include "imd/index.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace imd {
+namespace detail {
+
+// Nodes take at most eight cache lines. An inner node holds a key, a row and
+// a child per entry plus the node header and one more child, so that sets the
+// capacity: 20 int keys or 10 string keys per node on 64-bit targets.
+constexpr size_t kNodeBytes = 512;
+template <class K> static constexpr int nodeCap() {
+    return static_cast<int>((kNodeBytes - 2 * sizeof(void*)) / (sizeof(K) + sizeof(size_t) + sizeof(void*)));
+}
+
+// Erases since the last (re)build before erase() considers rebuilding.
+constexpr size_t kMinRebuild = 1024;
+
+template <class K> struct BPlusTree<K>::Node {
+    bool leaf;
+    int n = 0;
+    explicit Node(bool isLeaf) : leaf(isLeaf) {}
+};
+
+template <class K> struct alignas(64) BPlusTree<K>::Leaf : Node {
+    K keys[nodeCap<K>()];
+    size_t rows[nodeCap<K>()];
+    Leaf* next = nullptr;
+    Leaf() : Node(true) {
+        static_assert(sizeof(Leaf) <= kNodeBytes, "leaf outgrows its byte budget");
+    }
+};
+
+// kids[i] holds entries below separator i; kids[i + 1] holds entries from it upward.
+template <class K> struct alignas(64) BPlusTree<K>::Inner : Node {
+    K keys[nodeCap<K>()];
+    size_t rows[nodeCap<K>()];
+    Node* kids[nodeCap<K>() + 1];
+    Inner() : Node(false) {
+        static_assert(sizeof(Inner) <= kNodeBytes, "inner node outgrows its byte budget");
+    }
+};
+
+template <class K> static bool lessPair(const K& ak, size_t ar, const K& bk, size_t br) {
+    return ak < bk || (!(bk < ak) && ar < br);
+}
+
+// Number of entries in [0, n) that are <= (key, row): the child to descend into.
+template <class K> static int childFor(const K* keys, const size_t* rows, int n, const K& key, size_t row) {
+    int i = 0;
+    while (i < n && !lessPair(key, row, keys[i], rows[i]))
+        ++i;
+    return i;
+}
+
+template <class K> BPlusTree<K>::BPlusTree() : root_(new Leaf()) {}
+
+template <class K> BPlusTree<K>::~BPlusTree() {
+    clear();
+    delete static_cast<Leaf*>(root_);
+}
+
+template <class K> void BPlusTree<K>::clear() {
+    // iterative teardown: free every node, then start from one empty leaf
+    std::vector<Node*> stack{root_};
+    while (!stack.empty()) {
+        Node* n = stack.back();
+        stack.pop_back();
+        if (n->leaf) {
+            delete static_cast<Leaf*>(n);
+        } else {
+            Inner* in = static_cast<Inner*>(n);
+            for (int i = 0; i <= in->n; ++i)
+                stack.push_back(in->kids[i]);
+            delete in;
+        }
+    }
+    root_ = new Leaf();
+    size_ = erased_ = 0;
+}
+
+template <class K> typename BPlusTree<K>::Leaf* BPlusTree<K>::leftmost() const {
+    Node* n = root_;
+    while (!n->leaf)
+        n = static_cast<Inner*>(n)->kids[0];
+    return static_cast<Leaf*>(n);
+}
+
+template <class K> void BPlusTree<K>::insert(const K& key, size_t row) {
+    constexpr int cap = nodeCap<K>();
+    ++size_;
+    struct Frame {
+        Inner* node;
+        int slot;
+    };
+    std::vector<Frame> path;
+    Node* n = root_;
+    while (!n->leaf) {
+        Inner* in = static_cast<Inner*>(n);
+        int c = childFor(in->keys, in->rows, in->n, key, row);
+        path.push_back({in, c});
+        n = in->kids[c];
+    }
+
+    // insert into the leaf, splitting it when full
+    Leaf* leaf = static_cast<Leaf*>(n);
+    int pos = childFor(leaf->keys, leaf->rows, leaf->n, key, row);
+    K upKey{};
+    size_t upRow = 0;
+    Node* upRight = nullptr;
+    if (leaf->n < cap) {
+        for (int i = leaf->n; i > pos; --i) {
+            leaf->keys[i] = std::move(leaf->keys[i - 1]);
+            leaf->rows[i] = leaf->rows[i - 1];
+        }
+        leaf->keys[pos] = key;
+        leaf->rows[pos] = row;
+        ++leaf->n;
+        return;
+    }
+    {
+        Leaf* right = new Leaf();
+        const int half = (cap + 1) / 2; // entries staying left after the insert
+        // merge the new entry into a scratch sequence of cap + 1 entries
+        std::vector<K> ks;
+        std::vector<size_t> rs;
+        ks.reserve(cap + 1);
+        rs.reserve(cap + 1);
+        for (int i = 0; i < cap; ++i) {
+            if (i == pos) {
+                ks.push_back(key);
+                rs.push_back(row);
+            }
+            ks.push_back(std::move(leaf->keys[i]));
+            rs.push_back(leaf->rows[i]);
+        }
+        if (pos == cap) {
+            ks.push_back(key);
+            rs.push_back(row);
+        }
+        for (int i = 0; i < half; ++i) {
+            leaf->keys[i] = std::move(ks[i]);
+            leaf->rows[i] = rs[i];
+        }
+        for (int i = half; i < cap; ++i)
+            leaf->keys[i] = K{};
+        leaf->n = half;
+        for (int i = half; i <= cap; ++i) {
+            right->keys[i - half] = std::move(ks[i]);
+            right->rows[i - half] = rs[i];
+        }
+        right->n = cap + 1 - half;
+        right->next = leaf->next;
+        leaf->next = right;
+        upKey = right->keys[0];
+        upRow = right->rows[0];
+        upRight = right;
+    }
+
+    // push separators up until a parent has room
+    while (upRight) {
+        if (path.empty()) {
+            Inner* root = new Inner();
+            root->keys[0] = std::move(upKey);
+            root->rows[0] = upRow;
+            root->kids[0] = root_;
+            root->kids[1] = upRight;
+            root->n = 1;
+            root_ = root;
+            return;
+        }
+        Frame f = path.back();
+        path.pop_back();
+        Inner* in = f.node;
+        int c = f.slot;
+        if (in->n < cap) {
+            for (int i = in->n; i > c; --i) {
+                in->keys[i] = std::move(in->keys[i - 1]);
+                in->rows[i] = in->rows[i - 1];
+                in->kids[i + 1] = in->kids[i];
+            }
+            in->keys[c] = std::move(upKey);
+            in->rows[c] = upRow;
+            in->kids[c + 1] = upRight;
+            ++in->n;
+            return;
+        }
+        // split a full inner node: cap + 1 separators, the middle one moves up
+        std::vector<K> ks;
+        std::vector<size_t> rs;
+        std::vector<Node*> kids;
+        for (int i = 0; i < cap; ++i) {
+            if (i == c) {
+                ks.push_back(upKey);
+                rs.push_back(upRow);
+            }
+            ks.push_back(std::move(in->keys[i]));
+            rs.push_back(in->rows[i]);
+        }
+        if (c == cap) {
+            ks.push_back(upKey);
+            rs.push_back(upRow);
+        }
+        for (int i = 0; i <= cap; ++i) {
+            kids.push_back(in->kids[i]);
+            if (i == c)
+                kids.push_back(upRight);
+        }
+        const int mid = (cap + 1) / 2;
+        Inner* right = new Inner();
+        for (int i = 0; i < mid; ++i) {
+            in->keys[i] = std::move(ks[i]);
+            in->rows[i] = rs[i];
+            in->kids[i] = kids[i];
+        }
+        in->kids[mid] = kids[mid];
+        for (int i = mid; i < cap; ++i)
+            in->keys[i] = K{};
+        in->n = mid;
+        for (int i = mid + 1; i <= cap; ++i) {
+            right->keys[i - mid - 1] = std::move(ks[i]);
+            right->rows[i - mid - 1] = rs[i];
+            right->kids[i - mid - 1] = kids[i];
+        }
+        right->kids[cap - mid] = kids[cap + 1];
+        right->n = cap - mid;
+        upKey = std::move(ks[mid]);
+        upRow = rs[mid];
+        upRight = right;
+    }
+}
+
+template <class K> void BPlusTree<K>::erase(const K& key, size_t row) {
+    Node* n = root_;
+    while (!n->leaf) {
+        Inner* in = static_cast<Inner*>(n);
+        n = in->kids[childFor(in->keys, in->rows, in->n, key, row)];
+    }
+    Leaf* leaf = static_cast<Leaf*>(n);
+    for (int i = 0; i < leaf->n; ++i) {
+        if (leaf->rows[i] != row || leaf->keys[i] < key || key < leaf->keys[i])
+            continue;
+        for (int k = i + 1; k < leaf->n; ++k) {
+            leaf->keys[k - 1] = std::move(leaf->keys[k]);
+            leaf->rows[k - 1] = leaf->rows[k];
+        }
+        --leaf->n;
+        leaf->keys[leaf->n] = K{};
+        --size_;
+        // Erase leaves underfull (even empty) nodes behind. Once more entries
+        // were erased than are left, rebuild so range walks stay short.
+        if (++erased_ >= kMinRebuild && erased_ > size_)
+            rebuild();
+        return;
+    }
+}
+
+template <class K> void BPlusTree<K>::rebuild() {
+    std::vector<K> keys;
+    std::vector<size_t> rows;
+    keys.reserve(size_);
+    rows.reserve(size_);
+    for (Leaf* leaf = leftmost(); leaf; leaf = leaf->next) {
+        for (int i = 0; i < leaf->n; ++i) {
+            keys.push_back(std::move(leaf->keys[i]));
+            rows.push_back(leaf->rows[i]);
+        }
+    }
+    clear();
+    build(keys, rows);
+}
+
+template <class K> size_t BPlusTree<K>::leaves() const {
+    size_t n = 0;
+    for (const Leaf* leaf = leftmost(); leaf; leaf = leaf->next)
+        ++n;
+    return n;
+}
+
+template <class K>
+void BPlusTree<K>::range(const K* lo, bool loIncl, const K* hi, bool hiIncl, std::vector<size_t>& out,
+                         size_t limit) const {
+    if (limit == 0)
+        return;
+    const size_t stop = out.size() + std::min(limit, std::numeric_limits<size_t>::max() - out.size());
+    const Leaf* leaf;
+    int i = 0;
+    if (lo) {
+        // seek to the first entry >= (lo, 0), or > (lo, max) when exclusive
+        const size_t r = loIncl ? 0 : std::numeric_limits<size_t>::max();
+        const Node* n = root_;
+        while (!n->leaf) {
+            const Inner* in = static_cast<const Inner*>(n);
+            n = in->kids[childFor(in->keys, in->rows, in->n, *lo, r)];
+        }
+        leaf = static_cast<const Leaf*>(n);
+        while (i < leaf->n && lessPair(leaf->keys[i], leaf->rows[i], *lo, r))
+            ++i;
+        if (!loIncl)
+            while (i < leaf->n && !(*lo < leaf->keys[i]))
+                ++i;
+    } else {
+        leaf = leftmost();
+    }
+    for (; leaf; leaf = leaf->next, i = 0) {
+        for (; i < leaf->n; ++i) {
+            const K& k = leaf->keys[i];
+            if (hi && (hiIncl ? *hi < k : !(k < *hi)))
+                return;
+            if (lo && !loIncl && !(*lo < k))
+                continue;
+            out.push_back(leaf->rows[i]);
+            if (out.size() == stop)
+                return;
+        }
+    }
+}
+
+template <class K> void BPlusTree<K>::compact(const std::vector<size_t>& newPos, const std::vector<uint8_t>& keep) {
+    // survivors come out of the leaf chain already sorted by (key, new row)
+    std::vector<K> keys;
+    std::vector<size_t> rows;
+    for (Leaf* leaf = leftmost(); leaf; leaf = leaf->next) {
+        for (int i = 0; i < leaf->n; ++i) {
+            if (!keep[leaf->rows[i]])
+                continue;
+            keys.push_back(std::move(leaf->keys[i]));
+            rows.push_back(newPos[leaf->rows[i]]);
+        }
+    }
+    clear();
+    build(keys, rows);
+}
+
+// Bulk load from sorted entries; nodes are left 3/4 full so later inserts rarely split.
+template <class K> void BPlusTree<K>::build(std::vector<K>& keys, std::vector<size_t>& rows) {
+    constexpr int cap = nodeCap<K>();
+    constexpr int fill = cap - cap / 4;
+    if (keys.empty())
+        return;
+    delete static_cast<Leaf*>(root_);
+    size_ = keys.size();
+
+    struct Built {
+        Node* node;
+        size_t first; // index of the subtree's smallest entry
+    };
+    std::vector<Built> level;
+    Leaf* prev = nullptr;
+    for (size_t i = 0; i < keys.size(); i += fill) {
+        Leaf* leaf = new Leaf();
+        const size_t end = std::min(keys.size(), i + fill);
+        for (size_t k = i; k < end; ++k) {
+            leaf->keys[k - i] = keys[k];
+            leaf->rows[k - i] = rows[k];
+        }
+        leaf->n = static_cast<int>(end - i);
+        if (prev)
+            prev->next = leaf;
+        prev = leaf;
+        level.push_back({leaf, i});
+    }
+    while (level.size() > 1) {
+        std::vector<Built> up;
+        for (size_t i = 0; i < level.size(); i += fill + 1) {
+            Inner* in = new Inner();
+            const size_t end = std::min(level.size(), i + fill + 1);
+            in->kids[0] = level[i].node;
+            for (size_t k = i + 1; k < end; ++k) {
+                in->keys[k - i - 1] = keys[level[k].first];
+                in->rows[k - i - 1] = rows[level[k].first];
+                in->kids[k - i] = level[k].node;
+            }
+            in->n = static_cast<int>(end - i - 1);
+            up.push_back({in, level[i].first});
+        }
+        level.swap(up);
+    }
+    root_ = level[0].node;
+}
+
+template class BPlusTree<long long>;
+template class BPlusTree<std::string>;
+
+} // namespace detail
+
+// ----- BTreeIndex -----
+void BTreeIndex::insert(const Value& key, size_t row) {
+    if (type() == ColType::INT)
+        ints_.insert(key.asInt(), row);
+    else
+        strs_.insert(std::string(key.asStr()), row);
+}
+
+void BTreeIndex::erase(const Value& key, size_t row) {
+    if (type() == ColType::INT)
+        ints_.erase(key.asInt(), row);
+    else
+        strs_.erase(std::string(key.asStr()), row);
+}
+
+void BTreeIndex::compact(const std::vector<uint8_t>& keep) {
+    std::vector<size_t> newPos(keep.size());
+    size_t w = 0;
+    for (size_t i = 0; i < keep.size(); ++i) {
+        newPos[i] = w;
+        w += keep[i] ? 1 : 0;
+    }
+    if (type() == ColType::INT)
+        ints_.compact(newPos, keep);
+    else
+        strs_.compact(newPos, keep);
+}
+
+void BTreeIndex::clear() {
+    ints_.clear();
+    strs_.clear();
+}
+
+void BTreeIndex::equal(const Value& key, std::vector<size_t>& out) const {
+    if ((type() == ColType::INT) != key.isInt())
+        return;
+    range(&key, true, &key, true, out, Order::KEY); // one key: (key, row) order is row order
+}
+
+void BTreeIndex::range(const Value* lo, bool loIncl, const Value* hi, bool hiIncl, std::vector<size_t>& out,
+                       Order order, size_t limit) const {
+    size_t from = out.size();
+    if (type() == ColType::INT) {
+        long long l = lo ? lo->asInt() : 0, h = hi ? hi->asInt() : 0;
+        ints_.range(lo ? &l : nullptr, loIncl, hi ? &h : nullptr, hiIncl, out, limit);
+    } else {
+        std::string l, h;
+        if (lo)
+            l = lo->asStr();
+        if (hi)
+            h = hi->asStr();
+        strs_.range(lo ? &l : nullptr, loIncl, hi ? &h : nullptr, hiIncl, out, limit);
+    }
+    if (order == Order::ROW)
+        std::sort(out.begin() + from, out.end());
+}
+
+} // namespace imd
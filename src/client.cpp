@@ -0,0 +1,116 @@
+﻿#include "imd/client.hpp"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace imd {
+
+#ifdef _WIN32
+int connectSocket(const Endpoint&, bool) {
+    throw std::runtime_error("The client needs POSIX sockets, which this platform lacks");
+}
+Client::Client(const std::string& endpoint) {
+    connectSocket(parseEndpoint(endpoint));
+}
+Client::~Client() = default;
+void Client::flush() {}
+#else
+int connectSocket(const Endpoint& e, bool nonBlocking) {
+    int fd;
+    int rc;
+    if (e.isUnix) {
+        sockaddr_un a{};
+        a.sun_family = AF_UNIX;
+        if (e.path.size() >= sizeof(a.sun_path))
+            throw std::runtime_error("Socket path too long: " + e.path);
+        std::memcpy(a.sun_path, e.path.c_str(), e.path.size() + 1);
+        fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        rc = fd < 0 ? -1 : ::connect(fd, reinterpret_cast<sockaddr*>(&a), sizeof(a));
+    } else {
+        sockaddr_in a{};
+        a.sin_family = AF_INET;
+        a.sin_port = htons(e.port);
+        if (::inet_pton(AF_INET, e.host.c_str(), &a.sin_addr) != 1)
+            throw std::runtime_error("Expected a numeric IPv4 host, got " + e.host);
+        fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        rc = fd < 0 ? -1 : ::connect(fd, reinterpret_cast<sockaddr*>(&a), sizeof(a));
+        int one = 1;
+        if (rc == 0)
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    if (rc < 0) {
+        const std::string why = std::strerror(errno);
+        if (fd >= 0)
+            ::close(fd);
+        throw std::runtime_error("Cannot connect to " + (e.isUnix ? e.path : e.host + ":" + std::to_string(e.port)) +
+                                 ": " + why);
+    }
+    if (nonBlocking)
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+Client::Client(const std::string& endpoint) : fd_(connectSocket(parseEndpoint(endpoint))) {}
+
+Client::~Client() {
+    if (fd_ >= 0)
+        ::close(fd_);
+}
+
+void Client::flush() {
+    size_t off = 0;
+    while (off < out_.size()) {
+        const ssize_t n = ::send(fd_, out_.data() + off, out_.size() - off, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            throw std::runtime_error(std::string("Send failed: ") + std::strerror(errno));
+        off += static_cast<size_t>(n);
+    }
+    out_.clear();
+}
+#endif
+
+Response Client::query(std::string_view sql) {
+    send(sql);
+    return receive();
+}
+
+void Client::send(std::string_view sql) {
+    appendRequest(out_, sql);
+}
+
+Response Client::receive() {
+    flush();
+    std::string payload;
+    while (!nextResponse(in_, inOff_, payload)) {
+        if (inOff_ > 0) {
+            in_.erase(0, inOff_);
+            inOff_ = 0;
+        }
+        char buf[64 * 1024];
+#ifdef _WIN32
+        const long n = -1;
+#else
+        const ssize_t n = ::recv(fd_, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+#endif
+        if (n <= 0)
+            throw std::runtime_error("Connection closed by server");
+        in_.append(buf, static_cast<size_t>(n));
+    }
+    return decodeResponse(payload);
+}
+
+} // namespace imd
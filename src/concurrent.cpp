@@ -0,0 +1,146 @@
+﻿#include "imd/concurrent.hpp"
+#include <atomic>
+
+namespace imd {
+
+// ----- ShardedSharedMutex -----
+size_t ShardedSharedMutex::shardOfThisThread() {
+    static std::atomic<size_t> next{0};
+    thread_local const size_t shard = next.fetch_add(1, std::memory_order_relaxed) % kShards;
+    return shard;
+}
+
+void ShardedSharedMutex::lock() {
+    for (auto& s : shards_) // always in order, so two writers cannot deadlock
+        s.m.lock();
+}
+
+void ShardedSharedMutex::unlock() {
+    for (auto& s : shards_)
+        s.m.unlock();
+}
+
+void ShardedSharedMutex::lock_shared() {
+    shards_[shardOfThisThread()].m.lock_shared();
+}
+
+void ShardedSharedMutex::unlock_shared() {
+    shards_[shardOfThisThread()].m.unlock_shared();
+}
+
+// ----- ConcurrentDatabase -----
+namespace {
+
+enum class Access { NONE, READ, WRITE, CATALOG };
+
+struct Target {
+    Access access = Access::NONE;
+    const std::string* table = nullptr;
+    const std::string* other = nullptr; // JOIN: read alongside table
+};
+
+// PREPARE / DEALLOCATE touch only the session; EXECUTE latches the statement it runs.
+Target targetOf(const Statement& st) {
+    struct Visitor {
+        Target operator()(const SelectStmt& s) const {
+            return {Access::READ, &s.table, s.join ? &s.join->table : nullptr};
+        }
+        Target operator()(const InsertStmt& s) const {
+            return {Access::WRITE, &s.table};
+        }
+        Target operator()(const UpdateStmt& s) const {
+            return {Access::WRITE, &s.table};
+        }
+        Target operator()(const DeleteStmt& s) const {
+            return {Access::WRITE, &s.table};
+        }
+        Target operator()(const CopyStmt& s) const {
+            return {s.from ? Access::WRITE : Access::READ, &s.table};
+        }
+        Target operator()(const BgSaveStmt& s) const {
+            return {s.status ? Access::NONE : Access::CATALOG, nullptr};
+        }
+        Target operator()(const PrepareStmt&) const {
+            return {};
+        }
+        Target operator()(const ExecuteStmt&) const {
+            return {};
+        }
+        Target operator()(const DeallocateStmt&) const {
+            return {};
+        }
+        Target operator()(const CreateStmt&) const {
+            return {Access::CATALOG, nullptr};
+        }
+        Target operator()(const CreateIndexStmt&) const {
+            return {Access::CATALOG, nullptr};
+        }
+        Target operator()(const DropIndexStmt&) const {
+            return {Access::CATALOG, nullptr};
+        }
+        Target operator()(const SaveStmt&) const {
+            return {Access::CATALOG, nullptr};
+        }
+        Target operator()(const LoadStmt&) const {
+            return {Access::CATALOG, nullptr};
+        }
+    };
+    return std::visit(Visitor{}, st);
+}
+
+} // namespace
+
+// The common path takes the catalog latch shared and finds the table's latch.
+// A table without one yet, or still pending from a snapshot, is set up once
+// under the exclusive catalog latch: filling it mutates the catalog.
+ConcurrentDatabase::Guard ConcurrentDatabase::lock(const Statement& st) {
+    const Target t = targetOf(st);
+    Guard g;
+    if (t.access == Access::NONE)
+        return g;
+    if (t.access == Access::CATALOG) {
+        g.catalogExclusive = std::unique_lock<ShardedSharedMutex>(catalog_);
+        return g;
+    }
+    // a JOIN takes both latches shared, in name order
+    const std::string* names[2] = {t.table, t.other};
+    if (t.other && *t.other < *t.table)
+        std::swap(names[0], names[1]);
+    const int count = (t.other && *t.other != *t.table) ? 2 : 1;
+    for (;;) {
+        g.catalogShared = std::shared_lock<ShardedSharedMutex>(catalog_);
+        std::shared_mutex* found[2] = {nullptr, nullptr};
+        bool setup = false, missing = false;
+        for (int k = 0; k < count; ++k) {
+            if (db_.pending.count(*names[k])) {
+                setup = true;
+                continue;
+            }
+            auto it = latches_.find(*names[k]);
+            if (it != latches_.end())
+                found[k] = it->second.get();
+            else if (db_.tables.count(*names[k]))
+                setup = true;
+            else
+                missing = true; // no such table: the executor reports it
+        }
+        if (!setup) {
+            if (missing)
+                return g;
+            if (t.access == Access::WRITE)
+                g.tableExclusive = std::unique_lock<std::shared_mutex>(*found[0]);
+            else
+                g.tableShared = std::shared_lock<std::shared_mutex>(*found[0]);
+            if (count == 2)
+                g.joinShared = std::shared_lock<std::shared_mutex>(*found[1]);
+            return g;
+        }
+        g.catalogShared.unlock();
+        std::lock_guard<ShardedSharedMutex> lk(catalog_);
+        for (int k = 0; k < count; ++k)
+            if (db_.find(*names[k]))
+                latches_.try_emplace(*names[k], std::make_unique<std::shared_mutex>());
+    }
+}
+
+} // namespace imd
@@ -0,0 +1,392 @@
+﻿#include "imd/csv.hpp"
+#include "imd/filter.hpp"
+#include "imd/mapped_file.hpp"
+#include "imd/renderer.hpp"
+#include "imd/thread_pool.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IMD_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace imd {
+
+// ----- Scanning kernels -----
+static bool isCsvSpecial(char c) {
+    return c == ',' || c == '"' || c == '\n' || c == '\r';
+}
+
+static size_t countByteScalar(const char* p, size_t n, char c) {
+    size_t k = 0;
+    for (size_t i = 0; i < n; ++i)
+        k += (p[i] == c) ? 1 : 0;
+    return k;
+}
+
+static const char* findSpecialScalar(const char* p, const char* end) {
+    while (p < end && !isCsvSpecial(*p))
+        ++p;
+    return p;
+}
+
+#ifdef IMD_X86_SIMD
+__attribute__((target("avx2"))) static size_t countByteAvx2(const char* p, size_t n, char c) {
+    const __m256i needle = _mm256_set1_epi8(c);
+    size_t k = 0, i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        k += __builtin_popcount(static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, needle))));
+    }
+    return k + countByteScalar(p + i, n - i, c);
+}
+
+__attribute__((target("avx2"))) static const char* findSpecialAvx2(const char* p, const char* end) {
+    const __m256i comma = _mm256_set1_epi8(','), quote = _mm256_set1_epi8('"');
+    const __m256i lf = _mm256_set1_epi8('\n'), cr = _mm256_set1_epi8('\r');
+    for (; end - p >= 32; p += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(x, comma), _mm256_cmpeq_epi8(x, quote)),
+                                      _mm256_or_si256(_mm256_cmpeq_epi8(x, lf), _mm256_cmpeq_epi8(x, cr)));
+        unsigned bits = static_cast<unsigned>(_mm256_movemask_epi8(hit));
+        if (bits)
+            return p + __builtin_ctz(bits);
+    }
+    return findSpecialScalar(p, end);
+}
+
+__attribute__((target("sse4.2"))) static size_t countByteSse42(const char* p, size_t n, char c) {
+    const __m128i needle = _mm_set1_epi8(c);
+    size_t k = 0, i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        k += __builtin_popcount(static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, needle))));
+    }
+    return k + countByteScalar(p + i, n - i, c);
+}
+
+__attribute__((target("sse4.2"))) static const char* findSpecialSse42(const char* p, const char* end) {
+    const __m128i comma = _mm_set1_epi8(','), quote = _mm_set1_epi8('"');
+    const __m128i lf = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r');
+    for (; end - p >= 16; p += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, comma), _mm_cmpeq_epi8(x, quote)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(x, lf), _mm_cmpeq_epi8(x, cr)));
+        unsigned bits = static_cast<unsigned>(_mm_movemask_epi8(hit));
+        if (bits)
+            return p + __builtin_ctz(bits);
+    }
+    return findSpecialScalar(p, end);
+}
+#endif
+
+size_t countByte(const char* p, size_t n, char c) {
+#ifdef IMD_X86_SIMD
+    switch (simdLevel()) {
+    case SimdLevel::AVX2:
+        return countByteAvx2(p, n, c);
+    case SimdLevel::SSE42:
+        return countByteSse42(p, n, c);
+    default:
+        break;
+    }
+#endif
+    return countByteScalar(p, n, c);
+}
+
+const char* findCsvSpecial(const char* p, const char* end) {
+#ifdef IMD_X86_SIMD
+    switch (simdLevel()) {
+    case SimdLevel::AVX2:
+        return findSpecialAvx2(p, end);
+    case SimdLevel::SSE42:
+        return findSpecialSse42(p, end);
+    default:
+        break;
+    }
+#endif
+    return findSpecialScalar(p, end);
+}
+
+// ----- Record parsing -----
+// Splits the record at p into fields and advances p past its line break.
+// Fields are views into the file, except quoted ones holding "" escapes,
+// which are unescaped into scratch (pre-sized, so earlier views stay valid).
+static void parseRecord(const char*& p, const char* end, std::vector<std::string_view>& fields,
+                        std::vector<std::string>& scratch) {
+    fields.clear();
+    for (;;) {
+        if (fields.size() == scratch.size())
+            throw std::runtime_error("too many fields (expected " + std::to_string(scratch.size()) + ")");
+        if (p < end && *p == '"') {
+            const char* start = ++p;
+            bool escaped = false;
+            for (;;) {
+                const char* q = static_cast<const char*>(std::memchr(p, '"', static_cast<size_t>(end - p)));
+                if (!q)
+                    throw std::runtime_error("unterminated quoted field");
+                p = q + 1;
+                if (p < end && *p == '"') {
+                    escaped = true;
+                    ++p;
+                    continue;
+                }
+                std::string_view raw(start, static_cast<size_t>(q - start));
+                if (!escaped) {
+                    fields.push_back(raw);
+                    break;
+                }
+                std::string& s = scratch[fields.size()];
+                s.clear();
+                for (size_t i = 0; i < raw.size(); ++i) {
+                    s.push_back(raw[i]);
+                    if (raw[i] == '"')
+                        ++i; // second quote of a "" pair
+                }
+                fields.push_back(s);
+                break;
+            }
+        } else {
+            const char* q = findCsvSpecial(p, end);
+            if (q < end && *q == '"')
+                throw std::runtime_error("quote inside unquoted field");
+            fields.emplace_back(p, static_cast<size_t>(q - p));
+            p = q;
+        }
+        if (p == end)
+            return;
+        if (*p == ',') {
+            ++p;
+            continue;
+        }
+        if (*p == '\r')
+            ++p;
+        if (p == end)
+            return;
+        if (*p == '\n') {
+            ++p;
+            return;
+        }
+        throw std::runtime_error("unexpected character after quoted field");
+    }
+}
+
+static bool skipBlankLine(const char*& p, const char* end) {
+    if (*p == '\n') {
+        ++p;
+        return true;
+    }
+    if (*p == '\r' && p + 1 < end && p[1] == '\n') {
+        p += 2;
+        return true;
+    }
+    return false;
+}
+
+// ----- COPY FROM -----
+namespace {
+
+struct Chunk {
+    size_t begin = 0, end = 0; // byte range of whole records
+    std::vector<Row> rows;
+    size_t records = 0; // parsed before an error, or all of them
+    std::string error;
+};
+
+} // namespace
+
+// Chunks smaller than this are not worth a task.
+constexpr size_t kMinCopyChunk = 1 << 20;
+
+size_t copyFrom(Table& t, const std::string& path, ThreadPool* pool) {
+    MappedFile file(path);
+    const char* base = file.data();
+    const char* fileEnd = base + file.size();
+    const char* p = base;
+    const size_t ncols = t.columns.size();
+
+    // Header: maps field k to column slot[k].
+    std::vector<std::string_view> fields;
+    std::vector<std::string> scratch(ncols);
+    while (p < fileEnd && skipBlankLine(p, fileEnd)) {
+    }
+    if (p == fileEnd)
+        throw std::runtime_error("COPY: '" + path + "' has no header row");
+    try {
+        parseRecord(p, fileEnd, fields, scratch);
+    } catch (const std::runtime_error& e) {
+        throw std::runtime_error("COPY: header of '" + path + "': " + e.what());
+    }
+    std::vector<int> slot;
+    std::vector<uint8_t> seen(ncols, 0);
+    for (auto f : fields) {
+        int j = t.indexOf(std::string(f));
+        if (j < 0)
+            throw std::runtime_error("COPY: unknown column '" + std::string(f) + "' in " + t.name);
+        if (seen[j]++)
+            throw std::runtime_error("COPY: duplicate column '" + std::string(f) + "'");
+        slot.push_back(j);
+    }
+    Row defaults(ncols);
+    for (size_t j = 0; j < ncols; ++j)
+        defaults[j] = t.columns[j].type == ColType::INT ? Value::makeInt(0) : Value::makeStr("");
+
+    // Record boundaries: a chunk starts after the first LF past its nominal
+    // start that is outside quotes. Quote parity at each nominal start comes
+    // from a prefix sum of per-chunk quote counts ("" pairs leave it unchanged).
+    const size_t bodyOff = static_cast<size_t>(p - base);
+    const size_t body = file.size() - bodyOff;
+    size_t parts = std::max<size_t>(1, body / kMinCopyChunk);
+    if (pool)
+        parts = std::min<size_t>(parts, size_t(pool->size()) * 4);
+    else
+        parts = 1;
+    auto run = [&](size_t n, const std::function<void(size_t)>& fn) {
+        if (!pool || n <= 1 || pool->size() == 1) {
+            for (size_t i = 0; i < n; ++i)
+                fn(i);
+            return;
+        }
+        pool->parallelFor(n, fn);
+    };
+    auto nominal = [&](size_t i) { return bodyOff + body * i / parts; };
+
+    std::vector<size_t> quotes(parts);
+    run(parts, [&](size_t i) { quotes[i] = countByte(base + nominal(i), nominal(i + 1) - nominal(i), '"'); });
+    std::vector<Chunk> chunks(parts);
+    run(parts, [&](size_t i) {
+        if (i == 0) {
+            chunks[0].begin = bodyOff;
+            return;
+        }
+        size_t before = 0;
+        for (size_t k = 0; k < i; ++k)
+            before += quotes[k];
+        bool inQuote = before & 1;
+        const char* q = base + nominal(i);
+        for (; q < fileEnd; ++q) {
+            if (*q == '"')
+                inQuote = !inQuote;
+            else if (*q == '\n' && !inQuote)
+                break;
+        }
+        chunks[i].begin = (q < fileEnd) ? static_cast<size_t>(q + 1 - base) : file.size();
+    });
+    for (size_t i = 1; i < parts; ++i)
+        chunks[i].begin = std::max(chunks[i].begin, chunks[i - 1].begin);
+    for (size_t i = 0; i < parts; ++i)
+        chunks[i].end = (i + 1 < parts) ? chunks[i + 1].begin : file.size();
+
+    // Parse and type-check every chunk.
+    run(parts, [&](size_t i) {
+        Chunk& c = chunks[i];
+        const char* r = base + c.begin;
+        const char* end = base + c.end;
+        std::vector<std::string_view> fs;
+        std::vector<std::string> sc(ncols);
+        c.rows.reserve((c.end - c.begin) / 16);
+        try {
+            while (r < end) {
+                if (skipBlankLine(r, end))
+                    continue;
+                parseRecord(r, end, fs, sc);
+                if (fs.size() != slot.size())
+                    throw std::runtime_error("expected " + std::to_string(slot.size()) + " fields, got " +
+                                             std::to_string(fs.size()));
+                Row row = defaults;
+                for (size_t k = 0; k < fs.size(); ++k) {
+                    const int j = slot[k];
+                    if (t.columns[j].type == ColType::STR) {
+                        row[j] = Value::makeStr(fs[k]);
+                        continue;
+                    }
+                    long long v = 0;
+                    auto res = std::from_chars(fs[k].data(), fs[k].data() + fs[k].size(), v);
+                    if (fs[k].empty() || res.ec != std::errc() || res.ptr != fs[k].data() + fs[k].size())
+                        throw std::runtime_error("column " + t.columns[j].name + " expects INT, got '" +
+                                                 std::string(fs[k]) + "'");
+                    row[j] = Value::makeInt(v);
+                }
+                c.rows.push_back(std::move(row));
+                ++c.records;
+            }
+        } catch (const std::runtime_error& e) {
+            c.error = e.what();
+        }
+    });
+
+    size_t total = 0;
+    for (const auto& c : chunks) {
+        if (!c.error.empty())
+            throw std::runtime_error("COPY " + t.name + ": record " + std::to_string(total + c.records + 1) + ": " +
+                                     c.error);
+        total += c.records;
+    }
+    t.reserve(t.rowCount() + total);
+    for (auto& c : chunks) {
+        for (auto& row : c.rows)
+            t.append(std::move(row));
+        std::vector<Row>().swap(c.rows);
+    }
+    return total;
+}
+
+// ----- COPY TO -----
+size_t copyTo(const Table& t, const std::string& path, ThreadPool* pool) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+        throw std::runtime_error("COPY: cannot open '" + path + "' for writing");
+    std::string head;
+    for (size_t j = 0; j < t.columns.size(); ++j) {
+        if (j)
+            head.push_back(',');
+        head += csvEscape(t.columns[j].name);
+    }
+    head.push_back('\n');
+    out.write(head.data(), static_cast<std::streamsize>(head.size()));
+
+    // One window of morsels is formatted in parallel, then written in order.
+    const size_t n = t.rowCount();
+    const size_t window = kMorsel * (pool ? pool->size() : 1);
+    std::vector<std::string> text;
+    for (size_t from = 0; from < n; from += window) {
+        const size_t to = std::min(n, from + window);
+        text.assign((to - from + kMorsel - 1) / kMorsel, std::string());
+        forMorsels(pool, to - from, [&](size_t a, size_t b) {
+            std::string& s = text[a / kMorsel];
+            char num[24];
+            for (size_t r = from + a; r < from + b; ++r) {
+                for (size_t j = 0; j < t.columns.size(); ++j) {
+                    if (j)
+                        s.push_back(',');
+                    if (t.columns[j].type == ColType::INT) {
+                        auto res = std::to_chars(num, num + sizeof(num), t.intAt(r, static_cast<int>(j)));
+                        s.append(num, res.ptr);
+                    } else {
+                        std::string_view v = t.strAt(r, static_cast<int>(j));
+                        if (v.find_first_of(",\"\n\r") == std::string_view::npos)
+                            s.append(v);
+                        else
+                            s += csvEscape(v);
+                    }
+                }
+                s.push_back('\n');
+            }
+        });
+        for (const auto& s : text)
+            out.write(s.data(), static_cast<std::streamsize>(s.size()));
+    }
+    out.flush();
+    if (!out)
+        throw std::runtime_error("COPY: write to '" + path + "' failed");
+    return n;
+}
+
+} // namespace imd
@@ -1,202 +1,554 @@
 ﻿#include "imd/executor.hpp"
+#include "imd/aggregate.hpp"
+#include "imd/bgsave.hpp"
+#include "imd/binder.hpp"
+#include "imd/concurrent.hpp"
+#include "imd/csv.hpp"
 #include "imd/renderer.hpp"
+#include "imd/filter.hpp"
+#include "imd/join.hpp"
+#include "imd/lexer.hpp"
+#include "imd/order.hpp"
+#include "imd/parser.hpp"
+#include "imd/snapshot.hpp"
+#include "imd/wal.hpp"
 #include <stdexcept>
 #include <algorithm>
+#include <cstdio>
+#include <filesystem>
 #include <iostream>
+#include <type_traits>
 
 namespace imd {
 
-Value Executor::defaultFor(ColType t) {
-    if (t == ColType::INT)
-        return Value::makeInt(0);
-    return Value::makeStr("");
+Executor::Executor(ConcurrentDatabase& db) : Executor(db.data()) {
+    shared_ = &db;
 }
 
-void Executor::ensureTableExists(const Database& db, const std::string& name) {
-    if (!db.tables.count(name))
-        throw std::runtime_error("No such table: " + name);
+// ----- WAL -----
+// Records are appended after a statement binds (so rejected statements are not
+// logged) and committed once it has been applied.
+template <class S> static uint64_t walAppend(Wal* wal, const S& s) {
+    if (!wal)
+        return 0;
+    std::string rec;
+    encodeStatement(s, rec);
+    return wal->append(rec);
 }
 
-static void typeCheckAssign(const Column& col, const Value& v) {
-    if (col.type == ColType::INT && !v.isInt())
-        throw std::runtime_error("Type error: expected int for column '" + col.name + "'");
-    if (col.type == ColType::STR && !v.isStr())
-        throw std::runtime_error("Type error: expected str for column '" + col.name + "'");
+void Executor::commit(uint64_t lsn) {
+    if (lsn && syncEach_ && deferSync_ == 0)
+        wal_->waitDurable(lsn);
 }
 
-static bool equalValues(const Value& a, const Value& b) {
-    if (a.data.index() != b.data.index())
-        return false;
-    if (a.isInt())
-        return a.asInt() == b.asInt();
-    return a.asStr() == b.asStr();
+void Executor::sync() {
+    if (wal_)
+        wal_->sync();
 }
 
-// Tri-state comparator for Value (clean, no warnings)
-static int compareValues(const Value& a, const Value& b) {
-    if (a.isInt() && b.isInt()) {
-        long long x = a.asInt();
-        long long y = b.asInt();
-        if (x < y)
-            return -1;
-        if (x > y)
-            return 1;
-        return 0;
-    }
-    if (a.isStr() && b.isStr()) {
-        const std::string& x = a.asStr();
-        const std::string& y = b.asStr();
-        if (x < y)
-            return -1;
-        if (x > y)
-            return 1;
-        return 0;
+size_t Executor::recover(Wal& wal) {
+    Wal* saved = wal_;
+    wal_ = nullptr;
+    size_t n = 0;
+    // Streamed INSERT batches by table, applied once the LAST piece is read. A
+    // group cut off by a crash stays here: a later FIRST on its table replaces
+    // it, and whatever is left at the end of the log is dropped.
+    using Part = InsertStmt::Part;
+    std::unordered_map<std::string, std::vector<InsertStmt>> parts;
+    try {
+        n = wal.replay([&](std::string_view rec) {
+            Statement st = decodeStatement(rec);
+            auto* ins = std::get_if<InsertStmt>(&st);
+            if (!ins || ins->part == Part::WHOLE) {
+                execute(std::move(st));
+                return;
+            }
+            const std::string table = ins->table;
+            auto& group = parts[table];
+            if (ins->part == Part::FIRST)
+                group.clear();
+            else if (group.empty())
+                return; // the rest of a group whose FIRST was replaced
+            group.push_back(std::move(*ins));
+            if (group.back().part != Part::LAST)
+                return;
+            for (auto& piece : group)
+                execute(Statement(std::move(piece)));
+            parts.erase(table);
+        });
+    } catch (const std::exception& e) {
+        wal_ = saved;
+        throw std::runtime_error("WAL replay of " + wal.path() + " failed: " + e.what());
     }
-    throw std::runtime_error("Type mismatch in comparison");
+    wal_ = saved;
+    return n;
 }
 
-bool Executor::rowMatches(const Table& t, const Row& r, const Condition& c) {
-    int j = t.indexOf(c.column);
-    if (j < 0)
-        throw std::runtime_error("Unknown column in WHERE: " + c.column);
-    const Value& cell = r[j];
-
-    switch (c.op) {
-    case CmpOp::EQ:
-        return equalValues(cell, c.literal);
-    case CmpOp::NE:
-        return !equalValues(cell, c.literal);
-    case CmpOp::LT:
-        return compareValues(cell, c.literal) < 0;
-    case CmpOp::LE:
-        return compareValues(cell, c.literal) <= 0;
-    case CmpOp::GT:
-        return compareValues(cell, c.literal) > 0;
-    case CmpOp::GE:
-        return compareValues(cell, c.literal) >= 0;
-    }
-    return false;
+void Executor::exec(const CreateStmt& s) {
+    BoundCreate b = Binder(db_).bind(s);
+    const uint64_t lsn = walAppend(wal_, s);
+    std::string name = b.table.name;
+    db_.tables.emplace(std::move(name), std::move(b.table));
+    ++db_.epoch;
+    commit(lsn);
 }
 
-void Executor::exec(const CreateStmt& s) {
-    if (db_.tables.count(s.table))
-        throw std::runtime_error("Table already exists: " + s.table);
-    Table t;
-    t.name = s.table;
-    for (size_t i = 0; i < s.columns.size(); ++i) {
-        t.columns.push_back({s.columns[i].first, s.columns[i].second});
-        t.colIndex[t.columns.back().name] = static_cast<int>(i);
-    }
-    db_.tables.emplace(t.name, std::move(t));
+// Grows t ahead of a bulk append; at least 1.5x at a time so repeated batches stay amortized.
+static void reserveAhead(Table& t, size_t extra) {
+    const size_t need = t.rowCount() + extra;
+    if (need > t.capacity())
+        t.reserve(std::max(need, t.capacity() + t.capacity() / 2));
 }
 
 void Executor::exec(const InsertStmt& s) {
-    ensureTableExists(db_, s.table);
-    Table& t = db_.tables[s.table];
-
-    std::vector<int> pos;
-    pos.reserve(s.cols.size());
-    for (const auto& cn : s.cols) {
-        int j = t.indexOf(cn);
-        if (j < 0)
-            throw std::runtime_error("Unknown column: " + cn);
-        pos.push_back(j);
-    }
-
-    for (const auto& values : s.rows) {
-        if (values.size() != pos.size())
-            throw std::runtime_error("VALUES count does not match column list");
-
-        Row r;
-        r.reserve(t.columns.size());
-        for (const auto& col : t.columns)
-            r.push_back(defaultFor(col.type));
-
-        for (size_t k = 0; k < pos.size(); ++k) {
-            int j = pos[k];
-            const Column& col = t.columns[j];
-            const Value& v = values[k];
-            typeCheckAssign(col, v);
-            r[j] = v;
+    exec(Binder(db_).bind(s), s);
+}
+
+void Executor::exec(const BoundInsert& b, const InsertStmt& s) {
+    const uint64_t lsn = walAppend(wal_, s);
+    Table& t = *b.table;
+    reserveAhead(t, std::max(s.rows.size(), s.rowsHint));
+    for (const auto& values : *b.rows) {
+        Row r = b.defaults;
+        for (size_t k = 0; k < b.pos.size(); ++k)
+            r[b.pos[k]] = values[k];
+        t.append(std::move(r));
+    }
+    commit(lsn);
+}
+
+void Executor::exec(InsertStmt&& s) {
+    const BoundInsert b = Binder(db_).bind(s);
+    const uint64_t lsn = walAppend(wal_, s); // before the values are moved out
+    Table& t = *b.table;
+    reserveAhead(t, std::max(s.rows.size(), s.rowsHint));
+    bool inOrder = b.pos.size() == t.columns.size();
+    for (size_t k = 0; k < b.pos.size() && inOrder; ++k)
+        inOrder = b.pos[k] == static_cast<int>(k);
+    for (auto& values : s.rows) {
+        if (inOrder) { // the tuple already is the row
+            t.append(std::move(values));
+            continue;
         }
-        t.rows.push_back(std::move(r));
+        Row r = b.defaults;
+        for (size_t k = 0; k < b.pos.size(); ++k)
+            r[b.pos[k]] = std::move(values[k]);
+        t.append(std::move(r));
     }
+    s.rows.clear();
+    commit(s.part == InsertStmt::Part::FIRST || s.part == InsertStmt::Part::MIDDLE ? 0 : lsn); // LAST covers them
 }
 
 void Executor::exec(const DeleteStmt& s) {
-    ensureTableExists(db_, s.table);
-    Table& t = db_.tables[s.table];
-    if (!s.where) {
-        t.rows.clear();
-        return;
+    exec(Binder(db_).bind(s), s);
+}
+
+void Executor::exec(const BoundDelete& b, const DeleteStmt& s) {
+    const uint64_t lsn = walAppend(wal_, s);
+    Table& t = *b.table;
+    if (!b.where) {
+        t.clear();
+    } else {
+        std::vector<size_t> hits;
+        filterRows(t, *b.where, hits, pool_);
+        if (!hits.empty()) {
+            std::vector<uint8_t> keep(t.rowCount(), 1);
+            for (size_t i : hits)
+                keep[i] = 0;
+            t.compact(keep, pool_);
+        }
     }
-    const Condition& c = *s.where;
-    t.rows.erase(std::remove_if(t.rows.begin(), t.rows.end(), [&](const Row& r) { return rowMatches(t, r, c); }),
-                 t.rows.end());
+    commit(lsn);
 }
 
 void Executor::exec(const UpdateStmt& s) {
-    ensureTableExists(db_, s.table);
-    Table& t = db_.tables[s.table];
+    exec(Binder(db_).bind(s), s);
+}
+
+void Executor::exec(const BoundUpdate& b, const UpdateStmt& s) {
+    const uint64_t lsn = walAppend(wal_, s);
+    Table& t = *b.table;
 
-    std::vector<int> idx;
-    idx.reserve(s.assignments.size());
-    for (const auto& [cn, v] : s.assignments) {
-        int j = t.indexOf(cn);
-        if (j < 0)
-            throw std::runtime_error("Unknown column in SET: " + cn);
-        typeCheckAssign(t.columns[j], v);
-        idx.push_back(j);
+    // Rows are independent unless a write touches shared structures: an index
+    // on an assigned column, or the string storage of a STR column (the heap of
+    // a columnar column, the arena of a ROW table).
+    bool parallel = true;
+    for (const auto& [j, v] : b.sets) {
+        for (const auto& ix : t.indexes)
+            parallel = parallel && ix->column() != j;
+        parallel = parallel && t.columns[j].type != ColType::STR;
     }
+    ThreadPool* pool = parallel ? pool_ : nullptr;
 
-    for (auto& r : t.rows) {
-        if (s.where && !rowMatches(t, r, *s.where))
-            continue;
-        for (size_t k = 0; k < idx.size(); ++k) {
-            r[idx[k]] = s.assignments[k].second;
-        }
+    auto apply = [&](size_t i) {
+        for (const auto& [j, v] : b.sets)
+            t.set(i, j, *v);
+    };
+    if (!b.where) {
+        forMorsels(pool, t.rowCount(), [&](size_t from, size_t to) {
+            for (size_t i = from; i < to; ++i)
+                apply(i);
+        });
+    } else {
+        std::vector<size_t> hits;
+        filterRows(t, *b.where, hits, pool_);
+        forMorsels(pool, hits.size(), [&](size_t from, size_t to) {
+            for (size_t k = from; k < to; ++k)
+                apply(hits[k]);
+        });
     }
+    commit(lsn);
 }
 
 void Executor::exec(const SelectStmt& s) {
-    ensureTableExists(db_, s.table);
-    const Table& t = db_.tables[s.table];
-
-    std::vector<int> proj;
-    std::vector<std::string> headers;
-    if (s.selectAll) {
-        proj.reserve(t.columns.size());
-        for (size_t j = 0; j < t.columns.size(); ++j) {
-            proj.push_back((int)j);
-            headers.push_back(t.columns[j].name);
-        }
+    if (s.join)
+        return execJoin(s);
+    exec(Binder(db_).bind(s));
+}
+
+void Executor::exec(const BoundSelect& b) {
+    const Table& t = *b.table;
+    auto sink = makeSink(format_, *out_);
+    const BoundExpr* where = b.where ? &*b.where : nullptr;
+    const size_t keep = b.limit > SIZE_MAX - b.offset ? SIZE_MAX : b.offset + b.limit; // rows before OFFSET applies
+
+    std::vector<ColType> types;
+    if (!b.aggs.empty()) {
+        std::vector<std::vector<Value>> rows;
+        std::vector<uint8_t> nulls; // of the ungrouped row
+        aggregate(b, pool_, rows, types, nulls);
+        if (b.desc) // groups come out in key order, which is the only order allowed
+            std::reverse(rows.begin(), rows.end());
+        sink->begin(b.headers, types);
+        for (size_t k = b.offset; k < rows.size() && k < keep; ++k)
+            sink->row(rows[k], nulls.empty() ? nullptr : &nulls);
+        sink->end();
+        return;
+    }
+    for (int j : b.proj)
+        types.push_back(t.columns[j].type);
+    sink->begin(b.headers, types);
+
+    // each slice of matches is projected in parallel, then streamed out in order
+    std::vector<std::vector<Value>> lines;
+    auto emit = [&](const size_t* rows, size_t n) {
+        lines.resize(n);
+        forMorsels(pool_, n, [&](size_t from, size_t to) {
+            for (size_t k = from; k < to; ++k) {
+                auto& line = lines[k];
+                line.clear();
+                for (int j : b.proj)
+                    line.push_back(t.peek(rows[k], j));
+            }
+        });
+        for (size_t k = 0; k < n; ++k)
+            sink->row(lines[k]);
+    };
+    if (b.orderCol >= 0) {
+        const std::vector<size_t> rows = orderRows(t, where, b.orderCol, b.desc, keep, pool_);
+        const size_t slice = kMorsel * (pool_ ? pool_->size() : 1);
+        for (size_t at = std::min(b.offset, rows.size()); at < rows.size(); at += slice)
+            emit(rows.data() + at, std::min(slice, rows.size() - at));
     } else {
-        proj.reserve(s.cols.size());
-        for (const auto& cn : s.cols) {
-            int j = t.indexOf(cn);
-            if (j < 0)
-                throw std::runtime_error("Unknown column: " + cn);
-            proj.push_back(j);
-            headers.push_back(t.columns[j].name);
+        size_t skip = b.offset;
+        scanRows(
+            t, where, pool_,
+            [&](const std::vector<size_t>& hits) {
+                const size_t k = std::min(skip, hits.size());
+                skip -= k;
+                emit(hits.data() + k, hits.size() - k);
+            },
+            keep);
+    }
+    sink->end();
+}
+
+void Executor::execJoin(const SelectStmt& s) {
+    const BoundJoin b = Binder(db_).bindJoin(s);
+    auto sink = makeSink(format_, *out_);
+    std::vector<ColType> types;
+    for (const auto& [k, j] : b.proj)
+        types.push_back(b.side[k]->columns[j].type);
+    sink->begin(b.headers, types);
+
+    const size_t keep = b.limit > SIZE_MAX - b.offset ? SIZE_MAX : b.offset + b.limit;
+    size_t skip = b.offset;
+    std::vector<std::vector<Value>> lines;
+    hashJoin(
+        b, pool_,
+        [&](const JoinPairs& pairs) {
+            const size_t first = std::min(skip, pairs.size());
+            skip -= first;
+            lines.resize(pairs.size() - first);
+            forMorsels(pool_, lines.size(), [&](size_t from, size_t to) {
+                for (size_t k = from; k < to; ++k) {
+                    const auto& [r0, r1] = pairs[first + k];
+                    auto& line = lines[k];
+                    line.clear();
+                    for (const auto& [side, j] : b.proj)
+                        line.push_back(b.side[side]->peek(side == 0 ? r0 : r1, j));
+                }
+            });
+            for (const auto& line : lines)
+                sink->row(line);
+        },
+        keep);
+    sink->end();
+}
+
+void Executor::exec(const CreateIndexStmt& s) {
+    db_.loadAll(); // index names of snapshot tables are known once they are filled
+    for (const auto& [name, tbl] : db_.tables)
+        for (const auto& ix : tbl.indexes)
+            if (ix->name() == s.name)
+                throw std::runtime_error("Index already exists: " + s.name);
+    Table& t = Binder(db_).table(s.table);
+    int j = t.indexOf(s.column);
+    if (j < 0)
+        throw std::runtime_error("Unknown column: " + s.column);
+    const uint64_t lsn = walAppend(wal_, s);
+    if (s.kind == IndexKind::BTREE)
+        t.addIndex(std::make_unique<BTreeIndex>(s.name, j, t.columns[j].type));
+    else
+        t.addIndex(std::make_unique<HashIndex>(s.name, j, t.columns[j].type));
+    commit(lsn);
+}
+
+void Executor::exec(const DropIndexStmt& s) {
+    db_.loadAll();
+    for (auto& [name, tbl] : db_.tables) {
+        auto& v = tbl.indexes;
+        auto it = std::find_if(v.begin(), v.end(), [&](const auto& ix) { return ix->name() == s.name; });
+        if (it != v.end()) {
+            const uint64_t lsn = walAppend(wal_, s);
+            v.erase(it);
+            commit(lsn);
+            return;
         }
     }
+    throw std::runtime_error("No such index: " + s.name);
+}
 
-    std::vector<std::vector<std::string>> outRows;
-    for (const auto& r : t.rows) {
-        if (s.where && !rowMatches(t, r, *s.where))
-            continue;
-        std::vector<std::string> line;
-        line.reserve(proj.size());
-        for (int j : proj)
-            line.push_back(r[j].toString());
-        outRows.push_back(std::move(line));
+void Executor::exec(const PrepareStmt& s) {
+    if (prepared_.count(s.name))
+        throw std::runtime_error("Prepared statement already exists: " + s.name);
+    prepared_.emplace(s.name, std::make_unique<PreparedStmt>(*s.body));
+}
+
+void Executor::exec(const ExecuteStmt& s) {
+    executePrepared(s.name, s.args);
+}
+
+void Executor::exec(const DeallocateStmt& s) {
+    deallocate(s.name);
+}
+
+void Executor::exec(const CopyStmt& s) {
+    Table& t = Binder(db_).table(s.table);
+    if (!s.from) {
+        copyTo(t, s.path, pool_);
+        return;
+    }
+    const size_t before = t.rowCount();
+    copyFrom(t, s.path, pool_);
+    if (wal_ && t.rowCount() > before) { // logged as the rows it loaded, so replay does not need the file
+        using Part = InsertStmt::Part;
+        std::string rec;
+        uint64_t lsn = 0;
+        for (size_t from = before; from < t.rowCount(); from += kAppendRows) {
+            const size_t to = std::min(t.rowCount(), from + kAppendRows);
+            const bool first = from == before, last = to == t.rowCount();
+            rec.clear(); // recovery drops a load whose LAST record never reached the log
+            encodeAppend(t, from, to, first && last ? Part::WHOLE : first ? Part::FIRST : last ? Part::LAST : Part::MIDDLE,
+                         rec);
+            lsn = wal_->append(rec);
+        }
+        commit(lsn);
     }
+}
+
+// With a WAL, SAVE is a checkpoint: the log restarts from a LOAD of the new
+// snapshot, so recovery replays only what came after it.
+void Executor::exec(const SaveStmt& s) {
+    saveSnapshot(db_, s.path);
+    if (wal_) {
+        std::string rec;
+        encodeStatement(LoadStmt{std::filesystem::absolute(s.path).string()}, rec);
+        wal_->restart(rec); // replay resolves the path as it is now, whatever the working directory
+    }
+}
 
-    printAscii(headers, outRows, std::cout);
+void Executor::exec(const LoadStmt& s) {
+    loadSnapshot(db_, s.path);
+    if (wal_) {
+        std::string rec;
+        encodeStatement(LoadStmt{std::filesystem::absolute(s.path).string()}, rec);
+        commit(wal_->append(rec));
+    }
+}
+
+// BGSAVE STATUS prints one row: state, file, progress and the fork() pause.
+void Executor::exec(const BgSaveStmt& s) {
+    BackgroundSave& bg = backgroundSave(db_);
+    if (!s.status) {
+        bg.start(db_, s.path);
+        return;
+    }
+    const BackgroundSave::Status st = bg.status();
+    uint64_t pct = st.state == BackgroundSave::State::DONE ? 100 : 0;
+    if (st.cellsTotal)
+        pct = st.cellsDone * 100 / st.cellsTotal;
+    char secs[32];
+    std::snprintf(secs, sizeof(secs), "%.3f", st.seconds);
+    auto sink = makeSink(format_, *out_);
+    sink->begin({"state", "file", "percent", "cells", "fork_us", "seconds", "error"},
+                {ColType::STR, ColType::STR, ColType::INT, ColType::INT, ColType::INT, ColType::STR, ColType::STR});
+    sink->row({Value::makeStr(stateName(st.state)), Value::makeStr(st.path), Value::makeInt(static_cast<long long>(pct)),
+               Value::makeInt(static_cast<long long>(st.cellsDone)), Value::makeInt(static_cast<long long>(st.forkMicros)),
+               Value::makeStr(secs), Value::makeStr(st.error)});
+    sink->end();
+}
+
+void Executor::prepare(const std::string& name, const std::string& sql) {
+    Parser p(sql);
+    exec(PrepareStmt{name, std::make_shared<PreparedBody>(p.parseTemplate())});
+}
+
+void Executor::executePrepared(const std::string& name, std::vector<Value> args) {
+    auto it = prepared_.find(name);
+    if (it == prepared_.end())
+        throw std::runtime_error("No such prepared statement: " + name);
+    execute(*it->second, std::move(args));
+}
+
+// The plan bound on an earlier run is reused while the catalog is unchanged;
+// only what depends on the new literals is redone.
+template <class B, class S> void Executor::execPlan(PreparedStmt& p, const S& s) {
+    B* b = std::get_if<B>(&p.plan);
+    if (b && p.epoch == db_.epoch) {
+        Binder(db_).rebind(*b, s);
+    } else {
+        p.plan = Binder(db_).bind(s);
+        p.epoch = db_.epoch;
+        b = &std::get<B>(p.plan);
+    }
+    if constexpr (std::is_same_v<B, BoundSelect>)
+        exec(*b);
+    else
+        exec(*b, s);
+}
+
+void Executor::execute(PreparedStmt& p, std::vector<Value>&& args) {
+    const Statement& st = p.bind(std::move(args));
+    const auto latch = shared_ ? shared_->lock(st) : ConcurrentDatabase::Guard{};
+    if (const auto* s = std::get_if<InsertStmt>(&st))
+        execPlan<BoundInsert>(p, *s);
+    else if (const auto* s = std::get_if<DeleteStmt>(&st))
+        execPlan<BoundDelete>(p, *s);
+    else if (const auto* s = std::get_if<UpdateStmt>(&st))
+        execPlan<BoundUpdate>(p, *s);
+    else if (const auto* s = std::get_if<SelectStmt>(&st); s && !s->join)
+        execPlan<BoundSelect>(p, *s);
+    else
+        std::visit([&](auto&& x) { exec(x); }, st);
+}
+
+void Executor::deallocate(const std::string& name) {
+    if (!prepared_.erase(name))
+        throw std::runtime_error("No such prepared statement: " + name);
 }
 
 void Executor::execute(const Statement& st) {
+    streamLatch_.reset(); // a streamed INSERT whose end never came lets go
+    const auto latch = shared_ ? shared_->lock(st) : ConcurrentDatabase::Guard{};
     std::visit([&](auto&& s) { exec(s); }, st);
 }
 
+void Executor::execute(Statement&& st) {
+    auto* ins = std::get_if<InsertStmt>(&st);
+    if (!ins) {
+        execute(static_cast<const Statement&>(st));
+        return;
+    }
+    if (shared_ && !streamLatch_)
+        streamLatch_ = shared_->lock(st);
+    const bool last = ins->part == InsertStmt::Part::WHOLE || ins->part == InsertStmt::Part::LAST;
+    try {
+        exec(std::move(*ins));
+    } catch (...) {
+        streamLatch_.reset();
+        throw;
+    }
+    if (last)
+        streamLatch_.reset();
+}
+
+// ----- Plan cache -----
+// Statements longer than this (bulk INSERTs) are parsed directly instead of
+// being cached under a key as long as the statement itself.
+static constexpr size_t kMaxCachedTokens = 256;
+
+static bool cacheableKeyword(const Token& t) {
+    return t.type == TokType::Ident &&
+           (t.text == "INSERT" || t.text == "DELETE" || t.text == "UPDATE" || t.text == "SELECT");
+}
+
+void Executor::run(std::string_view sql) {
+    ++deferSync_; // statements of one call share a single durability wait
+    try {
+        runStatements(sql);
+    } catch (...) {
+        if (--deferSync_ == 0 && wal_ && syncEach_)
+            wal_->sync(); // what ran before the error stays committed
+        throw;
+    }
+    if (--deferSync_ == 0 && wal_ && syncEach_)
+        wal_->sync();
+}
+
+void Executor::runStatements(std::string_view sql) {
+    Lexer lx(sql);
+    Token tok = lx.next();
+    while (tok.type != TokType::End) {
+        const size_t begin = tok.pos;
+        bool cacheable = cacheableKeyword(tok);
+        std::string key;
+        std::vector<Value> args;
+        std::vector<Token> toks; // literals as '?': what a miss parses, without lexing again
+        for (; cacheable && tok.type != TokType::End && tok.type != TokType::Semicolon; tok = lx.next()) {
+            if (tok.type == TokType::Number || tok.type == TokType::String) {
+                args.push_back(tok.type == TokType::Number ? Value::makeInt(parseInt(tok.text))
+                                                           : Value::makeStr(tok.text));
+                tok.type = TokType::Question;
+                tok.text = "?";
+            } else if (tok.type == TokType::Question) {
+                cacheable = false; // let the parser report it
+                break;
+            }
+            key += tok.text;
+            key += ' ';
+            toks.push_back(tok);
+            cacheable = toks.size() <= kMaxCachedTokens;
+        }
+        if (!cacheable || tok.type == TokType::End) {
+            // uncached, or missing ';': the parser handles it (and reports errors) as before
+            const size_t end = statementEnd(sql, begin);
+            Parser p(sql.substr(begin, end - begin));
+            p.setInsertSink([this](InsertStmt&& batch) { execute(Statement(std::move(batch))); });
+            for (Statement st; p.next(st);)
+                execute(std::move(st));
+            lx.skipTo(end);
+            tok = lx.next();
+            continue;
+        }
+        PreparedStmt* plan = cache_.find(key);
+        if (!plan) {
+            Parser p(std::move(toks));
+            plan = &cache_.insert(key, std::make_unique<PreparedStmt>(p.parseTemplate()));
+        }
+        execute(*plan, std::move(args));
+        tok = lx.next(); // past the ';'
+    }
+}
+
 } // namespace imd
@@ -0,0 +1,595 @@
+﻿#include "imd/filter.hpp"
+#include "imd/thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IMD_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace imd {
+
+// ----- Dispatch -----
+SimdLevel detectSimd() {
+#ifdef IMD_X86_SIMD
+    static const SimdLevel lv = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return SimdLevel::AVX2;
+        if (__builtin_cpu_supports("sse4.2"))
+            return SimdLevel::SSE42;
+        return SimdLevel::SCALAR;
+    }();
+    return lv;
+#else
+    return SimdLevel::SCALAR; // no intrinsics on this compiler/target
+#endif
+}
+
+static std::atomic<int>& levelSlot() {
+    static std::atomic<int> lv{static_cast<int>(detectSimd())};
+    return lv;
+}
+
+SimdLevel simdLevel() {
+    return static_cast<SimdLevel>(levelSlot().load(std::memory_order_relaxed));
+}
+
+void setSimdLevel(SimdLevel lv) {
+    if (static_cast<int>(lv) > static_cast<int>(detectSimd()))
+        lv = detectSimd();
+    levelSlot().store(static_cast<int>(lv), std::memory_order_relaxed);
+}
+
+// ----- Integer kernels -----
+// Every kernel evaluates a "base" predicate and optionally inverts it:
+// EQ/NE -> (v == lit), LT/GE -> (lit > v), GT/LE -> (v > lit).
+enum class Base { EQ, LIT_GT, V_GT };
+
+static Base baseOf(CmpOp op, bool& invert) {
+    invert = (op == CmpOp::NE || op == CmpOp::GE || op == CmpOp::LE);
+    if (op == CmpOp::EQ || op == CmpOp::NE)
+        return Base::EQ;
+    if (op == CmpOp::LT || op == CmpOp::GE)
+        return Base::LIT_GT;
+    return Base::V_GT;
+}
+
+static void cmpIntScalar(const long long* vals, size_t n, Base b, bool invert, long long lit, uint64_t* mask) {
+    for (size_t w = 0; w * 64 < n; ++w) {
+        const size_t end = (n - w * 64 < 64) ? n - w * 64 : 64;
+        const long long* v = vals + w * 64;
+        uint64_t bits = 0;
+        for (size_t i = 0; i < end; ++i) {
+            bool hit = (b == Base::EQ) ? v[i] == lit : (b == Base::LIT_GT) ? lit > v[i] : v[i] > lit;
+            bits |= static_cast<uint64_t>(hit != invert) << i;
+        }
+        mask[w] = bits;
+    }
+}
+
+#ifdef IMD_X86_SIMD
+__attribute__((target("avx2"))) static void cmpIntAvx2(const long long* vals, size_t n, Base b, bool invert,
+                                                       long long lit, uint64_t* mask) {
+    const __m256i l = _mm256_set1_epi64x(lit);
+    const size_t full = n / 64;
+    for (size_t w = 0; w < full; ++w) {
+        const long long* v = vals + w * 64;
+        uint64_t bits = 0;
+        for (int k = 0; k < 16; ++k) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + k * 4));
+            __m256i m = (b == Base::EQ)       ? _mm256_cmpeq_epi64(x, l)
+                        : (b == Base::LIT_GT) ? _mm256_cmpgt_epi64(l, x)
+                                              : _mm256_cmpgt_epi64(x, l);
+            bits |= static_cast<uint64_t>(_mm256_movemask_pd(_mm256_castsi256_pd(m))) << (k * 4);
+        }
+        mask[w] = invert ? ~bits : bits;
+    }
+    if (full * 64 < n)
+        cmpIntScalar(vals + full * 64, n - full * 64, b, invert, lit, mask + full);
+}
+
+__attribute__((target("sse4.2"))) static void cmpIntSse42(const long long* vals, size_t n, Base b, bool invert,
+                                                          long long lit, uint64_t* mask) {
+    const __m128i l = _mm_set1_epi64x(lit);
+    const size_t full = n / 64;
+    for (size_t w = 0; w < full; ++w) {
+        const long long* v = vals + w * 64;
+        uint64_t bits = 0;
+        for (int k = 0; k < 32; ++k) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + k * 2));
+            __m128i m = (b == Base::EQ)       ? _mm_cmpeq_epi64(x, l)
+                        : (b == Base::LIT_GT) ? _mm_cmpgt_epi64(l, x)
+                                              : _mm_cmpgt_epi64(x, l);
+            bits |= static_cast<uint64_t>(_mm_movemask_pd(_mm_castsi128_pd(m))) << (k * 2);
+        }
+        mask[w] = invert ? ~bits : bits;
+    }
+    if (full * 64 < n)
+        cmpIntScalar(vals + full * 64, n - full * 64, b, invert, lit, mask + full);
+}
+#endif
+
+void cmpInt(const long long* vals, size_t n, CmpOp op, long long lit, uint64_t* mask) {
+    bool invert;
+    Base b = baseOf(op, invert);
+#ifdef IMD_X86_SIMD
+    switch (simdLevel()) {
+    case SimdLevel::AVX2:
+        return cmpIntAvx2(vals, n, b, invert, lit, mask);
+    case SimdLevel::SSE42:
+        return cmpIntSse42(vals, n, b, invert, lit, mask);
+    default:
+        break;
+    }
+#endif
+    cmpIntScalar(vals, n, b, invert, lit, mask);
+}
+
+// ----- String kernels -----
+static uint64_t prefix8(const char* p, size_t len) {
+    uint64_t x = 0;
+    std::memcpy(&x, p, len < 8 ? len : 8);
+    return x;
+}
+
+void eqStr(const std::string_view* vals, size_t n, std::string_view lit, uint64_t* mask) {
+    const size_t len = lit.size();
+    const uint64_t head = prefix8(lit.data(), len);
+    for (size_t w = 0; w * 64 < n; ++w) {
+        const size_t end = (n - w * 64 < 64) ? n - w * 64 : 64;
+        const std::string_view* v = vals + w * 64;
+        uint64_t bits = 0;
+        for (size_t i = 0; i < end; ++i) {
+            if (v[i].size() != len || prefix8(v[i].data(), len) != head)
+                continue;
+            if (len <= 8 || std::memcmp(v[i].data() + 8, lit.data() + 8, len - 8) == 0)
+                bits |= uint64_t{1} << i;
+        }
+        mask[w] = bits;
+    }
+}
+
+// ----- Table filtering -----
+static constexpr size_t kBatch = 1024;  // rows per kernel call (16 mask words)
+static constexpr size_t kChunk = 16384; // rows per expression pass between re-orderings
+
+static int lowestBit(uint64_t x) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(x);
+#else
+    int i = 0;
+    while (!(x & 1)) {
+        x >>= 1;
+        ++i;
+    }
+    return i;
+#endif
+}
+
+namespace {
+
+// Candidate rows: list[0, n) when list is set, otherwise the range [from, from + n).
+struct RowSpan {
+    const size_t* list;
+    size_t from;
+    size_t n;
+
+    size_t at(size_t i) const {
+        return list ? list[i] : from + i;
+    }
+};
+
+} // namespace
+
+static void emitBits(const uint64_t* mask, size_t n, size_t base, RowSpan in, std::vector<size_t>& out) {
+    for (size_t w = 0; w * 64 < n; ++w) {
+        uint64_t bits = mask[w];
+        if (n - w * 64 < 64)
+            bits &= (uint64_t{1} << (n - w * 64)) - 1;
+        while (bits) {
+            out.push_back(in.at(base + w * 64 + static_cast<size_t>(lowestBit(bits))));
+            bits &= bits - 1;
+        }
+    }
+}
+
+static bool holds(CmpOp op, const Value& v, const Value& lit) {
+    switch (op) {
+    case CmpOp::EQ:
+        return equalValues(v, lit);
+    case CmpOp::NE:
+        return !equalValues(v, lit);
+    case CmpOp::LT:
+        return compareValues(v, lit) < 0;
+    case CmpOp::LE:
+        return compareValues(v, lit) <= 0;
+    case CmpOp::GT:
+        return compareValues(v, lit) > 0;
+    default: // GE
+        return compareValues(v, lit) >= 0;
+    }
+}
+
+static void filterSpan(const Table& t, const BoundCmp& c, RowSpan in, std::vector<size_t>& out) {
+    const size_t n = in.n;
+    if (n == 0 || c.fold == BoundCmp::Fold::NEVER)
+        return;
+    if (c.fold == BoundCmp::Fold::ALWAYS) {
+        for (size_t i = 0; i < n; ++i)
+            out.push_back(in.at(i));
+        return;
+    }
+
+    const int j = c.col;
+    uint64_t mask[kBatch / 64];
+    if (c.type == ColType::INT) {
+        const long long lit = c.ival;
+        const long long* direct = (t.layout == Layout::COLUMNAR) ? t.cols[j].ints.data() : nullptr;
+        long long buf[kBatch];
+        for (size_t base = 0; base < n; base += kBatch) {
+            const size_t m = (n - base < kBatch) ? n - base : kBatch;
+            const long long* vals;
+            if (direct && !in.list) {
+                vals = direct + in.from + base; // contiguous column: no gather at all
+            } else {
+                for (size_t i = 0; i < m; ++i)
+                    buf[i] = t.intAt(in.at(base + i), j);
+                vals = buf;
+            }
+            cmpInt(vals, m, c.op, lit, mask);
+            emitBits(mask, m, base, in, out);
+        }
+        return;
+    }
+
+    if (t.columns[j].dict) {
+        // the literal becomes a code (=, !=) or a rank bound (ranges) once;
+        // rows then compare integers with the INT kernel
+        const StrDict& d = t.dicts[j];
+        const bool eq = c.op == CmpOp::EQ || c.op == CmpOp::NE;
+        CmpOp op = c.op;
+        long long lit;
+        if (eq) {
+            lit = d.find(c.sval);
+            if (lit < 0) { // no row holds the literal
+                if (c.op == CmpOp::NE)
+                    for (size_t i = 0; i < n; ++i)
+                        out.push_back(in.at(i));
+                return;
+            }
+        } else {
+            const bool below = c.op == CmpOp::LT || c.op == CmpOp::LE;
+            lit = (c.op == CmpOp::LT || c.op == CmpOp::GE) ? d.lowerRank(c.sval) : d.upperRank(c.sval);
+            op = below ? CmpOp::LT : CmpOp::GE;
+        }
+        const uint32_t* rank = eq ? nullptr : d.ranks();
+        long long buf[kBatch];
+        for (size_t base = 0; base < n; base += kBatch) {
+            const size_t m = (n - base < kBatch) ? n - base : kBatch;
+            for (size_t i = 0; i < m; ++i) {
+                const uint32_t code = t.codeAt(in.at(base + i), j);
+                buf[i] = eq ? code : rank[code];
+            }
+            cmpInt(buf, m, op, lit, mask);
+            emitBits(mask, m, base, in, out);
+        }
+        return;
+    }
+    if (t.layout == Layout::ROW) {
+        // cells are compared as Values: most are settled by length and inline prefix
+        const Value& lit = *c.literal;
+        for (size_t base = 0; base < n; base += kBatch) {
+            const size_t m = (n - base < kBatch) ? n - base : kBatch;
+            for (size_t w = 0; w * 64 < m; ++w) {
+                uint64_t bits = 0;
+                for (size_t i = w * 64; i < m && i < w * 64 + 64; ++i)
+                    bits |= static_cast<uint64_t>(holds(c.op, t.cell(in.at(base + i), j), lit)) << (i - w * 64);
+                mask[w] = bits;
+            }
+            emitBits(mask, m, base, in, out);
+        }
+        return;
+    }
+    const std::string_view lit = c.sval;
+    std::string_view buf[kBatch];
+    for (size_t base = 0; base < n; base += kBatch) {
+        const size_t m = (n - base < kBatch) ? n - base : kBatch;
+        for (size_t i = 0; i < m; ++i)
+            buf[i] = t.strAt(in.at(base + i), j);
+        if (c.op == CmpOp::EQ || c.op == CmpOp::NE) {
+            eqStr(buf, m, lit, mask);
+            if (c.op == CmpOp::NE)
+                for (auto& w : mask)
+                    w = ~w;
+        } else {
+            for (size_t w = 0; w * 64 < m; ++w) {
+                uint64_t bits = 0;
+                for (size_t i = w * 64; i < m && i < w * 64 + 64; ++i)
+                    bits |= static_cast<uint64_t>(c.strCmp(buf[i], lit)) << (i - w * 64);
+                mask[w] = bits;
+            }
+        }
+        emitBits(mask, m, base, in, out);
+    }
+}
+
+void filterRows(const Table& t, const BoundCmp& c, const std::vector<size_t>* in, std::vector<size_t>& out) {
+    filterSpan(t, c, in ? RowSpan{in->data(), 0, in->size()} : RowSpan{nullptr, 0, t.rowCount()}, out);
+}
+
+void filterRows(const Table& t, const Condition& c, const std::vector<size_t>* in, std::vector<size_t>& out) {
+    filterRows(t, bindCmp(t, c), in, out);
+}
+
+// Answers c from an index when one covers it; false means the caller must scan.
+// Equality prefers a hash index; ranges need a B+-tree. NE always scans.
+bool probeIndex(const Table& t, const BoundCmp& c, std::vector<size_t>& out) {
+    const int j = c.col;
+    if (c.fold == BoundCmp::Fold::NEVER)
+        return true;
+    if (c.fold == BoundCmp::Fold::ALWAYS || c.op == CmpOp::NE)
+        return false;
+    if (c.op == CmpOp::EQ) {
+        const Index* ix = t.findIndex(j, IndexKind::HASH);
+        if (!ix)
+            ix = t.findIndex(j, IndexKind::BTREE);
+        if (!ix)
+            return false;
+        ix->equal(*c.literal, out);
+        return true;
+    }
+    const auto* bt = static_cast<const BTreeIndex*>(t.findIndex(j, IndexKind::BTREE));
+    if (!bt)
+        return false;
+    const Value& v = *c.literal;
+    switch (c.op) {
+    case CmpOp::LT:
+        bt->range(nullptr, false, &v, false, out, BTreeIndex::Order::ROW);
+        break;
+    case CmpOp::LE:
+        bt->range(nullptr, false, &v, true, out, BTreeIndex::Order::ROW);
+        break;
+    case CmpOp::GT:
+        bt->range(&v, false, nullptr, false, out, BTreeIndex::Order::ROW);
+        break;
+    default: // GE
+        bt->range(&v, true, nullptr, false, out, BTreeIndex::Order::ROW);
+        break;
+    }
+    return true;
+}
+
+// ----- Compound expressions -----
+namespace {
+
+// Rows of `in` not in `hits` (hits is an ascending subset of in).
+void subtract(RowSpan in, const std::vector<size_t>& hits, std::vector<size_t>& out) {
+    size_t h = 0;
+    for (size_t i = 0; i < in.n; ++i) {
+        size_t r = in.at(i);
+        if (h < hits.size() && hits[h] == r)
+            ++h;
+        else
+            out.push_back(r);
+    }
+}
+
+// Evaluates one Expr tree over successive chunks. Each AND/OR keeps per-operand
+// statistics (rows in, rows out, time) and re-orders its operands after every
+// pass: AND by cost / (1 - selectivity), OR by cost / selectivity.
+class ExprEval {
+  public:
+    ExprEval(const Table& t, const BoundExpr& e) : t_(t) {
+        build(root_, e);
+    }
+    void run(RowSpan in, std::vector<size_t>& out) {
+        eval(root_, in, out);
+    }
+
+  private:
+    struct Node {
+        const BoundExpr* e = nullptr;
+        std::vector<Node> kids;
+        std::vector<size_t> order; // evaluation order of kids
+        double cost = 1;           // static estimate, used until stats exist
+        double in = 0, out = 0, nanos = 0;
+    };
+    const Table& t_;
+    Node root_;
+
+    void build(Node& n, const BoundExpr& e) {
+        n.e = &e;
+        if (e.kind == ExprKind::CMP) {
+            bool str = (e.cmp.type == ColType::STR);
+            n.cost = !str ? 1 : (e.cmp.op == CmpOp::EQ || e.cmp.op == CmpOp::NE) ? 2 : 4;
+            return;
+        }
+        n.kids.resize(e.kids.size());
+        n.cost = 0;
+        for (size_t k = 0; k < e.kids.size(); ++k) {
+            build(n.kids[k], e.kids[k]);
+            n.cost += n.kids[k].cost;
+            n.order.push_back(k);
+        }
+        reorder(n);
+    }
+
+    static double perRow(const Node& k) {
+        return k.in > 0 ? k.nanos / k.in : k.cost;
+    }
+    static double passRate(const Node& k) {
+        return k.in > 0 ? k.out / k.in : 0.5;
+    }
+
+    static void reorder(Node& n) {
+        auto rank = [&](size_t k) {
+            const Node& c = n.kids[k];
+            if (n.e->kind == ExprKind::AND)
+                return perRow(c) / std::max(1e-6, 1 - passRate(c));
+            return perRow(c) / std::max(1e-6, passRate(c));
+        };
+        std::stable_sort(n.order.begin(), n.order.end(), [&](size_t a, size_t b) { return rank(a) < rank(b); });
+    }
+
+    void timed(Node& k, RowSpan in, std::vector<size_t>& out) {
+        auto t0 = std::chrono::steady_clock::now();
+        size_t before = out.size();
+        eval(k, in, out);
+        k.nanos += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+        k.in += static_cast<double>(in.n);
+        k.out += static_cast<double>(out.size() - before);
+    }
+
+    void eval(Node& n, RowSpan in, std::vector<size_t>& out) {
+        switch (n.e->kind) {
+        case ExprKind::CMP:
+            filterSpan(t_, n.e->cmp, in, out);
+            return;
+        case ExprKind::NOT: {
+            std::vector<size_t> hits;
+            eval(n.kids[0], in, hits);
+            subtract(in, hits, out);
+            return;
+        }
+        case ExprKind::AND: {
+            // each operand only sees rows that passed the previous ones
+            std::vector<size_t> cur, next;
+            RowSpan span = in;
+            for (size_t k : n.order) {
+                next.clear();
+                timed(n.kids[k], span, next);
+                cur.swap(next);
+                span = RowSpan{cur.data(), 0, cur.size()};
+                if (cur.empty())
+                    break;
+            }
+            out.insert(out.end(), cur.begin(), cur.end());
+            reorder(n);
+            return;
+        }
+        case ExprKind::OR: {
+            // each operand only sees rows no previous operand accepted
+            std::vector<size_t> acc, rest, hits, merged;
+            RowSpan span = in;
+            for (size_t k : n.order) {
+                hits.clear();
+                timed(n.kids[k], span, hits);
+                merged.clear();
+                std::merge(acc.begin(), acc.end(), hits.begin(), hits.end(), std::back_inserter(merged));
+                acc.swap(merged);
+                std::vector<size_t> left;
+                subtract(span, hits, left);
+                rest.swap(left);
+                span = RowSpan{rest.data(), 0, rest.size()};
+                if (rest.empty())
+                    break;
+            }
+            out.insert(out.end(), acc.begin(), acc.end());
+            reorder(n);
+            return;
+        }
+        }
+    }
+};
+
+} // namespace
+
+void scanRows(const Table& t, const BoundExpr* e, ThreadPool* pool,
+              const std::function<void(const std::vector<size_t>& rows)>& emit, size_t limit) {
+    if (limit == 0)
+        return;
+    // An indexed comparison (or conjunct) narrows the candidates; the rest runs over them.
+    std::vector<size_t> seed;
+    bool seeded = false;
+    BoundExpr rest;
+    const BoundExpr* todo = e;
+    if (e && e->kind == ExprKind::CMP) {
+        if (probeIndex(t, e->cmp, seed)) {
+            if (seed.size() > limit)
+                seed.resize(limit);
+            if (!seed.empty())
+                emit(seed);
+            return;
+        }
+    } else if (e && e->kind == ExprKind::AND) {
+        for (size_t k = 0; k < e->kids.size() && !seeded; ++k) {
+            if (e->kids[k].kind != ExprKind::CMP || !probeIndex(t, e->kids[k].cmp, seed))
+                continue;
+            seeded = true;
+            rest.kind = ExprKind::AND;
+            for (size_t m = 0; m < e->kids.size(); ++m)
+                if (m != k)
+                    rest.kids.push_back(e->kids[m]);
+            todo = (rest.kids.size() == 1) ? &rest.kids[0] : &rest;
+        }
+    }
+
+    const size_t n = seeded ? seed.size() : t.rowCount();
+    auto span = [&](size_t from, size_t to) {
+        return seeded ? RowSpan{seed.data() + from, 0, to - from} : RowSpan{nullptr, from, to - from};
+    };
+    // sequential scans share one evaluator, so operand statistics carry across windows
+    std::optional<ExprEval> seqEval;
+    auto scan = [&](size_t from, size_t to, std::vector<size_t>& dst, bool shared) {
+        if (!todo) {
+            for (size_t i = from; i < to; ++i)
+                dst.push_back(seeded ? seed[i] : i);
+            return;
+        }
+        if (todo->kind == ExprKind::CMP) {
+            filterSpan(t, todo->cmp, span(from, to), dst);
+            return;
+        }
+        std::optional<ExprEval> local;
+        ExprEval& ev = shared ? (seqEval ? *seqEval : seqEval.emplace(t, *todo)) : local.emplace(t, *todo);
+        for (size_t base = from; base < to; base += kChunk)
+            ev.run(span(base, std::min(to, base + kChunk)), dst);
+    };
+
+    // one window = one morsel per thread; each morsel adapts its own operand order
+    const bool parallel = pool && pool->size() > 1;
+    const size_t full = kMorsel * (parallel ? pool->size() : 1);
+    size_t window = limit == SIZE_MAX ? full : kMorsel;
+    size_t emitted = 0;
+    std::vector<size_t> hits;
+    std::vector<std::vector<size_t>> partial;
+    for (size_t base = 0; base < n; base += window, window = std::min(full, window * 2)) {
+        const size_t end = std::min(n, base + window);
+        const size_t parts = (end - base + kMorsel - 1) / kMorsel;
+        hits.clear();
+        if (!parallel || parts <= 1) {
+            scan(base, end, hits, true);
+        } else {
+            partial.assign(parts, {});
+            pool->parallelFor(parts, [&](size_t p) {
+                scan(base + p * kMorsel, std::min(end, base + (p + 1) * kMorsel), partial[p], false);
+            });
+            for (const auto& part : partial)
+                hits.insert(hits.end(), part.begin(), part.end());
+        }
+        if (hits.size() > limit - emitted)
+            hits.resize(limit - emitted);
+        if (!hits.empty())
+            emit(hits);
+        emitted += hits.size();
+        if (emitted == limit)
+            return;
+    }
+}
+
+void filterRows(const Table& t, const BoundExpr& e, std::vector<size_t>& out, ThreadPool* pool) {
+    scanRows(t, &e, pool, [&](const std::vector<size_t>& rows) { out.insert(out.end(), rows.begin(), rows.end()); });
+}
+
+void filterRows(const Table& t, const Expr& e, std::vector<size_t>& out, ThreadPool* pool) {
+    filterRows(t, bindExpr(t, e), out, pool);
+}
+
+} // namespace imd
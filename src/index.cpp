@@ -0,0 +1,196 @@
+﻿#include "imd/index.hpp"
+#include <algorithm>
+#include <functional>
+
+namespace imd {
+namespace detail {
+
+static size_t hashKey(long long k) {
+    return static_cast<size_t>(mix64(static_cast<uint64_t>(k))); // sequential ids spread over the whole table
+}
+static size_t hashKey(std::string_view k) {
+    return std::hash<std::string_view>{}(k);
+}
+
+template <class K> size_t OpenTable<K>::probe(KeyArg key) const {
+    if (slots_.empty())
+        return 0;
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = hashKey(key) & mask;; i = (i + 1) & mask) {
+        const Slot& s = slots_[i];
+        if (s.state == 0)
+            return slots_.size();
+        if (s.state == 1 && s.key == key)
+            return i;
+    }
+}
+
+template <class K> void OpenTable<K>::rehash(size_t cap) {
+    std::vector<Slot> old;
+    old.swap(slots_);
+    slots_.resize(cap);
+    used_ = 0;
+    tombs_ = 0;
+    const size_t mask = cap - 1;
+    for (auto& s : old) {
+        if (s.state != 1)
+            continue;
+        size_t i = hashKey(s.key) & mask;
+        while (slots_[i].state != 0)
+            i = (i + 1) & mask;
+        slots_[i] = std::move(s);
+        ++used_;
+    }
+}
+
+template <class K> void OpenTable<K>::insert(KeyArg key, size_t row) {
+    // keep load (including tombstones) under 70%
+    if ((used_ + tombs_ + 1) * 10 > slots_.size() * 7) {
+        size_t cap = slots_.empty() ? 16 : slots_.size();
+        while ((used_ + 1) * 10 > cap * 5)
+            cap *= 2;
+        rehash(cap);
+    }
+    const size_t mask = slots_.size() - 1;
+    size_t firstTomb = slots_.size();
+    size_t i = hashKey(key) & mask;
+    for (;; i = (i + 1) & mask) {
+        Slot& s = slots_[i];
+        if (s.state == 0)
+            break;
+        if (s.state == 2) {
+            if (firstTomb == slots_.size())
+                firstTomb = i;
+        } else if (s.key == key) {
+            s.more.push_back(row);
+            return;
+        }
+    }
+    if (firstTomb != slots_.size()) {
+        i = firstTomb;
+        --tombs_;
+    }
+    Slot& s = slots_[i];
+    s.key = K(key); // the only copy of a string key
+    s.row = row;
+    s.more.clear();
+    s.state = 1;
+    ++used_;
+}
+
+template <class K> void OpenTable<K>::erase(KeyArg key, size_t row) {
+    size_t i = probe(key);
+    if (i == slots_.size())
+        return;
+    Slot& s = slots_[i];
+    if (s.row == row) {
+        if (!s.more.empty()) {
+            s.row = s.more.back();
+            s.more.pop_back();
+            return;
+        }
+        s.state = 2;
+        s.key = K{};
+        --used_;
+        ++tombs_;
+        return;
+    }
+    auto it = std::find(s.more.begin(), s.more.end(), row);
+    if (it != s.more.end()) {
+        *it = s.more.back();
+        s.more.pop_back();
+    }
+}
+
+template <class K> const typename OpenTable<K>::Slot* OpenTable<K>::find(KeyArg key) const {
+    size_t i = probe(key);
+    return (i == slots_.size()) ? nullptr : &slots_[i];
+}
+
+template <class K> void OpenTable<K>::compact(const std::vector<size_t>& newPos, const std::vector<uint8_t>& keep) {
+    for (auto& s : slots_) {
+        if (s.state != 1)
+            continue;
+        std::vector<size_t> live;
+        if (keep[s.row])
+            live.push_back(newPos[s.row]);
+        for (size_t r : s.more)
+            if (keep[r])
+                live.push_back(newPos[r]);
+        if (live.empty()) {
+            s.state = 2;
+            s.key = K{};
+            s.more.clear();
+            --used_;
+            ++tombs_;
+            continue;
+        }
+        s.row = live.back();
+        live.pop_back();
+        s.more.swap(live);
+    }
+    if (tombs_ > used_)
+        rehash(slots_.size());
+}
+
+template <class K> void OpenTable<K>::clear() {
+    slots_.clear();
+    used_ = 0;
+    tombs_ = 0;
+}
+
+template class OpenTable<long long>;
+template class OpenTable<std::string>;
+
+} // namespace detail
+
+// ----- HashIndex -----
+void HashIndex::insert(const Value& key, size_t row) {
+    if (type() == ColType::INT)
+        ints_.insert(key.asInt(), row);
+    else
+        strs_.insert(key.asStr(), row);
+}
+
+void HashIndex::erase(const Value& key, size_t row) {
+    if (type() == ColType::INT)
+        ints_.erase(key.asInt(), row);
+    else
+        strs_.erase(key.asStr(), row);
+}
+
+void HashIndex::compact(const std::vector<uint8_t>& keep) {
+    std::vector<size_t> newPos(keep.size());
+    size_t w = 0;
+    for (size_t i = 0; i < keep.size(); ++i) {
+        newPos[i] = w;
+        w += keep[i] ? 1 : 0;
+    }
+    ints_.compact(newPos, keep);
+    strs_.compact(newPos, keep);
+}
+
+void HashIndex::clear() {
+    ints_.clear();
+    strs_.clear();
+}
+
+template <class S> static void appendSorted(const S* s, std::vector<size_t>& out) {
+    if (!s)
+        return;
+    size_t from = out.size();
+    out.push_back(s->row);
+    out.insert(out.end(), s->more.begin(), s->more.end());
+    std::sort(out.begin() + from, out.end());
+}
+
+void HashIndex::equal(const Value& key, std::vector<size_t>& out) const {
+    if (type() == ColType::INT) {
+        if (key.isInt())
+            appendSorted(ints_.find(key.asInt()), out);
+    } else if (key.isStr()) {
+        appendSorted(strs_.find(key.asStr()), out);
+    }
+}
+
+} // namespace imd
@@ -0,0 +1,193 @@
+﻿#include "imd/join.hpp"
+#include "imd/filter.hpp"
+#include "imd/index.hpp"
+#include "imd/thread_pool.hpp"
+#include <algorithm>
+#include <string_view>
+
+namespace imd {
+
+namespace {
+
+// Rows of one side that passed its WHERE terms: rows, or all of [0, n) when all.
+struct Side {
+    const Table* t = nullptr;
+    int key = -1;
+    bool all = true;
+    std::vector<size_t> rows;
+    size_t n = 0;
+
+    size_t at(size_t i) const {
+        return all ? i : rows[i];
+    }
+    bool str() const {
+        return t->columns[key].type == ColType::STR;
+    }
+    uint64_t hash(size_t row) const {
+        if (str())
+            return std::hash<std::string_view>{}(t->strAt(row, key));
+        return detail::mix64(static_cast<uint64_t>(t->intAt(row, key)));
+    }
+};
+
+class JoinTable {
+  public:
+    JoinTable(const Side& s, ThreadPool* pool) : side_(s) {
+        const size_t n = s.n;
+        // enough partitions that one partition's entries and slots fit in cache
+        const size_t bytes = n * (sizeof(Entry) + 2 * sizeof(Slot));
+        while ((bytes >> bits_) > kJoinCacheBytes && bits_ < 16)
+            ++bits_;
+        const size_t parts = size_t{1} << bits_;
+
+        // hash once, count entries per (morsel, partition), then scatter in parallel
+        const size_t morsels = (n + kMorsel - 1) / kMorsel;
+        std::vector<uint64_t> hashes(n);
+        std::vector<size_t> counts(morsels * parts, 0);
+        forMorsels(pool, n, [&](size_t from, size_t to) {
+            size_t* c = &counts[from / kMorsel * parts];
+            for (size_t i = from; i < to; ++i) {
+                hashes[i] = s.hash(s.at(i));
+                ++c[part(hashes[i])];
+            }
+        });
+        partStart_.assign(parts + 1, 0);
+        std::vector<size_t> offs(morsels * parts);
+        size_t total = 0;
+        for (size_t p = 0; p < parts; ++p) {
+            partStart_[p] = total;
+            for (size_t m = 0; m < morsels; ++m) {
+                offs[m * parts + p] = total;
+                total += counts[m * parts + p];
+            }
+        }
+        partStart_[parts] = total;
+        entries_.resize(n);
+        forMorsels(pool, n, [&](size_t from, size_t to) {
+            size_t* o = &offs[from / kMorsel * parts];
+            for (size_t i = from; i < to; ++i)
+                entries_[o[part(hashes[i])]++] = Entry{hashes[i], s.at(i)};
+        });
+
+        // per partition: sort by (hash, row) so equal hashes are contiguous, then index runs
+        slotStart_.assign(parts + 1, 0);
+        for (size_t p = 0; p < parts; ++p) {
+            size_t cap = 16;
+            while (cap < 2 * (partStart_[p + 1] - partStart_[p]))
+                cap *= 2;
+            slotStart_[p + 1] = slotStart_[p] + cap;
+        }
+        slots_.assign(slotStart_[parts], Slot{0, kEmpty});
+        auto build = [&](size_t p) {
+            const auto first = entries_.begin() + partStart_[p], last = entries_.begin() + partStart_[p + 1];
+            std::sort(first, last, [](const Entry& a, const Entry& b) {
+                return a.hash != b.hash ? a.hash < b.hash : a.row < b.row;
+            });
+            Slot* slots = &slots_[slotStart_[p]];
+            const size_t mask = slotStart_[p + 1] - slotStart_[p] - 1;
+            for (size_t e = partStart_[p]; e < partStart_[p + 1]; ++e) {
+                if (e > partStart_[p] && entries_[e - 1].hash == entries_[e].hash)
+                    continue;
+                size_t i = entries_[e].hash & mask;
+                while (slots[i].first != kEmpty)
+                    i = (i + 1) & mask;
+                slots[i] = Slot{entries_[e].hash, e};
+            }
+        };
+        if (pool && parts > 1)
+            pool->parallelFor(parts, build);
+        else
+            for (size_t p = 0; p < parts; ++p)
+                build(p);
+    }
+
+    // Calls fn(build row) for every build row whose key equals probe's key, in row order.
+    template <class Fn> void probe(const Side& probe, size_t row, Fn&& fn) const {
+        const uint64_t h = probe.hash(row);
+        const size_t p = part(h);
+        const Slot* slots = &slots_[slotStart_[p]];
+        const size_t mask = slotStart_[p + 1] - slotStart_[p] - 1;
+        for (size_t i = h & mask; slots[i].first != kEmpty; i = (i + 1) & mask) {
+            if (slots[i].hash != h)
+                continue;
+            const bool str = side_.str();
+            const std::string_view key = str ? probe.t->strAt(row, probe.key) : std::string_view();
+            for (size_t e = slots[i].first; e < partStart_[p + 1] && entries_[e].hash == h; ++e)
+                if (!str || side_.t->strAt(entries_[e].row, side_.key) == key)
+                    fn(entries_[e].row);
+            return;
+        }
+    }
+
+  private:
+    static constexpr size_t kEmpty = SIZE_MAX;
+    struct Entry {
+        uint64_t hash;
+        size_t row;
+    };
+    struct Slot {
+        uint64_t hash;
+        size_t first; // first entry with this hash
+    };
+    const Side& side_;
+    unsigned bits_ = 0;
+    std::vector<size_t> partStart_; // entries_ range of each partition
+    std::vector<Entry> entries_;    // grouped by partition, sorted by (hash, row) within
+    std::vector<size_t> slotStart_; // slots_ range (a power of two) of each partition
+    std::vector<Slot> slots_;
+
+    size_t part(uint64_t h) const {
+        return bits_ ? static_cast<size_t>(h >> (64 - bits_)) : 0;
+    }
+};
+
+} // namespace
+
+void hashJoin(const BoundJoin& b, ThreadPool* pool, const std::function<void(const JoinPairs& pairs)>& emit,
+              size_t limit) {
+    Side sides[2];
+    for (int k = 0; k < 2; ++k) {
+        Side& s = sides[k];
+        s.t = b.side[k];
+        s.key = b.key[k];
+        s.all = !b.where[k];
+        if (!s.all)
+            filterRows(*s.t, *b.where[k], s.rows, pool);
+        s.n = s.all ? s.t->rowCount() : s.rows.size();
+    }
+    if (limit == 0 || sides[0].n == 0 || sides[1].n == 0)
+        return;
+    const int build = sides[1].n <= sides[0].n ? 1 : 0;
+    const Side& probe = sides[1 - build];
+    const JoinTable table(sides[build], pool);
+
+    // one window = one morsel per thread, concatenated in probe order
+    const bool parallel = pool && pool->size() > 1;
+    const size_t window = kMorsel * (parallel ? pool->size() : 1);
+    std::vector<JoinPairs> partial;
+    JoinPairs out;
+    size_t emitted = 0;
+    for (size_t base = 0; base < probe.n && emitted < limit; base += window) {
+        const size_t end = std::min(probe.n, base + window);
+        partial.assign((end - base + kMorsel - 1) / kMorsel, {});
+        forMorsels(parallel ? pool : nullptr, end - base, [&](size_t from, size_t to) {
+            JoinPairs& dst = partial[from / kMorsel];
+            for (size_t i = base + from; i < base + to; ++i) {
+                const size_t row = probe.at(i);
+                table.probe(probe, row, [&](size_t match) {
+                    dst.push_back(build == 1 ? std::make_pair(row, match) : std::make_pair(match, row));
+                });
+            }
+        });
+        out.clear();
+        for (const auto& part : partial)
+            out.insert(out.end(), part.begin(), part.end());
+        if (out.size() > limit - emitted)
+            out.resize(limit - emitted);
+        if (!out.empty())
+            emit(out);
+        emitted += out.size();
+    }
+}
+
+} // namespace imd
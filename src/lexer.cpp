@@ -1,9 +1,10 @@
 ﻿#include "imd/lexer.hpp"
 #include <cctype>
+#include <charconv>
 
 namespace imd {
 
-Lexer::Lexer(std::string src) : s_(std::move(src)) {}
+Lexer::Lexer(std::string_view src) : s_(src) {}
 
 char Lexer::get() {
     char c = peek();
@@ -19,6 +20,11 @@ char Lexer::get() {
     return c;
 }
 
+void Lexer::skipTo(size_t pos) {
+    while (i_ < pos && !eof())
+        get();
+}
+
 void Lexer::skipSpaces() {
     while (std::isspace(static_cast<unsigned char>(peek())))
         get();
@@ -29,14 +35,13 @@ Token Lexer::readString() {
     t.type = TokType::String;
     t.line = line_;
     t.col = col_;
-    std::string out;
+    t.pos = i_ - 1; // opening quote already consumed
+    const size_t start = i_;
     while (!eof()) {
-        char c = get();
-        if (c == '"') {
-            t.text = std::move(out);
+        if (get() == '"') { // no escaping per spec
+            t.text = s_.substr(start, i_ - 1 - start);
             return t;
         }
-        out.push_back(c); // no escaping per spec
     }
     throw std::runtime_error("Unterminated string literal");
 }
@@ -46,14 +51,12 @@ Token Lexer::readNumber() {
     t.type = TokType::Number;
     t.line = line_;
     t.col = col_;
-    std::string out;
-    char c0 = s_[i_ - 1];
-    out.push_back(c0);
+    t.pos = i_ - 1;
     while (std::isdigit(static_cast<unsigned char>(peek())))
-        out.push_back(get());
-    if (out == "-" || out.empty())
+        get();
+    t.text = s_.substr(t.pos, i_ - t.pos);
+    if (t.text == "-")
         throw std::runtime_error("Invalid integer literal");
-    t.text = std::move(out);
     return t;
 }
 
@@ -62,12 +65,10 @@ Token Lexer::readIdent() {
     t.type = TokType::Ident;
     t.line = line_;
     t.col = col_;
-    std::string out;
-    char c0 = s_[i_ - 1];
-    out.push_back(c0);
+    t.pos = i_ - 1;
     while (std::isalnum(static_cast<unsigned char>(peek())) || peek() == '_')
-        out.push_back(get());
-    t.text = std::move(out);
+        get();
+    t.text = s_.substr(t.pos, i_ - t.pos);
     return t;
 }
 
@@ -76,6 +77,7 @@ Token Lexer::next() {
     Token t;
     t.line = line_;
     t.col = col_;
+    t.pos = i_;
 
     if (eof()) {
         t.type = TokType::End;
@@ -104,6 +106,14 @@ Token Lexer::next() {
         t.type = TokType::Star;
         t.text = "*";
         return t;
+    case '?':
+        t.type = TokType::Question;
+        t.text = "?";
+        return t;
+    case '.':
+        t.type = TokType::Dot;
+        t.text = ".";
+        return t;
     case '"':
         return readString();
     case '=':
@@ -152,22 +162,47 @@ Token Lexer::next() {
     throw std::runtime_error("Unexpected character");
 }
 
-static bool isUpper(const std::string& s) {
+static bool isUpper(std::string_view s) {
     for (char c : s)
         if (!(c >= 'A' && c <= 'Z'))
             return false;
     return !s.empty();
 }
 
-bool isUpperKeyword(const std::string& w) {
+bool isUpperKeyword(std::string_view w) {
     if (!isUpper(w))
         return false;
     return (w == "CREATE" || w == "TABLE" || w == "INSERT" || w == "INTO" || w == "VALUES" || w == "SELECT" ||
-            w == "FROM" || w == "WHERE" || w == "DELETE" || w == "UPDATE" || w == "SET");
+            w == "FROM" || w == "WHERE" || w == "DELETE" || w == "UPDATE" || w == "SET" || w == "USING" ||
+            w == "INDEX" || w == "ON" || w == "DROP" || w == "AND" || w == "OR" || w == "NOT" || w == "PREPARE" ||
+            w == "AS" || w == "EXECUTE" || w == "DEALLOCATE" || w == "COPY" || w == "TO" ||
+            w == "SAVE" || w == "LOAD" || w == "BGSAVE" || w == "GROUP" || w == "BY" ||
+            w == "ORDER" || w == "ASC" || w == "DESC" || w == "LIMIT" || w == "OFFSET" || w == "JOIN");
 }
 
-bool isTypeWord(const std::string& w) {
+bool isTypeWord(std::string_view w) {
     return (w == "int" || w == "str"); // exactly lowercase per spec
 }
 
+long long parseInt(std::string_view digits) {
+    long long x = 0;
+    auto [end, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), x);
+    if (ec == std::errc::result_out_of_range)
+        throw std::runtime_error("Integer literal out of range: " + std::string(digits));
+    if (ec != std::errc() || end != digits.data() + digits.size())
+        throw std::runtime_error("Invalid integer literal");
+    return x;
+}
+
+size_t statementEnd(std::string_view src, size_t from) {
+    bool inStr = false;
+    for (size_t i = from; i < src.size(); ++i) {
+        if (src[i] == '"')
+            inStr = !inStr;
+        else if (src[i] == ';' && !inStr)
+            return i + 1;
+    }
+    return src.size();
+}
+
 } // namespace imd
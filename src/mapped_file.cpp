@@ -0,0 +1,72 @@
+﻿#include "imd/mapped_file.hpp"
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace imd {
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string& path) {
+    HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (f == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Cannot open " + path);
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(f, &sz)) {
+        CloseHandle(f);
+        throw std::runtime_error("Cannot stat " + path);
+    }
+    size_ = static_cast<size_t>(sz.QuadPart);
+    if (size_ > 0) {
+        HANDLE m = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (m)
+            data_ = static_cast<const char*>(MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0));
+        if (m)
+            CloseHandle(m); // the view keeps the mapping alive
+    }
+    CloseHandle(f);
+    if (size_ > 0 && !data_)
+        throw std::runtime_error("Cannot map " + path);
+}
+
+MappedFile::~MappedFile() {
+    if (data_)
+        UnmapViewOfFile(data_);
+}
+#else
+MappedFile::MappedFile(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open " + path);
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Cannot stat " + path);
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ > 0) {
+        void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            ::close(fd);
+            throw std::runtime_error("Cannot map " + path);
+        }
+        ::madvise(p, size_, MADV_SEQUENTIAL);
+        data_ = static_cast<const char*>(p);
+    }
+    ::close(fd); // the mapping keeps the file alive
+}
+
+MappedFile::~MappedFile() {
+    if (data_)
+        ::munmap(const_cast<char*>(data_), size_);
+}
+#endif
+
+} // namespace imd
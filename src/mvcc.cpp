@@ -0,0 +1,356 @@
+﻿#include "imd/mvcc.hpp"
+#include "imd/binder.hpp"
+#include "imd/filter.hpp"
+#include "imd/parser.hpp"
+#include "imd/thread_pool.hpp"
+#include <functional>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace imd {
+
+// Versions per segment when the collector merges segments.
+constexpr size_t kSegmentRows = kMorsel;
+// Partial segments a table may have before it is merged. Writers merge inline
+// at twice this, so a busy writer cannot outrun the background collector.
+constexpr size_t kMaxSmallSegments = 8;
+
+struct MvccDatabase::Catalog {
+    // Empty tables, used only for binding. Never modified once the catalog is
+    // published; mutable because Binder takes a non-const Database.
+    mutable Database schemas;
+    std::unordered_map<std::string, std::shared_ptr<MvccTable>> tables;
+};
+
+// Copy of t's schema with no rows and no indexes.
+static Table schemaOf(const Table& t) {
+    Table s;
+    s.name = t.name;
+    s.columns = t.columns;
+    s.colIndex = t.colIndex;
+    s.layout = t.layout;
+    if (s.layout == Layout::COLUMNAR)
+        s.cols.resize(s.columns.size());
+    s.dicts.resize(s.columns.size());
+    return s;
+}
+
+// Builds one segment from rows, all created by the same commit unless ends / begins are given.
+static std::shared_ptr<MvccSegment> makeSegment(const Table& schema, std::vector<Row>& rows,
+                                                const std::vector<uint64_t>& begins,
+                                                const std::vector<uint64_t>* ends = nullptr) {
+    auto seg = std::make_shared<MvccSegment>();
+    seg->data = schemaOf(schema);
+    seg->data.reserve(rows.size());
+    for (auto& r : rows)
+        seg->data.append(std::move(r));
+    seg->begin = begins;
+    seg->end = std::make_unique<std::atomic<uint64_t>[]>(rows.size());
+    for (size_t i = 0; i < rows.size(); ++i)
+        seg->end[i].store(ends ? (*ends)[i] : kLiveTs, std::memory_order_relaxed);
+    return seg;
+}
+
+static Row rowAt(const Table& t, size_t r) {
+    Row row;
+    row.reserve(t.columns.size());
+    for (size_t j = 0; j < t.columns.size(); ++j)
+        row.push_back(t.get(r, static_cast<int>(j)));
+    return row;
+}
+
+// Positions in seg matching where (all rows when null).
+static void candidates(const MvccSegment& seg, const std::optional<BoundExpr>& where, std::vector<size_t>& out) {
+    out.clear();
+    if (where) {
+        filterRows(seg.data, *where, out);
+        return;
+    }
+    out.resize(seg.data.rowCount());
+    for (size_t i = 0; i < out.size(); ++i)
+        out[i] = i;
+}
+
+// ----- MvccTable -----
+MvccTable::MvccTable() : segs_(std::make_shared<const MvccSegments>()) {}
+
+size_t MvccTable::versions() const {
+    size_t n = 0;
+    const auto segs = segments(); // holds the list while it is walked
+    for (const auto& seg : *segs)
+        n += seg->data.rowCount();
+    return n;
+}
+
+// ----- Snapshots -----
+// Registers in a free slot, then re-reads the commit timestamp until it is
+// stable: a collector that scanned the slots before the store then holds the
+// writer lock, so the timestamp cannot have moved past what it protects.
+MvccDatabase::Snapshot::Snapshot(const MvccDatabase& db) {
+    size_t i = std::hash<std::thread::id>()(std::this_thread::get_id()) % kSlots;
+    for (size_t tries = 1;; ++tries, i = (i + 1) % kSlots) {
+        uint64_t expected = 0;
+        ts_ = db.visible_.load();
+        if (ts_ && db.slots_[i].compare_exchange_strong(expected, ts_)) {
+            slot_ = &db.slots_[i];
+            break;
+        }
+        if (!ts_) // nothing committed yet; there is nothing to protect
+            return;
+        if (tries % kSlots == 0)
+            std::this_thread::yield();
+    }
+    for (uint64_t now; (now = db.visible_.load()) != ts_;) {
+        ts_ = now;
+        slot_->store(now);
+    }
+}
+
+MvccDatabase::Snapshot::~Snapshot() {
+    if (slot_)
+        slot_->store(0);
+}
+
+uint64_t MvccDatabase::horizon() const {
+    uint64_t h = visible_.load();
+    for (const auto& s : slots_) {
+        const uint64_t v = s.load();
+        if (v && v < h)
+            h = v;
+    }
+    return h;
+}
+
+// ----- MvccDatabase -----
+MvccDatabase::MvccDatabase(std::chrono::milliseconds gcEvery)
+    : catalog_(std::make_shared<const Catalog>()), gcEvery_(gcEvery) {
+    if (gcEvery_.count() > 0)
+        gc_ = std::thread([this] { gcLoop(); });
+}
+
+MvccDatabase::~MvccDatabase() {
+    {
+        std::lock_guard<std::mutex> lk(gcM_);
+        stop_ = true;
+    }
+    gcCv_.notify_all();
+    if (gc_.joinable())
+        gc_.join();
+}
+
+std::shared_ptr<const MvccDatabase::Catalog> MvccDatabase::catalog() const {
+    return std::atomic_load(&catalog_);
+}
+
+MvccTable& MvccDatabase::table(const Catalog& c, const std::string& name) const {
+    auto it = c.tables.find(name);
+    if (it == c.tables.end())
+        throw std::runtime_error("No such table: " + name);
+    return *it->second;
+}
+
+size_t MvccDatabase::versions(const std::string& name) const {
+    return table(*catalog(), name).versions();
+}
+
+void MvccDatabase::execute(const Statement& st, ResultSink* sink) {
+    if (const auto* s = std::get_if<SelectStmt>(&st)) {
+        select(*s, sink);
+        return;
+    }
+    if (!std::holds_alternative<CreateStmt>(st) && !std::holds_alternative<InsertStmt>(st) &&
+        !std::holds_alternative<UpdateStmt>(st) && !std::holds_alternative<DeleteStmt>(st))
+        throw std::runtime_error("MvccDatabase runs CREATE TABLE, INSERT, UPDATE, DELETE and SELECT only");
+    write(st);
+}
+
+void MvccDatabase::run(std::string_view sql, std::ostream& out, OutputFormat format) {
+    Parser p(sql);
+    for (Statement st; p.next(st);) {
+        auto sink = makeSink(format, out);
+        execute(st, sink.get());
+    }
+}
+
+void MvccDatabase::select(const SelectStmt& s, ResultSink* sink) const {
+    const auto cat = catalog();
+    const BoundSelect b = Binder(cat->schemas).bind(s);
+    if (!b.aggs.empty())
+        throw std::runtime_error("Aggregates are not supported on the MVCC store");
+    if (b.orderCol >= 0)
+        throw std::runtime_error("ORDER BY is not supported on the MVCC store");
+    const MvccTable& mt = table(*cat, s.table);
+    const Snapshot snap(*this);
+    const auto segs = mt.segments(); // after registering, so the collector keeps what snap sees
+
+    std::vector<ColType> types;
+    for (int j : b.proj)
+        types.push_back(b.table->columns[j].type);
+    if (sink)
+        sink->begin(b.headers, types);
+    std::vector<size_t> hits;
+    std::vector<Value> line;
+    size_t skip = b.offset, left = b.limit;
+    for (const auto& seg : *segs) {
+        if (left == 0)
+            break;
+        candidates(*seg, b.where, hits);
+        for (size_t i : hits) {
+            if (left == 0)
+                break;
+            if (!seg->visible(i, snap.ts()) || !sink)
+                continue;
+            if (skip > 0) {
+                --skip;
+                continue;
+            }
+            --left;
+            line.clear();
+            for (int j : b.proj)
+                line.push_back(seg->data.peek(i, j));
+            sink->row(line);
+        }
+    }
+    if (sink)
+        sink->end();
+}
+
+// Under the writer lock the latest commit is the read view; this commit is
+// stamped one past it and becomes visible only once fully applied.
+void MvccDatabase::write(const Statement& st) {
+    std::lock_guard<std::mutex> lk(writer_);
+    const auto cat = catalog();
+    const Binder binder(cat->schemas);
+    const uint64_t now = visible_.load(), ts = now + 1;
+
+    if (const auto* s = std::get_if<CreateStmt>(&st)) {
+        BoundCreate b = binder.bind(*s);
+        auto next = std::make_shared<Catalog>();
+        for (const auto& [name, t] : cat->schemas.tables)
+            next->schemas.tables.emplace(name, schemaOf(t));
+        next->tables = cat->tables;
+        next->tables.emplace(s->table, std::make_shared<MvccTable>());
+        next->schemas.tables.emplace(s->table, std::move(b.table));
+        std::atomic_store(&catalog_, std::shared_ptr<const Catalog>(std::move(next)));
+        return;
+    }
+
+    std::vector<Row> rows; // new versions
+    std::string name;
+    if (const auto* s = std::get_if<InsertStmt>(&st)) {
+        const BoundInsert b = binder.bind(*s);
+        name = s->table;
+        for (const auto& values : *b.rows) {
+            Row r = b.defaults;
+            for (size_t k = 0; k < b.pos.size(); ++k)
+                r[b.pos[k]] = values[k];
+            rows.push_back(std::move(r));
+        }
+    } else if (const auto* s = std::get_if<DeleteStmt>(&st)) {
+        const BoundDelete b = binder.bind(*s);
+        name = s->table;
+        std::vector<size_t> hits;
+        const auto segs = table(*cat, name).segments();
+        for (const auto& seg : *segs) {
+            candidates(*seg, b.where, hits);
+            for (size_t i : hits)
+                if (seg->visible(i, now))
+                    seg->end[i].store(ts, std::memory_order_release);
+        }
+    } else if (const auto* s = std::get_if<UpdateStmt>(&st)) {
+        const BoundUpdate b = binder.bind(*s);
+        name = s->table;
+        std::vector<size_t> hits;
+        const auto segs = table(*cat, name).segments();
+        for (const auto& seg : *segs) {
+            candidates(*seg, b.where, hits);
+            for (size_t i : hits) {
+                if (!seg->visible(i, now))
+                    continue;
+                Row r = rowAt(seg->data, i);
+                for (const auto& [j, v] : b.sets)
+                    r[j] = *v;
+                rows.push_back(std::move(r));
+                seg->end[i].store(ts, std::memory_order_release);
+            }
+        }
+    }
+    if (!rows.empty()) {
+        MvccTable& mt = table(*cat, name);
+        auto next = std::make_shared<MvccSegments>(*mt.segments());
+        const std::vector<uint64_t> begins(rows.size(), ts);
+        const Table& schema = *cat->schemas.find(name);
+        next->push_back(makeSegment(schema, rows, begins));
+        const bool splintered = next->size() > 2 * kMaxSmallSegments;
+        mt.publish(std::move(next));
+        visible_.store(ts);
+        if (splintered)
+            collect(schema, mt, horizon());
+        return;
+    }
+    visible_.store(ts);
+}
+
+// ----- Garbage collection -----
+// A version whose end is at or before the horizon is invisible to every
+// current and future snapshot. A table is rewritten (live versions only, in
+// full segments) once a quarter of its versions are dead or it has splintered
+// into many small segments; readers still holding the old list keep it alive.
+size_t MvccDatabase::collect(const Table& schema, MvccTable& mt, uint64_t h) {
+    const auto segs = mt.segments();
+    size_t total = 0, dead = 0;
+    for (const auto& seg : *segs) {
+        const size_t n = seg->data.rowCount();
+        total += n;
+        for (size_t i = 0; i < n; ++i)
+            dead += seg->end[i].load(std::memory_order_relaxed) <= h ? 1 : 0;
+    }
+    if (dead * 4 <= total && segs->size() <= total / kSegmentRows + kMaxSmallSegments)
+        return 0;
+    auto next = std::make_shared<MvccSegments>();
+    std::vector<Row> rows;
+    std::vector<uint64_t> begins, ends;
+    auto flush = [&] {
+        if (!rows.empty())
+            next->push_back(makeSegment(schema, rows, begins, &ends));
+        rows.clear();
+        begins.clear();
+        ends.clear();
+    };
+    for (const auto& seg : *segs) {
+        for (size_t i = 0; i < seg->data.rowCount(); ++i) {
+            const uint64_t end = seg->end[i].load(std::memory_order_relaxed);
+            if (end <= h)
+                continue;
+            rows.push_back(rowAt(seg->data, i));
+            begins.push_back(seg->begin[i]);
+            ends.push_back(end);
+            if (rows.size() == kSegmentRows)
+                flush();
+        }
+    }
+    flush();
+    mt.publish(std::move(next));
+    return dead;
+}
+
+size_t MvccDatabase::collectGarbage() {
+    std::lock_guard<std::mutex> lk(writer_);
+    const uint64_t h = horizon();
+    const auto cat = catalog();
+    size_t reclaimed = 0;
+    for (const auto& [name, mt] : cat->tables)
+        reclaimed += collect(*cat->schemas.find(name), *mt, h);
+    return reclaimed;
+}
+
+void MvccDatabase::gcLoop() {
+    std::unique_lock<std::mutex> lk(gcM_);
+    while (!gcCv_.wait_for(lk, gcEvery_, [&] { return stop_; })) {
+        lk.unlock();
+        collectGarbage();
+        lk.lock();
+    }
+}
+
+} // namespace imd
@@ -0,0 +1,134 @@
+﻿#include "imd/order.hpp"
+#include "imd/filter.hpp"
+#include "imd/thread_pool.hpp"
+#include <algorithm>
+#include <string_view>
+
+namespace imd {
+
+namespace {
+
+// Keeps above this use a full sort: the heaps would hold most of the rows anyway.
+constexpr size_t kMaxHeap = kMorsel;
+
+template <class K> struct Keyed {
+    K key;
+    size_t row;
+};
+
+template <class K> struct Before {
+    bool desc;
+    bool operator()(const Keyed<K>& a, const Keyed<K>& b) const {
+        if (a.key != b.key)
+            return desc ? b.key < a.key : a.key < b.key;
+        return a.row < b.row;
+    }
+};
+
+// Max-heap by before, holding the best keep entries seen so far.
+template <class K> void offer(std::vector<Keyed<K>>& heap, size_t keep, const Keyed<K>& x, Before<K> before) {
+    if (heap.size() < keep) {
+        heap.push_back(x);
+        std::push_heap(heap.begin(), heap.end(), before);
+    } else if (before(x, heap.front())) {
+        std::pop_heap(heap.begin(), heap.end(), before);
+        heap.back() = x;
+        std::push_heap(heap.begin(), heap.end(), before);
+    }
+}
+
+template <class K, class Get>
+std::vector<size_t> order(const Table& t, const BoundExpr* e, bool desc, size_t keep, ThreadPool* pool, Get get) {
+    const Before<K> before{desc};
+    std::vector<Keyed<K>> best;
+    if (keep <= kMaxHeap) {
+        std::vector<std::vector<Keyed<K>>> local;
+        scanRows(t, e, pool, [&](const std::vector<size_t>& hits) {
+            local.assign((hits.size() + kMorsel - 1) / kMorsel, {});
+            forMorsels(pool, hits.size(), [&](size_t from, size_t to) {
+                auto& heap = local[from / kMorsel];
+                for (size_t i = from; i < to; ++i)
+                    offer(heap, keep, Keyed<K>{get(hits[i]), hits[i]}, before);
+            });
+            for (const auto& heap : local)
+                for (const auto& x : heap)
+                    offer(best, keep, x, before);
+        });
+        std::sort_heap(best.begin(), best.end(), before);
+    } else {
+        scanRows(t, e, pool, [&](const std::vector<size_t>& hits) {
+            const size_t at = best.size();
+            best.resize(at + hits.size());
+            forMorsels(pool, hits.size(), [&](size_t from, size_t to) {
+                for (size_t i = from; i < to; ++i)
+                    best[at + i] = Keyed<K>{get(hits[i]), hits[i]};
+            });
+        });
+        parallelSort(pool, best, before);
+        if (best.size() > keep)
+            best.resize(keep);
+    }
+    std::vector<size_t> rows(best.size());
+    for (size_t i = 0; i < best.size(); ++i)
+        rows[i] = best[i].row;
+    return rows;
+}
+
+// Ascending order over a column with a B+-tree is a walk of the tree: entries
+// come out by (key, row), ties in table order, and the walk stops after keep.
+// Covers no WHERE and a single comparison on that column; false otherwise.
+bool orderByIndex(const Table& t, const BoundExpr* e, int col, bool desc, size_t keep, std::vector<size_t>& rows) {
+    const auto* bt = static_cast<const BTreeIndex*>(t.findIndex(col, IndexKind::BTREE));
+    if (!bt || desc)
+        return false;
+    constexpr auto kKey = BTreeIndex::Order::KEY;
+    if (!e || (e->kind == ExprKind::CMP && e->cmp.col == col && e->cmp.fold == BoundCmp::Fold::ALWAYS)) {
+        bt->range(nullptr, false, nullptr, false, rows, kKey, keep);
+        return true;
+    }
+    if (e->kind != ExprKind::CMP || e->cmp.col != col || e->cmp.op == CmpOp::NE)
+        return false;
+    if (e->cmp.fold == BoundCmp::Fold::NEVER)
+        return true;
+    const Value* v = e->cmp.literal;
+    switch (e->cmp.op) {
+    case CmpOp::EQ:
+        bt->range(v, true, v, true, rows, kKey, keep);
+        break;
+    case CmpOp::LT:
+        bt->range(nullptr, false, v, false, rows, kKey, keep);
+        break;
+    case CmpOp::LE:
+        bt->range(nullptr, false, v, true, rows, kKey, keep);
+        break;
+    case CmpOp::GT:
+        bt->range(v, false, nullptr, false, rows, kKey, keep);
+        break;
+    default: // GE
+        bt->range(v, true, nullptr, false, rows, kKey, keep);
+        break;
+    }
+    return true;
+}
+
+} // namespace
+
+std::vector<size_t> orderRows(const Table& t, const BoundExpr* e, int col, bool desc, size_t keep, ThreadPool* pool) {
+    if (keep == 0)
+        return {};
+    if (std::vector<size_t> rows; orderByIndex(t, e, col, desc, keep, rows))
+        return rows;
+    if (t.columns[col].dict) { // ranks order like the strings
+        const uint32_t* rank = t.dicts[col].ranks();
+        return order<long long>(t, e, desc, keep, pool, [&](size_t r) { return rank[t.codeAt(r, col)]; });
+    }
+    if (t.columns[col].type == ColType::STR)
+        return order<std::string_view>(t, e, desc, keep, pool, [&](size_t r) { return t.strAt(r, col); });
+    if (t.layout == Layout::COLUMNAR) {
+        const long long* v = t.cols[col].ints.data();
+        return order<long long>(t, e, desc, keep, pool, [v](size_t r) { return v[r]; });
+    }
+    return order<long long>(t, e, desc, keep, pool, [&](size_t r) { return t.intAt(r, col); });
+}
+
+} // namespace imd
@@ -3,10 +3,18 @@
 
 namespace imd {
 
-Parser::Parser(std::string src) : lx_(std::move(src)) {
+Parser::Parser(std::string src) : src_(std::move(src)), lx_(src_) {
     cur_ = lx_.next();
 }
 
+Parser::Parser(std::string_view src) : lx_(src) {
+    cur_ = lx_.next();
+}
+
+Parser::Parser(std::vector<Token> tokens) : lx_(std::string_view{}), toks_(std::move(tokens)) {
+    advance();
+}
+
 bool Parser::accept(TokType t) {
     if (cur_.type == t) {
         advance();
@@ -29,59 +37,137 @@ void Parser::expectWord(const char* w, const char* msg) {
 
 std::string Parser::parseIdent(const char* what) {
     if (cur_.type == TokType::Ident && !isUpperKeyword(cur_.text) && !isTypeWord(cur_.text)) {
-        std::string s = cur_.text;
+        std::string s(cur_.text);
         advance();
         return s;
     }
     throw std::runtime_error(std::string("Expected identifier for ") + what);
 }
 
-Value Parser::parseLiteral() {
+std::string Parser::parseColumn(const char* what) {
+    std::string s = parseIdent(what);
+    if (accept(TokType::Dot))
+        s += "." + parseIdent(what);
+    return s;
+}
+
+Value Parser::parseLiteral(int* param) {
+    if (cur_.type == TokType::Question) {
+        if (!param || nParams_ < 0)
+            throw std::runtime_error("'?' placeholder is only allowed in PREPARE");
+        *param = nParams_++;
+        advance();
+        return Value{};
+    }
     if (cur_.type == TokType::Number) {
-        long long x = std::stoll(cur_.text);
+        long long x = parseInt(cur_.text);
         advance();
         return Value::makeInt(x);
     }
     if (cur_.type == TokType::String) {
-        std::string s = cur_.text;
+        Value v = Value::makeStr(cur_.text);
         advance();
-        return Value::makeStr(std::move(s));
+        return v;
     }
     throw std::runtime_error("Expected literal (number or \"string\")");
 }
 
-CreateStmt Parser::parseCreate() {
+Statement Parser::parseCreate() {
     expectWord("CREATE", "Expected CREATE");
+    if (acceptWord("INDEX"))
+        return parseCreateIndex();
     expectWord("TABLE", "Expected TABLE");
     CreateStmt s;
     s.table = parseIdent("table");
     expect(TokType::LParen, "Expected '('");
 
-    // First column
-    {
+    // name type [DICT], at least one
+    do {
         std::string cname = parseIdent("column");
         if (!(cur_.type == TokType::Ident && isTypeWord(cur_.text)))
             throw std::runtime_error("Expected type int or str after column name");
-        ColType ct = (cur_.text == "int") ? ColType::INT : ColType::STR;
+        const ColType ct = (cur_.text == "int") ? ColType::INT : ColType::STR;
         advance();
-        s.columns.push_back({std::move(cname), ct});
-
-        // Additional columns
-        while (accept(TokType::Comma)) {
-            cname = parseIdent("column");
-            if (!(cur_.type == TokType::Ident && isTypeWord(cur_.text)))
-                throw std::runtime_error("Expected type int or str after column name");
-            ct = (cur_.text == "int") ? ColType::INT : ColType::STR;
-            advance();
-            s.columns.push_back({std::move(cname), ct});
-        }
-    }
+        const bool dict = acceptWord("DICT");
+        if (dict && ct != ColType::STR)
+            throw std::runtime_error("DICT applies only to str columns");
+        s.columns.push_back({std::move(cname), ct, dict});
+    } while (accept(TokType::Comma));
 
     // Require closing ')'
     expect(TokType::RParen, "Expected ')' after column list");
+
+    // Optional storage layout
+    if (acceptWord("USING")) {
+        if (acceptWord("COLUMNAR"))
+            s.layout = Layout::COLUMNAR;
+        else if (acceptWord("ROW"))
+            s.layout = Layout::ROW;
+        else
+            throw std::runtime_error("Expected ROW or COLUMNAR after USING");
+    }
     return s;
 }
 
+// CREATE INDEX <name> ON <table> ( <column> ) [USING HASH | USING BTREE]   (CREATE INDEX already consumed)
+CreateIndexStmt Parser::parseCreateIndex() {
+    CreateIndexStmt s;
+    s.name = parseIdent("index");
+    expectWord("ON", "Expected ON after index name");
+    s.table = parseIdent("table");
+    expect(TokType::LParen, "Expected '(' after table");
+    s.column = parseIdent("column");
+    expect(TokType::RParen, "Expected ')' after index column");
+    if (acceptWord("USING")) {
+        if (acceptWord("HASH"))
+            s.kind = IndexKind::HASH;
+        else if (acceptWord("BTREE"))
+            s.kind = IndexKind::BTREE;
+        else
+            throw std::runtime_error("Expected HASH or BTREE after USING");
+    }
+    return s;
+}
+
+DropIndexStmt Parser::parseDrop() {
+    expectWord("DROP", "Expected DROP");
+    expectWord("INDEX", "Expected INDEX after DROP");
+    DropIndexStmt s;
+    s.name = parseIdent("index");
+    return s;
+}
+
+// Lexes the tuples after the current token up to the ';' without building
+// them. Every tuple must parse and match the arity and literal kinds of first,
+// so once first binds, no later batch of the statement can fail.
+void Parser::checkRemainingTuples(const InsertStmt& s, const std::vector<Value>& first) const {
+    Lexer lx = lx_;
+    for (Token t = cur_; t.type != TokType::Semicolon; t = lx.next()) {
+        if (t.type != TokType::Comma)
+            throw std::runtime_error(t.type == TokType::End ? "Expected ';' after statement" : "Expected ')'");
+        if ((t = lx.next()).type != TokType::LParen)
+            throw std::runtime_error("Expected '(' before row");
+        size_t k = 0;
+        do {
+            t = lx.next();
+            if (t.type == TokType::Question)
+                throw std::runtime_error("'?' placeholder is only allowed in PREPARE");
+            if (t.type != TokType::Number && t.type != TokType::String)
+                throw std::runtime_error("Expected literal (number or \"string\")");
+            if (t.type == TokType::Number)
+                parseInt(t.text); // range check
+            if (k < first.size() && k < s.cols.size() && first[k].isInt() != (t.type == TokType::Number))
+                throw std::runtime_error(std::string("Type error: expected ") + (first[k].isInt() ? "int" : "str") +
+                                         " for column '" + s.cols[k] + "'");
+            ++k;
+        } while ((t = lx.next()).type == TokType::Comma);
+        if (t.type != TokType::RParen)
+            throw std::runtime_error("Expected ')'");
+        if (k != s.cols.size())
+            throw std::runtime_error("VALUES count does not match column list");
+    }
+}
+
 InsertStmt Parser::parseInsert() {
     expectWord("INSERT", "Expected INSERT");
     expectWord("INTO", "Expected INTO");
@@ -93,15 +179,39 @@ InsertStmt Parser::parseInsert() {
     } while (accept(TokType::Comma));
     expect(TokType::RParen, "Expected ')'");
     expectWord("VALUES", "Expected VALUES");
+    const bool stream = insertSink_ && nParams_ < 0;
+    const size_t valuesBegin = cur_.pos;
+    const size_t stmtEnd = stream ? statementEnd(lx_.source(), valuesBegin) : 0;
+    size_t sent = 0;
     do {
         expect(TokType::LParen, "Expected '(' before row");
         std::vector<Value> row;
-        row.push_back(parseLiteral());
-        while (accept(TokType::Comma))
-            row.push_back(parseLiteral());
+        do {
+            int param = -1;
+            row.push_back(parseLiteral(&param));
+            if (param >= 0)
+                s.params.push_back({s.rows.size(), row.size() - 1});
+        } while (accept(TokType::Comma));
         expect(TokType::RParen, "Expected ')'");
         s.rows.push_back(std::move(row));
+        if (stream && s.rows.size() == insertBatch_) {
+            if (sent == 0)
+                checkRemainingTuples(s, s.rows[0]);
+            InsertStmt batch;
+            batch.table = s.table;
+            batch.cols = s.cols;
+            batch.rows.swap(s.rows);
+            batch.part = sent == 0 ? InsertStmt::Part::FIRST : InsertStmt::Part::MIDDLE;
+            sent += batch.rows.size();
+            // extrapolate the tuples still to come from the bytes parsed so far
+            const double bytesPerTuple = static_cast<double>(cur_.pos - valuesBegin) / static_cast<double>(sent);
+            batch.rowsHint = batch.rows.size() + static_cast<size_t>((stmtEnd - cur_.pos) / bytesPerTuple);
+            insertSink_(std::move(batch));
+            s.rows.reserve(insertBatch_);
+        }
     } while (accept(TokType::Comma));
+    if (sent)
+        s.part = InsertStmt::Part::LAST;
     return s;
 }
 
@@ -111,7 +221,7 @@ DeleteStmt Parser::parseDelete() {
     DeleteStmt s;
     s.table = parseIdent("table");
     if (acceptWord("WHERE"))
-        s.where = parseCondition();
+        s.where = parseExpr();
     return s;
 }
 
@@ -123,14 +233,35 @@ UpdateStmt Parser::parseUpdate() {
     do {
         std::string cname = parseIdent("column");
         expect(TokType::Equal, "Expected '=' in SET");
-        Value v = parseLiteral();
+        int param = -1;
+        Value v = parseLiteral(&param);
+        if (param >= 0) {
+            s.params.resize(s.assignments.size(), -1);
+            s.params.push_back(param);
+        }
         s.assignments.push_back({std::move(cname), std::move(v)});
     } while (accept(TokType::Comma));
     if (acceptWord("WHERE"))
-        s.where = parseCondition();
+        s.where = parseExpr();
     return s;
 }
 
+static bool aggregateWord(std::string_view w, AggFn& fn) {
+    static const std::pair<const char*, AggFn> words[] = {
+        {"COUNT", AggFn::COUNT}, {"SUM", AggFn::SUM}, {"MIN", AggFn::MIN}, {"MAX", AggFn::MAX}, {"AVG", AggFn::AVG}};
+    for (const auto& [word, f] : words)
+        if (w == word) {
+            fn = f;
+            return true;
+        }
+    return false;
+}
+
+// SELECT * | <item> [, <item> ...] FROM <table> [JOIN <table> ON <column> = <column>]
+//        [WHERE <expr>] [GROUP BY <column>]
+//        [ORDER BY <column> [ASC | DESC]] [LIMIT <n> [OFFSET <m>]]
+// where an item is a column or COUNT(*) / COUNT|SUM|MIN|MAX|AVG(<column>).
+// Aggregate names are not reserved: without '(' they are column names.
 SelectStmt Parser::parseSelect() {
     expectWord("SELECT", "Expected SELECT");
     SelectStmt s;
@@ -138,20 +269,101 @@ SelectStmt Parser::parseSelect() {
         s.selectAll = true;
     } else {
         s.selectAll = false;
-        s.cols.push_back(parseIdent("column"));
-        while (accept(TokType::Comma))
-            s.cols.push_back(parseIdent("column"));
+        do {
+            AggFn fn;
+            if (cur_.type == TokType::Ident && aggregateWord(cur_.text, fn)) {
+                std::string word(cur_.text);
+                advance();
+                if (!accept(TokType::LParen)) {
+                    s.cols.push_back(std::move(word));
+                    continue;
+                }
+                Aggregate a{fn, {}, s.cols.size() + s.aggregates.size()};
+                if (!(fn == AggFn::COUNT && accept(TokType::Star)))
+                    a.column = parseColumn("aggregate column");
+                expect(TokType::RParen, "Expected ')' after aggregate column");
+                s.aggregates.push_back(std::move(a));
+                continue;
+            }
+            s.cols.push_back(parseColumn("column"));
+        } while (accept(TokType::Comma));
     }
     expectWord("FROM", "Expected FROM");
     s.table = parseIdent("table");
+    if (acceptWord("JOIN")) {
+        JoinClause j;
+        j.table = parseIdent("table");
+        expectWord("ON", "Expected ON after JOIN table");
+        j.left = parseColumn("JOIN column");
+        expect(TokType::Equal, "Expected '=' in JOIN condition");
+        j.right = parseColumn("JOIN column");
+        s.join = std::move(j);
+    }
     if (acceptWord("WHERE"))
-        s.where = parseCondition();
+        s.where = parseExpr();
+    if (acceptWord("GROUP")) {
+        expectWord("BY", "Expected BY after GROUP");
+        s.groupBy = parseColumn("GROUP BY column");
+    }
+    if (acceptWord("ORDER")) {
+        expectWord("BY", "Expected BY after ORDER");
+        s.orderBy = parseColumn("ORDER BY column");
+        if (!acceptWord("ASC"))
+            s.desc = acceptWord("DESC");
+    }
+    if (acceptWord("LIMIT")) {
+        s.limit = parseLiteral(&s.limitParam);
+        if (acceptWord("OFFSET"))
+            s.offset = parseLiteral(&s.offsetParam);
+    }
     return s;
 }
 
+// Precedence: NOT binds tighter than AND, AND tighter than OR.
+Expr Parser::parseExpr() {
+    Expr first = parseAnd();
+    if (!(cur_.type == TokType::Ident && cur_.text == "OR"))
+        return first;
+    Expr e;
+    e.kind = ExprKind::OR;
+    e.kids.push_back(std::move(first));
+    while (acceptWord("OR"))
+        e.kids.push_back(parseAnd());
+    return e;
+}
+
+Expr Parser::parseAnd() {
+    Expr first = parseNot();
+    if (!(cur_.type == TokType::Ident && cur_.text == "AND"))
+        return first;
+    Expr e;
+    e.kind = ExprKind::AND;
+    e.kids.push_back(std::move(first));
+    while (acceptWord("AND"))
+        e.kids.push_back(parseNot());
+    return e;
+}
+
+Expr Parser::parseNot() {
+    if (acceptWord("NOT")) {
+        Expr e;
+        e.kind = ExprKind::NOT;
+        e.kids.push_back(parseNot());
+        return e;
+    }
+    if (accept(TokType::LParen)) {
+        Expr e = parseExpr();
+        expect(TokType::RParen, "Expected ')' in WHERE");
+        return e;
+    }
+    Expr e;
+    e.cmp = parseCondition();
+    return e;
+}
+
 Condition Parser::parseCondition() {
     Condition c;
-    c.column = parseIdent("WHERE column");
+    c.column = parseColumn("WHERE column");
     if (accept(TokType::Equal)) {
         c.op = CmpOp::EQ;
     } else if (accept(TokType::NotEqual)) {
@@ -166,31 +378,130 @@ Condition Parser::parseCondition() {
         c.op = CmpOp::GT;
     } else
         throw std::runtime_error("Expected comparison operator (=, !=, <, <=, >, >=) in WHERE");
-    c.literal = parseLiteral();
+    c.literal = parseLiteral(&c.param);
     return c;
 }
 
+// PREPARE <name> AS <INSERT | DELETE | UPDATE | SELECT>
+PrepareStmt Parser::parsePrepare() {
+    expectWord("PREPARE", "Expected PREPARE");
+    PrepareStmt s;
+    s.name = parseIdent("prepared statement");
+    expectWord("AS", "Expected AS after prepared statement name");
+    s.body = std::make_shared<PreparedBody>(parseWithParams());
+    return s;
+}
+
+ExecuteStmt Parser::parseExecute() {
+    expectWord("EXECUTE", "Expected EXECUTE");
+    ExecuteStmt s;
+    s.name = parseIdent("prepared statement");
+    if (accept(TokType::LParen)) {
+        do {
+            s.args.push_back(parseLiteral());
+        } while (accept(TokType::Comma));
+        expect(TokType::RParen, "Expected ')' after EXECUTE arguments");
+    }
+    return s;
+}
+
+DeallocateStmt Parser::parseDeallocate() {
+    expectWord("DEALLOCATE", "Expected DEALLOCATE");
+    DeallocateStmt s;
+    s.name = parseIdent("prepared statement");
+    return s;
+}
+
+// COPY <table> FROM | TO "<path>"
+CopyStmt Parser::parseCopy() {
+    expectWord("COPY", "Expected COPY");
+    CopyStmt s;
+    s.table = parseIdent("table");
+    if (acceptWord("TO"))
+        s.from = false;
+    else
+        expectWord("FROM", "Expected FROM or TO after COPY table");
+    s.path = parsePath("COPY");
+    return s;
+}
+
+std::string Parser::parsePath(const char* stmt) {
+    if (cur_.type != TokType::String)
+        throw std::runtime_error(std::string("Expected quoted file path after ") + stmt);
+    std::string path(cur_.text);
+    advance();
+    return path;
+}
+
+Statement Parser::parseStatement() {
+    if (cur_.type != TokType::Ident || !isUpperKeyword(cur_.text))
+        throw std::runtime_error("Expected a statement keyword (CREATE/INSERT/DELETE/SELECT/UPDATE/DROP/COPY/"
+                                 "SAVE/LOAD/BGSAVE/PREPARE/EXECUTE/DEALLOCATE)");
+    const std::string_view kw = cur_.text;
+    if (kw == "CREATE")
+        return parseCreate();
+    if (kw == "INSERT")
+        return parseInsert();
+    if (kw == "DELETE")
+        return parseDelete();
+    if (kw == "UPDATE")
+        return parseUpdate();
+    if (kw == "SELECT")
+        return parseSelect();
+    if (kw == "DROP")
+        return parseDrop();
+    if (nParams_ < 0) {
+        if (kw == "PREPARE")
+            return parsePrepare();
+        if (kw == "EXECUTE")
+            return parseExecute();
+        if (kw == "DEALLOCATE")
+            return parseDeallocate();
+        if (kw == "COPY")
+            return parseCopy();
+        if (acceptWord("SAVE"))
+            return SaveStmt{parsePath("SAVE")};
+        if (acceptWord("LOAD"))
+            return LoadStmt{parsePath("LOAD")};
+        if (acceptWord("BGSAVE")) {
+            if (acceptWord("STATUS"))
+                return BgSaveStmt{"", true};
+            return BgSaveStmt{parsePath("BGSAVE"), false};
+        }
+    }
+    throw std::runtime_error("Unsupported statement");
+}
+
+bool Parser::next(Statement& out) {
+    if (cur_.type == TokType::End)
+        return false;
+    out = parseStatement();
+    expect(TokType::Semicolon, "Expected ';' after statement");
+    return true;
+}
+
 std::vector<Statement> Parser::parseAll() {
     std::vector<Statement> out;
-    while (cur_.type != TokType::End) {
-        if (cur_.type != TokType::Ident || !isUpperKeyword(cur_.text))
-            throw std::runtime_error("Expected a statement keyword (CREATE/INSERT/DELETE/SELECT/UPDATE)");
-        std::string kw = cur_.text;
-        if (kw == "CREATE")
-            out.push_back(parseCreate());
-        else if (kw == "INSERT")
-            out.push_back(parseInsert());
-        else if (kw == "DELETE")
-            out.push_back(parseDelete());
-        else if (kw == "UPDATE")
-            out.push_back(parseUpdate());
-        else if (kw == "SELECT")
-            out.push_back(parseSelect());
-        else
-            throw std::runtime_error("Unsupported statement");
-        expect(TokType::Semicolon, "Expected ';' after statement");
-    }
+    for (Statement st; next(st);)
+        out.push_back(std::move(st));
     return out;
 }
 
+PreparedBody Parser::parseWithParams() {
+    PreparedBody b;
+    nParams_ = 0;
+    b.stmt = parseStatement();
+    b.params = static_cast<size_t>(nParams_);
+    nParams_ = -1;
+    return b;
+}
+
+PreparedBody Parser::parseTemplate() {
+    PreparedBody b = parseWithParams();
+    accept(TokType::Semicolon);
+    if (cur_.type != TokType::End)
+        throw std::runtime_error("Expected end of statement");
+    return b;
+}
+
 } // namespace imd
@@ -0,0 +1,84 @@
+﻿#include "imd/prepared.hpp"
+#include <stdexcept>
+
+namespace imd {
+
+// ----- PreparedStmt -----
+static void collectSlots(Expr& e, std::vector<Value*>& slots) {
+    if (e.kind == ExprKind::CMP) {
+        if (e.cmp.param >= 0)
+            slots[e.cmp.param] = &e.cmp.literal;
+        return;
+    }
+    for (auto& k : e.kids)
+        collectSlots(k, slots);
+}
+
+PreparedStmt::PreparedStmt(PreparedBody body) : stmt_(std::move(body.stmt)), slots_(body.params, nullptr) {
+    if (auto* s = std::get_if<InsertStmt>(&stmt_)) {
+        for (size_t k = 0; k < s->params.size(); ++k)
+            slots_[k] = &s->rows[s->params[k].first][s->params[k].second];
+    } else if (auto* s = std::get_if<UpdateStmt>(&stmt_)) {
+        for (size_t k = 0; k < s->params.size(); ++k)
+            if (s->params[k] >= 0)
+                slots_[s->params[k]] = &s->assignments[k].second;
+        if (s->where)
+            collectSlots(*s->where, slots_);
+    } else if (auto* s = std::get_if<DeleteStmt>(&stmt_)) {
+        if (s->where)
+            collectSlots(*s->where, slots_);
+    } else if (auto* s = std::get_if<SelectStmt>(&stmt_)) {
+        if (s->where)
+            collectSlots(*s->where, slots_);
+        if (s->limitParam >= 0)
+            slots_[s->limitParam] = &*s->limit;
+        if (s->offsetParam >= 0)
+            slots_[s->offsetParam] = &s->offset;
+    } else {
+        throw std::runtime_error("PREPARE supports INSERT, DELETE, UPDATE and SELECT");
+    }
+}
+
+const Statement& PreparedStmt::bind(std::vector<Value>&& args) {
+    if (args.size() != slots_.size())
+        throw std::runtime_error("Expected " + std::to_string(slots_.size()) + " parameter(s), got " +
+                                 std::to_string(args.size()));
+    for (size_t k = 0; k < args.size(); ++k)
+        *slots_[k] = std::move(args[k]);
+    return stmt_;
+}
+
+// ----- PlanCache -----
+PreparedStmt* PlanCache::find(const std::string& key) {
+    auto it = map_.find(key);
+    if (it == map_.end()) {
+        ++misses_;
+        return nullptr;
+    }
+    ++hits_;
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return it->second->second.get();
+}
+
+PreparedStmt& PlanCache::insert(const std::string& key, std::unique_ptr<PreparedStmt> plan) {
+    auto it = map_.find(key);
+    if (it != map_.end()) {
+        it->second->second = std::move(plan);
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return *lru_.front().second;
+    }
+    lru_.emplace_front(key, std::move(plan));
+    map_.emplace(key, lru_.begin());
+    while (map_.size() > cap_) {
+        map_.erase(lru_.back().first);
+        lru_.pop_back();
+    }
+    return *lru_.front().second;
+}
+
+void PlanCache::clear() {
+    map_.clear();
+    lru_.clear();
+}
+
+} // namespace imd
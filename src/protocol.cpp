@@ -0,0 +1,253 @@
+﻿#include "imd/protocol.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace imd {
+
+void putVarint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+bool getVarint(std::string_view& in, uint64_t& v) {
+    v = 0;
+    for (size_t i = 0; i < in.size() && i < 10; ++i) {
+        const auto b = static_cast<unsigned char>(in[i]);
+        v |= uint64_t(b & 0x7f) << (7 * i);
+        if (!(b & 0x80)) {
+            in.remove_prefix(i + 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint64_t zigzag(long long v) {
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+static long long unzigzag(uint64_t v) {
+    return static_cast<long long>(v >> 1) ^ -static_cast<long long>(v & 1);
+}
+
+// ----- Frames -----
+void appendFrame(std::string& out, std::string_view payload) {
+    if (payload.size() > kMaxFrame)
+        throw std::runtime_error("Frame of " + std::to_string(payload.size()) + " bytes exceeds the limit");
+    const auto n = static_cast<uint32_t>(payload.size());
+    for (int k = 0; k < 4; ++k)
+        out.push_back(static_cast<char>(n >> (8 * k)));
+    out.append(payload);
+}
+
+void appendRequest(std::string& out, std::string_view sql) {
+    if (sql.size() >= kMaxFrame)
+        throw std::runtime_error("Request of " + std::to_string(sql.size()) + " bytes exceeds the frame limit");
+    const auto n = static_cast<uint32_t>(sql.size() + 1);
+    for (int k = 0; k < 4; ++k)
+        out.push_back(static_cast<char>(n >> (8 * k)));
+    out.push_back('Q');
+    out.append(sql);
+}
+
+bool nextFrame(std::string_view buf, size_t& off, std::string_view& payload) {
+    if (buf.size() - off < 4)
+        return false;
+    uint32_t n = 0;
+    for (int k = 0; k < 4; ++k)
+        n |= uint32_t(static_cast<unsigned char>(buf[off + k])) << (8 * k);
+    if (n > kMaxFrame)
+        throw std::runtime_error("Frame of " + std::to_string(n) + " bytes exceeds the limit");
+    if (buf.size() - off - 4 < n)
+        return false;
+    payload = buf.substr(off + 4, n);
+    off += 4 + n;
+    return true;
+}
+
+bool nextResponse(std::string_view buf, size_t& off, std::string& payload) {
+    size_t end = off;
+    std::string_view frame;
+    do {
+        if (!nextFrame(buf, end, frame))
+            return false;
+        if (frame.empty())
+            throw std::runtime_error("Malformed response");
+    } while (frame.front() == 'R');
+    payload.clear();
+    for (size_t at = off; at < end;) {
+        nextFrame(buf, at, frame);
+        payload.append(frame.front() == 'R' ? frame.substr(1) : frame);
+    }
+    off = end;
+    return true;
+}
+
+// ----- Binary result sink -----
+namespace {
+
+class BinarySink : public ResultSink {
+  public:
+    explicit BinarySink(std::ostream& os) : os_(os) {}
+    void begin(const std::vector<std::string>& headers, const std::vector<ColType>& types) override {
+        buf_.assign(1, 'T');
+        putVarint(buf_, headers.size());
+        for (size_t j = 0; j < headers.size(); ++j) {
+            buf_.push_back(types[j] == ColType::INT ? 0 : 1);
+            putVarint(buf_, headers[j].size());
+            buf_ += headers[j];
+        }
+        types_ = types;
+        rows_ = 0;
+        flush();
+    }
+    void row(const std::vector<Value>& cells, const std::vector<uint8_t>* nulls) override {
+        const bool anyNull = nulls && std::find(nulls->begin(), nulls->end(), 1) != nulls->end();
+        buf_.push_back(anyNull ? 'N' : 'D');
+        if (anyNull) {
+            const size_t at = buf_.size();
+            buf_.append((cells.size() + 7) / 8, '\0');
+            for (size_t j = 0; j < cells.size(); ++j)
+                if ((*nulls)[j])
+                    buf_[at + j / 8] = static_cast<char>(buf_[at + j / 8] | (1 << (j % 8)));
+        }
+        for (size_t j = 0; j < cells.size(); ++j) {
+            if (anyNull && (*nulls)[j])
+                continue;
+            if (types_[j] == ColType::INT) {
+                putVarint(buf_, zigzag(cells[j].asInt()));
+            } else {
+                const std::string_view s = cells[j].asStr();
+                putVarint(buf_, s.size());
+                buf_ += s;
+            }
+        }
+        ++rows_;
+        if (buf_.size() >= 64 * 1024)
+            flush();
+    }
+    void end() override {
+        buf_.push_back('E');
+        putVarint(buf_, rows_);
+        flush();
+    }
+
+  private:
+    std::ostream& os_;
+    std::string buf_; // encoded, not yet written to os_
+    std::vector<ColType> types_;
+    uint64_t rows_ = 0;
+
+    void flush() {
+        os_.write(buf_.data(), static_cast<std::streamsize>(buf_.size()));
+        buf_.clear();
+    }
+};
+
+} // namespace
+
+std::unique_ptr<ResultSink> makeBinarySink(std::ostream& out) {
+    return std::make_unique<BinarySink>(out);
+}
+
+// ----- Decoding -----
+static uint64_t need(std::string_view& in) {
+    uint64_t v;
+    if (!getVarint(in, v))
+        throw std::runtime_error("Truncated response");
+    return v;
+}
+
+static std::string needBytes(std::string_view& in) {
+    const uint64_t n = need(in);
+    if (n > in.size())
+        throw std::runtime_error("Truncated response");
+    std::string s(in.substr(0, n));
+    in.remove_prefix(n);
+    return s;
+}
+
+Response decodeResponse(std::string_view in) {
+    Response r;
+    while (!in.empty()) {
+        const char tag = in.front();
+        in.remove_prefix(1);
+        if (tag == 'K' || tag == '!') {
+            r.failed = tag == '!';
+            if (r.failed)
+                r.error = std::string(in);
+            return r;
+        }
+        if (tag != 'T')
+            throw std::runtime_error("Malformed response");
+        ResultSet rs;
+        const uint64_t ncols = need(in);
+        for (uint64_t j = 0; j < ncols; ++j) {
+            if (in.empty())
+                throw std::runtime_error("Truncated response");
+            rs.types.push_back(in.front() == 0 ? ColType::INT : ColType::STR);
+            in.remove_prefix(1);
+            rs.headers.push_back(needBytes(in));
+        }
+        for (;;) {
+            if (in.empty())
+                throw std::runtime_error("Truncated response");
+            const char t = in.front();
+            in.remove_prefix(1);
+            if (t == 'E') {
+                if (need(in) != rs.rows.size())
+                    throw std::runtime_error("Malformed response: row count mismatch");
+                break;
+            }
+            if (t != 'D' && t != 'N')
+                throw std::runtime_error("Malformed response");
+            auto& row = rs.rows.emplace_back();
+            auto& nulls = rs.nulls.emplace_back();
+            if (t == 'N') {
+                const size_t bytes = static_cast<size_t>((ncols + 7) / 8);
+                if (in.size() < bytes)
+                    throw std::runtime_error("Truncated response");
+                for (uint64_t j = 0; j < ncols; ++j)
+                    nulls.push_back((static_cast<unsigned char>(in[j / 8]) >> (j % 8)) & 1);
+                in.remove_prefix(bytes);
+            }
+            for (uint64_t j = 0; j < ncols; ++j) {
+                if (!nulls.empty() && nulls[j])
+                    row.push_back("NULL");
+                else
+                    row.push_back(rs.types[j] == ColType::INT ? std::to_string(unzigzag(need(in))) : needBytes(in));
+            }
+        }
+        r.results.push_back(std::move(rs));
+    }
+    throw std::runtime_error("Truncated response");
+}
+
+// ----- Endpoints -----
+Endpoint parseEndpoint(std::string_view spec) {
+    Endpoint e;
+    if (spec.substr(0, 5) == "unix:") {
+        e.isUnix = true;
+        e.path = std::string(spec.substr(5));
+        if (e.path.empty())
+            throw std::runtime_error("Empty socket path in " + std::string(spec));
+        return e;
+    }
+    const size_t colon = spec.rfind(':');
+    if (colon == std::string_view::npos || colon == 0 || colon + 1 == spec.size())
+        throw std::runtime_error("Expected unix:/path or host:port, got " + std::string(spec));
+    e.host = std::string(spec.substr(0, colon));
+    const std::string port(spec.substr(colon + 1));
+    char* endp = nullptr;
+    const long p = std::strtol(port.c_str(), &endp, 10);
+    if (*endp || p < 0 || p > 65535)
+        throw std::runtime_error("Invalid port: " + port);
+    e.port = static_cast<uint16_t>(p);
+    return e;
+}
+
+} // namespace imd
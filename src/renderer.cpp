@@ -1,5 +1,7 @@
 ﻿#include "imd/renderer.hpp"
+#include "imd/protocol.hpp"
 #include <algorithm>
+#include <charconv>
 #include <iomanip>
 #include <ostream>
 #include <string>
@@ -54,9 +56,9 @@ void printAscii(const std::vector<std::string>& headers, const std::vector<std::
     os << rows.size() << " row(s)." << '\n';
 }
 
-static std::string csvEscape(const std::string& s) {
-    if (s.find_first_of(",\"\n\r") == std::string::npos)
-        return s;
+std::string csvEscape(std::string_view s) {
+    if (s.find_first_of(",\"\n\r") == std::string_view::npos)
+        return std::string(s);
     std::string out;
     out.reserve(s.size() + 2);
     out.push_back('"');
@@ -88,4 +90,241 @@ void printCsv(const std::vector<std::string>& headers, const std::vector<std::ve
     }
 }
 
+// ----- Sinks -----
+bool parseFormat(std::string_view name, OutputFormat& out) {
+    for (OutputFormat f : {OutputFormat::ASCII, OutputFormat::CSV, OutputFormat::TSV, OutputFormat::JSONL}) {
+        if (name == formatName(f)) {
+            out = f;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* formatName(OutputFormat f) {
+    switch (f) {
+    case OutputFormat::CSV:
+        return "csv";
+    case OutputFormat::TSV:
+        return "tsv";
+    case OutputFormat::JSONL:
+        return "jsonl";
+    case OutputFormat::BINARY:
+        return "binary";
+    default:
+        return "ascii";
+    }
+}
+
+namespace {
+
+// Text of a cell; an int is formatted into buf.
+std::string_view cellText(const Value& v, char (&buf)[24]) {
+    if (v.isStr())
+        return v.asStr();
+    const auto r = std::to_chars(buf, buf + sizeof(buf), v.asInt());
+    return std::string_view(buf, static_cast<size_t>(r.ptr - buf));
+}
+
+// Results up to kSample rows print exactly as printAscii would. Larger ones
+// take widths from the first kSample rows; wider cells later overflow their column.
+class AsciiSink : public ResultSink {
+  public:
+    explicit AsciiSink(std::ostream& os) : os_(os) {}
+
+    void begin(const std::vector<std::string>& headers, const std::vector<ColType>&) override {
+        headers_ = headers;
+    }
+    void row(const std::vector<Value>& cells, const std::vector<uint8_t>*) override {
+        ++count_;
+        std::vector<std::string> text;
+        text.reserve(cells.size());
+        for (const auto& v : cells)
+            text.push_back(v.toString());
+        if (streaming_) {
+            printOneRow(text, w_, os_);
+            return;
+        }
+        sample_.push_back(std::move(text));
+        if (sample_.size() == kSample)
+            flushSample();
+    }
+    void end() override {
+        if (!streaming_)
+            flushSample();
+        printBorder(w_, os_);
+        os_ << count_ << " row(s)." << '\n';
+    }
+
+  private:
+    static constexpr size_t kSample = 4096;
+    std::ostream& os_;
+    std::vector<std::string> headers_;
+    std::vector<std::vector<std::string>> sample_;
+    std::vector<size_t> w_;
+    size_t count_ = 0;
+    bool streaming_ = false;
+
+    void flushSample() {
+        w_ = colWidths(headers_, sample_);
+        printBorder(w_, os_);
+        printOneRow(headers_, w_, os_);
+        printBorder(w_, os_);
+        for (const auto& r : sample_)
+            printOneRow(r, w_, os_);
+        sample_.clear();
+        sample_.shrink_to_fit();
+        streaming_ = true;
+    }
+};
+
+class CsvSink : public ResultSink {
+  public:
+    explicit CsvSink(std::ostream& os) : os_(os) {}
+    void begin(const std::vector<std::string>& headers, const std::vector<ColType>&) override {
+        for (size_t j = 0; j < headers.size(); ++j)
+            field(j, headers[j]);
+        os_ << '\n';
+    }
+    void row(const std::vector<Value>& cells, const std::vector<uint8_t>*) override {
+        char buf[24];
+        for (size_t j = 0; j < cells.size(); ++j)
+            field(j, cellText(cells[j], buf));
+        os_ << '\n';
+    }
+    void end() override {
+        os_.flush();
+    }
+
+  private:
+    std::ostream& os_;
+
+    void field(size_t j, std::string_view s) {
+        if (j)
+            os_.put(',');
+        os_ << csvEscape(s);
+    }
+};
+
+// Tab-separated; tab, newline, CR and backslash are written as \t \n \r \\.
+class TsvSink : public ResultSink {
+  public:
+    explicit TsvSink(std::ostream& os) : os_(os) {}
+    void begin(const std::vector<std::string>& headers, const std::vector<ColType>&) override {
+        for (size_t j = 0; j < headers.size(); ++j)
+            field(j, headers[j]);
+        os_ << '\n';
+    }
+    void row(const std::vector<Value>& cells, const std::vector<uint8_t>*) override {
+        char buf[24];
+        for (size_t j = 0; j < cells.size(); ++j)
+            field(j, cellText(cells[j], buf));
+        os_ << '\n';
+    }
+    void end() override {
+        os_.flush();
+    }
+
+  private:
+    std::ostream& os_;
+
+    void field(size_t j, std::string_view s) {
+        if (j)
+            os_.put('\t');
+        for (char c : s) {
+            switch (c) {
+            case '\t':
+                os_ << "\\t";
+                break;
+            case '\n':
+                os_ << "\\n";
+                break;
+            case '\r':
+                os_ << "\\r";
+                break;
+            case '\\':
+                os_ << "\\\\";
+                break;
+            default:
+                os_.put(c);
+            }
+        }
+    }
+};
+
+// One JSON object per row; INT columns are numbers, STR columns strings, NULL cells null.
+class JsonLinesSink : public ResultSink {
+  public:
+    explicit JsonLinesSink(std::ostream& os) : os_(os) {}
+    void begin(const std::vector<std::string>& headers, const std::vector<ColType>& types) override {
+        keys_.clear();
+        for (const auto& h : headers)
+            keys_.push_back(quote(h) + ':');
+        types_ = types;
+    }
+    void row(const std::vector<Value>& cells, const std::vector<uint8_t>* nulls) override {
+        char buf[24];
+        os_.put('{');
+        for (size_t j = 0; j < cells.size(); ++j) {
+            if (j)
+                os_.put(',');
+            os_ << keys_[j];
+            if (nulls && (*nulls)[j])
+                os_ << "null";
+            else if (types_[j] == ColType::INT)
+                os_ << cellText(cells[j], buf);
+            else
+                os_ << quote(cellText(cells[j], buf));
+        }
+        os_ << "}\n";
+    }
+    void end() override {
+        os_.flush();
+    }
+
+  private:
+    std::ostream& os_;
+    std::vector<std::string> keys_; // "name":
+    std::vector<ColType> types_;
+
+    static std::string quote(std::string_view s) {
+        static const char* hex = "0123456789abcdef";
+        std::string out;
+        out.reserve(s.size() + 2);
+        out.push_back('"');
+        for (char ch : s) {
+            const unsigned char c = static_cast<unsigned char>(ch);
+            if (c == '"' || c == '\\') {
+                out.push_back('\\');
+                out.push_back(ch);
+            } else if (c < 0x20) {
+                out += "\\u00";
+                out.push_back(hex[c >> 4]);
+                out.push_back(hex[c & 15]);
+            } else {
+                out.push_back(ch);
+            }
+        }
+        out.push_back('"');
+        return out;
+    }
+};
+
+} // namespace
+
+std::unique_ptr<ResultSink> makeSink(OutputFormat f, std::ostream& out) {
+    switch (f) {
+    case OutputFormat::CSV:
+        return std::make_unique<CsvSink>(out);
+    case OutputFormat::TSV:
+        return std::make_unique<TsvSink>(out);
+    case OutputFormat::JSONL:
+        return std::make_unique<JsonLinesSink>(out);
+    case OutputFormat::BINARY:
+        return makeBinarySink(out);
+    default:
+        return std::make_unique<AsciiSink>(out);
+    }
+}
+
 } // namespace imd
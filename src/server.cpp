@@ -0,0 +1,458 @@
+﻿#include "imd/server.hpp"
+#include "imd/concurrent.hpp"
+#include "imd/executor.hpp"
+#include "imd/protocol.hpp"
+#include <cerrno>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <streambuf>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace imd {
+
+#ifndef __linux__
+Server::Server(ConcurrentDatabase& db, ServerOptions opts) : db_(db), opts_(std::move(opts)) {
+    throw std::runtime_error("Server mode needs epoll, which this platform lacks");
+}
+Server::~Server() = default;
+void Server::run() {}
+void Server::stop() {}
+#else
+
+// A connection stops reading while this much output is unsent, and its
+// worker stops producing more, so a client that pipelines without reading
+// cannot grow the server's buffers unbounded.
+constexpr size_t kMaxPendingOut = 16u << 20;
+// A connection also stops reading while this many request bytes wait for its session.
+constexpr size_t kMaxQueuedIn = 16u << 20;
+// Result bytes per 'R' frame.
+constexpr size_t kChunk = 256u << 10;
+
+namespace {
+
+// Session output: the result stream is cut into 'R' frames of up to kChunk
+// bytes, each passed to emit as soon as it fills. finish() sends the rest.
+class FrameOut : public std::streambuf {
+  public:
+    std::function<void(std::string&& frame)> emit;
+
+    void finish() {
+        if (buf_.size() > 1)
+            send();
+    }
+
+  protected:
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        for (size_t left = static_cast<size_t>(n); left;) {
+            const size_t take = std::min(left, kChunk + 1 - buf_.size());
+            buf_.append(s, take);
+            s += take;
+            left -= take;
+            if (buf_.size() == kChunk + 1)
+                send();
+        }
+        return n;
+    }
+    int_type overflow(int_type ch) override {
+        if (traits_type::eq_int_type(ch, traits_type::eof()))
+            return traits_type::not_eof(ch);
+        const char c = traits_type::to_char_type(ch);
+        xsputn(&c, 1);
+        return ch;
+    }
+
+  private:
+    std::string buf_ = "R";
+
+    void send() {
+        std::string frame;
+        appendFrame(frame, buf_);
+        buf_.resize(1);
+        emit(std::move(frame));
+    }
+};
+
+} // namespace
+
+struct Server::Conn {
+    int fd;
+    std::string in; // received, not yet parsed
+    size_t inOff = 0;
+    std::vector<std::string> queued; // requests waiting for the session
+    size_t queuedBytes = 0;
+    std::string out; // responses not yet sent
+    size_t outOff = 0;
+    bool busy = false;       // a worker holds the session
+    bool peerClosed = false; // EOF read; close once idle
+    uint32_t events = 0;     // current epoll interest
+
+    // Frames a running job has produced, not yet moved to out by the loop.
+    std::mutex outM;
+    std::condition_variable outCv; // out drained, or the connection closed
+    std::string outbox;
+    size_t unsent = 0;   // out.size() - outOff, as last seen by the loop
+    bool closed = false; // the worker drops what it produces
+
+    // Worker side: the session runs on one worker at a time.
+    std::unique_ptr<Executor> session;
+    FrameOut frames;
+    std::ostream results{&frames};
+
+    explicit Conn(int f) : fd(f) {}
+};
+
+static void fail(const std::string& what) {
+    throw std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+static int listenOn(const Endpoint& e, uint16_t& port) {
+    int fd;
+    if (e.isUnix) {
+        sockaddr_un a{};
+        a.sun_family = AF_UNIX;
+        if (e.path.size() >= sizeof(a.sun_path))
+            throw std::runtime_error("Socket path too long: " + e.path);
+        std::memcpy(a.sun_path, e.path.c_str(), e.path.size() + 1);
+        struct stat st;
+        if (::stat(e.path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+            ::unlink(e.path.c_str()); // left behind by a previous server
+        fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0 || ::bind(fd, reinterpret_cast<sockaddr*>(&a), sizeof(a)) < 0)
+            fail("Cannot bind " + e.path);
+    } else {
+        sockaddr_in a{};
+        a.sin_family = AF_INET;
+        a.sin_port = htons(e.port);
+        if (::inet_pton(AF_INET, e.host.c_str(), &a.sin_addr) != 1)
+            throw std::runtime_error("Expected a numeric IPv4 host, got " + e.host);
+        fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int one = 1;
+        if (fd >= 0)
+            ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (fd < 0 || ::bind(fd, reinterpret_cast<sockaddr*>(&a), sizeof(a)) < 0)
+            fail("Cannot bind " + e.host + ":" + std::to_string(e.port));
+        socklen_t len = sizeof(a);
+        ::getsockname(fd, reinterpret_cast<sockaddr*>(&a), &len);
+        port = ntohs(a.sin_port);
+    }
+    if (::listen(fd, SOMAXCONN) < 0)
+        fail("Cannot listen");
+    return fd;
+}
+
+Server::Server(ConcurrentDatabase& db, ServerOptions opts) : db_(db), opts_(std::move(opts)) {
+    const Endpoint e = parseEndpoint(opts_.listen);
+    listenFd_ = listenOn(e, port_);
+    epollFd_ = ::epoll_create1(EPOLL_CLOEXEC);
+    wakeFd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd_ < 0 || wakeFd_ < 0)
+        fail("Cannot create event loop");
+    for (int fd : {listenFd_, wakeFd_}) {
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        ::epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev);
+    }
+    unsigned n = opts_.workers ? opts_.workers : std::thread::hardware_concurrency();
+    for (unsigned i = 0; i < (n ? n : 1); ++i)
+        workers_.emplace_back([this] { workerLoop(); });
+}
+
+Server::~Server() {
+    {
+        std::lock_guard<std::mutex> lk(jobsM_);
+        quit_ = true;
+    }
+    jobsCv_.notify_all();
+    for (auto& t : workers_)
+        t.join();
+    for (auto& [fd, c] : conns_)
+        ::close(fd);
+    for (int fd : {listenFd_, epollFd_, wakeFd_})
+        if (fd >= 0)
+            ::close(fd);
+    const Endpoint e = parseEndpoint(opts_.listen);
+    if (e.isUnix)
+        ::unlink(e.path.c_str());
+}
+
+void Server::stop() {
+    stop_.store(true);
+    wake();
+}
+
+void Server::wake() {
+    const uint64_t one = 1;
+    [[maybe_unused]] ssize_t r = ::write(wakeFd_, &one, sizeof(one));
+}
+
+void Server::run() {
+    epoll_event evs[256];
+    while (!stop_.load()) {
+        const int n = ::epoll_wait(epollFd_, evs, 256, -1);
+        if (n < 0 && errno != EINTR)
+            fail("epoll_wait");
+        for (int i = 0; i < n; ++i) {
+            const int fd = evs[i].data.fd;
+            if (fd == listenFd_) {
+                acceptAll();
+            } else if (fd == wakeFd_) {
+                uint64_t v;
+                [[maybe_unused]] ssize_t r = ::read(wakeFd_, &v, sizeof(v));
+                finishJobs();
+            } else {
+                auto it = conns_.find(fd);
+                if (it == conns_.end())
+                    continue;
+                const std::shared_ptr<Conn> c = it->second; // close() drops the map's reference
+                if (evs[i].events & (EPOLLHUP | EPOLLERR)) {
+                    close(*c); // both directions are gone: nobody to answer
+                    continue;
+                }
+                if (evs[i].events & EPOLLOUT)
+                    flush(c);
+                if (c->fd >= 0 && (evs[i].events & EPOLLIN))
+                    readFrom(c);
+            }
+        }
+    }
+    while (!conns_.empty())
+        close(*conns_.begin()->second);
+}
+
+void Server::acceptAll() {
+    for (;;) {
+        const int fd = ::accept4(listenFd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return; // EAGAIN, or out of descriptors: the rest wait in the backlog
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // fails harmlessly on Unix sockets
+        auto c = std::make_shared<Conn>(fd);
+        conns_.emplace(fd, c);
+        epoll_event ev{};
+        ev.events = c->events = EPOLLIN;
+        ev.data.fd = fd;
+        ::epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+void Server::watch(Conn& c) {
+    const bool backlog = c.out.size() - c.outOff > kMaxPendingOut || c.queuedBytes > kMaxQueuedIn;
+    uint32_t want = backlog || c.peerClosed ? 0 : uint32_t(EPOLLIN);
+    if (c.outOff < c.out.size())
+        want |= EPOLLOUT;
+    if (want == c.events)
+        return;
+    epoll_event ev{};
+    ev.events = c.events = want;
+    ev.data.fd = c.fd;
+    ::epoll_ctl(epollFd_, EPOLL_CTL_MOD, c.fd, &ev);
+}
+
+void Server::close(Conn& c) {
+    if (c.fd < 0)
+        return;
+    const int fd = c.fd;
+    ::epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+    ::close(fd);
+    c.fd = -1;
+    {
+        std::lock_guard<std::mutex> lk(c.outM);
+        c.closed = true;
+        c.outbox.clear();
+    }
+    c.outCv.notify_all();
+    conns_.erase(fd); // a worker still running the session keeps it alive
+}
+
+// Reads until the socket is drained or enough requests are queued; watch()
+// then leaves EPOLLIN off until the session has caught up.
+void Server::readFrom(const std::shared_ptr<Conn>& c) {
+    char buf[64 * 1024];
+    while (c->queuedBytes <= kMaxQueuedIn) {
+        const ssize_t n = ::recv(c->fd, buf, sizeof(buf), 0);
+        if (n > 0) {
+            c->in.append(buf, static_cast<size_t>(n));
+            try {
+                for (std::string_view payload; nextFrame(c->in, c->inOff, payload);) {
+                    if (payload.empty() || payload.front() != 'Q')
+                        throw std::runtime_error("Unknown request");
+                    c->queued.emplace_back(payload.substr(1));
+                    c->queuedBytes += payload.size();
+                }
+            } catch (const std::exception&) {
+                close(*c); // not speaking the protocol
+                return;
+            }
+            if (c->inOff == c->in.size()) {
+                c->in.clear();
+                c->inOff = 0;
+            } else if (c->inOff > c->in.size() / 2) {
+                c->in.erase(0, c->inOff);
+                c->inOff = 0;
+            }
+            continue;
+        }
+        if (n == 0)
+            c->peerClosed = true;
+        else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            c->peerClosed = true; // reset: nothing more will arrive
+        else if (errno == EINTR)
+            continue;
+        break;
+    }
+    dispatch(c);
+    if (c->peerClosed && !c->busy && c->queued.empty() && c->outOff == c->out.size())
+        close(*c);
+    else
+        watch(*c);
+}
+
+void Server::flush(const std::shared_ptr<Conn>& c) {
+    while (c->outOff < c->out.size()) {
+        const ssize_t n = ::send(c->fd, c->out.data() + c->outOff, c->out.size() - c->outOff, MSG_NOSIGNAL);
+        if (n > 0) {
+            c->outOff += static_cast<size_t>(n);
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            close(*c);
+            return;
+        }
+    }
+    if (c->outOff == c->out.size()) {
+        c->out.clear();
+        c->outOff = 0;
+        if (c->peerClosed && !c->busy && c->queued.empty()) {
+            close(*c);
+            return;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lk(c->outM);
+        c->unsent = c->out.size() - c->outOff;
+    }
+    c->outCv.notify_all();
+    watch(*c);
+}
+
+void Server::dispatch(const std::shared_ptr<Conn>& c) {
+    if (c->busy || c->queued.empty())
+        return;
+    c->busy = true;
+    Job job{c, std::move(c->queued)};
+    c->queued.clear();
+    c->queuedBytes = 0;
+    {
+        std::lock_guard<std::mutex> lk(jobsM_);
+        jobs_.push_back(std::move(job));
+    }
+    jobsCv_.notify_one();
+}
+
+void Server::take(Conn& c) {
+    std::lock_guard<std::mutex> lk(c.outM);
+    c.out += c.outbox;
+    c.outbox.clear();
+    c.unsent = c.out.size() - c.outOff;
+}
+
+void Server::finishJobs() {
+    std::vector<Job> done;
+    std::vector<std::shared_ptr<Conn>> ready;
+    {
+        std::lock_guard<std::mutex> lk(doneM_);
+        done.swap(done_);
+        ready.swap(ready_);
+    }
+    for (const auto& c : ready) {
+        if (c->fd < 0)
+            continue;
+        take(*c);
+        flush(c);
+    }
+    for (auto& job : done) {
+        const std::shared_ptr<Conn>& c = job.conn;
+        c->busy = false;
+        if (c->fd < 0)
+            continue; // closed while the session ran
+        take(*c); // frames posted after ready_ was swapped out
+        dispatch(c); // the next pipelined batch runs while this one is sent
+        flush(c);
+    }
+}
+
+// Waits while the client has kMaxPendingOut bytes unsent. A worker blocked
+// here is released by the client reading or by the connection closing.
+void Server::post(const std::shared_ptr<Conn>& c, std::string&& frame) {
+    {
+        std::unique_lock<std::mutex> lk(c->outM);
+        c->outCv.wait(lk, [&] { return c->closed || c->outbox.size() + c->unsent < kMaxPendingOut; });
+        if (c->closed)
+            return;
+        c->outbox += frame;
+    }
+    {
+        std::lock_guard<std::mutex> lk(doneM_);
+        ready_.push_back(c);
+    }
+    wake();
+}
+
+void Server::workerLoop() {
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lk(jobsM_);
+            jobsCv_.wait(lk, [&] { return quit_ || !jobs_.empty(); });
+            if (jobs_.empty())
+                return;
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+        Conn& c = *job.conn;
+        if (!c.session) {
+            c.session = std::make_unique<Executor>(db_);
+            c.session->setOutput(c.results, OutputFormat::BINARY);
+            if (opts_.onSession)
+                opts_.onSession(*c.session);
+        }
+        c.frames.emit = [this, &job](std::string&& frame) { post(job.conn, std::move(frame)); };
+        for (const auto& sql : job.requests) {
+            std::string trailer = "K";
+            try {
+                c.session->run(sql);
+            } catch (const std::exception& e) {
+                trailer = std::string("!") + e.what();
+            }
+            c.results.flush();
+            c.frames.finish();
+            std::string frame;
+            appendFrame(frame, std::string_view(trailer).substr(0, kMaxFrame));
+            post(job.conn, std::move(frame));
+        }
+        c.frames.emit = nullptr;
+        {
+            std::lock_guard<std::mutex> lk(doneM_);
+            done_.push_back(std::move(job));
+        }
+        wake();
+    }
+}
+#endif
+
+} // namespace imd
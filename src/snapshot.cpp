@@ -0,0 +1,467 @@
+﻿#include "imd/snapshot.hpp"
+#include "imd/mapped_file.hpp"
+#include "imd/wal.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace imd {
+
+static const char kMagic[8] = {'I', 'M', 'D', 'S', 'N', 'A', 'P', 0};
+constexpr uint32_t kVersion = 1;
+constexpr uint32_t kByteOrder = 0x01020304; // written in host order; a mismatch means another endianness
+constexpr size_t kHeader = 64;
+constexpr size_t kAlign = 64;
+
+namespace {
+
+struct ColumnMeta {
+    std::string name;
+    ColType type{ColType::INT};
+    bool dict = false;
+    uint64_t off = 0, len = 0;
+    uint32_t crc = 0;
+};
+struct IndexMeta {
+    std::string name;
+    uint32_t column = 0;
+    IndexKind kind{IndexKind::HASH};
+};
+struct TableMeta {
+    std::string name;
+    Layout layout{Layout::ROW};
+    uint64_t rows = 0;
+    std::vector<ColumnMeta> columns;
+    std::vector<IndexMeta> indexes;
+};
+
+template <class T> void putRaw(std::string& out, T v) {
+    out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+void putStr(std::string& out, const std::string& s) {
+    putRaw(out, static_cast<uint32_t>(s.size()));
+    out += s;
+}
+
+struct In {
+    std::string_view s;
+    size_t pos = 0;
+
+    template <class T> T raw() {
+        T v;
+        std::memcpy(&v, take(sizeof(T)), sizeof(T));
+        return v;
+    }
+    std::string str() {
+        const uint32_t n = raw<uint32_t>();
+        return std::string(take(n), n);
+    }
+    const char* take(size_t n) {
+        if (s.size() - pos < n)
+            throw std::runtime_error("Snapshot is truncated or damaged");
+        pos += n;
+        return s.data() + pos - n;
+    }
+};
+
+} // namespace
+
+// ----- SAVE -----
+// Rows per progress report.
+constexpr size_t kProgressRows = 65536;
+// Staging buffer of a SnapshotWriter; holds a whole progress chunk of an INT column.
+constexpr size_t kStaging = 1 << 20;
+static_assert(kProgressRows * sizeof(long long) <= kStaging, "an INT chunk must fit the staging buffer");
+
+// Raw file calls, none of which allocate.
+#ifdef _WIN32
+static int sysCreate(const char* p) {
+    return _open(p, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+}
+static bool sysWrite(int fd, const char* p, size_t n) {
+    while (n) {
+        const unsigned chunk = n > (1u << 30) ? (1u << 30) : static_cast<unsigned>(n);
+        const int w = _write(fd, p, chunk);
+        if (w <= 0)
+            return false;
+        p += w;
+        n -= static_cast<size_t>(w);
+    }
+    return true;
+}
+static bool sysRewind(int fd) {
+    return _lseeki64(fd, 0, SEEK_SET) == 0;
+}
+static bool sysSync(int fd) {
+    return _commit(fd) == 0;
+}
+static bool sysClose(int fd) {
+    return _close(fd) == 0;
+}
+#else
+static int sysCreate(const char* p) {
+    return ::open(p, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+}
+static bool sysWrite(int fd, const char* p, size_t n) {
+    while (n) {
+        const ssize_t w = ::write(fd, p, n);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return false;
+        p += w;
+        n -= static_cast<size_t>(w);
+    }
+    return true;
+}
+static bool sysRewind(int fd) {
+    return ::lseek(fd, 0, SEEK_SET) == 0;
+}
+static bool sysSync(int fd) {
+    return ::fsync(fd) == 0;
+}
+static bool sysClose(int fd) {
+    return ::close(fd) == 0;
+}
+#endif
+
+namespace {
+
+// Appends to a file through the staging buffer while tracking the offset and
+// a running checksum. The first failed write sticks in ok (errno tells why).
+struct Out {
+    int fd = -1;
+    char* buf = nullptr;
+    size_t used = 0;
+    uint64_t pos = 0;
+    uint32_t crc = 0;
+    bool ok = true;
+    uint64_t cells = 0, totalCells = 0;
+    const SnapshotProgress* progress = nullptr;
+
+    void advance(size_t n) { // n more cells written
+        cells += n;
+        if (*progress)
+            (*progress)(cells, totalCells);
+    }
+
+    void flush() {
+        if (ok && used)
+            ok = sysWrite(fd, buf, used);
+        used = 0;
+    }
+    char* room(size_t n) { // n <= kStaging bytes to fill, then commit(n)
+        if (used + n > kStaging)
+            flush();
+        return buf + used;
+    }
+    void commit(size_t n) {
+        crc = crc32c(buf + used, n, crc);
+        used += n;
+        pos += n;
+    }
+    void write(const void* p, size_t n) {
+        if (n > kStaging) { // large strings go straight to the file
+            flush();
+            crc = crc32c(p, n, crc);
+            pos += n;
+            if (ok)
+                ok = sysWrite(fd, static_cast<const char*>(p), n);
+            return;
+        }
+        std::memcpy(room(n), p, n);
+        commit(n);
+    }
+    void pad() {
+        const size_t n = (kAlign - pos % kAlign) % kAlign;
+        std::memset(room(n), 0, n);
+        used += n;
+        pos += n;
+    }
+};
+
+} // namespace
+
+// Writes column j of t and stores its offset, length and checksum at field.
+static void writeColumn(Out& out, const Table& t, int j, char* field) {
+    const size_t n = t.rowCount();
+    out.pad();
+    const uint64_t off = out.pos;
+    out.crc = 0;
+    if (t.columns[j].type == ColType::INT) {
+        for (size_t from = 0; from < n; from += kProgressRows) {
+            const size_t to = std::min(n, from + kProgressRows), bytes = (to - from) * sizeof(long long);
+            if (t.layout == Layout::COLUMNAR) {
+                out.write(t.cols[j].ints.data() + from, bytes);
+            } else {
+                char* p = out.room(bytes);
+                for (size_t r = from; r < to; ++r) {
+                    const long long v = t.intAt(r, j);
+                    std::memcpy(p + (r - from) * sizeof(v), &v, sizeof(v));
+                }
+                out.commit(bytes);
+            }
+            out.advance(to - from);
+        }
+    } else {
+        uint64_t end = 0;
+        out.write(&end, sizeof(end));
+        for (size_t from = 0; from < n; from += kProgressRows) { // offsets, one chunk at a time
+            const size_t to = std::min(n, from + kProgressRows);
+            char* p = out.room((to - from) * sizeof(end));
+            for (size_t r = from; r < to; ++r) {
+                end += t.strAt(r, j).size();
+                std::memcpy(p + (r - from) * sizeof(end), &end, sizeof(end));
+            }
+            out.commit((to - from) * sizeof(end));
+        }
+        for (size_t r = 0; r < n; ++r) {
+            std::string_view s = t.strAt(r, j);
+            out.write(s.data(), s.size());
+            if ((r + 1) % kProgressRows == 0 || r + 1 == n)
+                out.advance(r % kProgressRows + 1);
+        }
+    }
+    const uint64_t len = out.pos - off;
+    std::memcpy(field, &off, sizeof(off));
+    std::memcpy(field + sizeof(off), &len, sizeof(len));
+    std::memcpy(field + 2 * sizeof(off), &out.crc, sizeof(out.crc));
+}
+
+SnapshotWriter::SnapshotWriter(Database& db, const std::string& path)
+    : path_(path), tmp_(path + ".tmp"), staging_(new char[kStaging]) {
+    db.loadAll();
+    dir_ = parentDir(path);
+    cannotWrite_ = "Cannot write snapshot " + tmp_;
+    cannotRename_ = "Cannot rename " + tmp_ + " to " + path_;
+    cannotSyncDir_ = "Cannot sync directory " + dir_;
+    crc32c(kMagic, sizeof(kMagic)); // initializes its lookup state here rather than in write()
+
+    putRaw(cat_, static_cast<uint32_t>(db.tables.size()));
+    for (const auto& [name, t] : db.tables) {
+        tables_.push_back(&t);
+        totalCells_ += t.rowCount() * t.columns.size();
+        putStr(cat_, name);
+        putRaw(cat_, static_cast<uint8_t>(t.layout));
+        putRaw(cat_, static_cast<uint64_t>(t.rowCount()));
+        putRaw(cat_, static_cast<uint32_t>(t.columns.size()));
+        for (const auto& c : t.columns) {
+            putStr(cat_, c.name);
+            putRaw(cat_, encodeColType(c.type, c.dict));
+            patch_.push_back(cat_.size());
+            putRaw(cat_, uint64_t{0}); // off
+            putRaw(cat_, uint64_t{0}); // len
+            putRaw(cat_, uint32_t{0}); // crc
+        }
+        putRaw(cat_, static_cast<uint32_t>(t.indexes.size()));
+        for (const auto& ix : t.indexes) {
+            putStr(cat_, ix->name());
+            putRaw(cat_, static_cast<uint32_t>(ix->column()));
+            putRaw(cat_, static_cast<uint8_t>(ix->kind()));
+        }
+    }
+}
+
+const char* SnapshotWriter::write(const SnapshotProgress& progress) {
+    Out out;
+    out.fd = sysCreate(tmp_.c_str());
+    if (out.fd < 0)
+        return cannotWrite_.c_str();
+    out.buf = staging_.get();
+    out.progress = &progress;
+    out.totalCells = totalCells_;
+    char header[kHeader] = {};
+    out.write(header, kHeader); // rewritten once the catalog is placed
+
+    size_t k = 0;
+    for (const Table* t : tables_)
+        for (size_t j = 0; j < t->columns.size(); ++j)
+            writeColumn(out, *t, static_cast<int>(j), &cat_[patch_[k++]]);
+    out.pad();
+    const uint64_t catOff = out.pos, catLen = cat_.size();
+    out.write(cat_.data(), cat_.size());
+    out.flush();
+    const uint32_t catCrc = crc32c(cat_.data(), cat_.size());
+
+    size_t h = 0;
+    auto put = [&](const void* p, size_t n) {
+        std::memcpy(header + h, p, n);
+        h += n;
+    };
+    put(kMagic, sizeof(kMagic));
+    put(&kVersion, sizeof(kVersion));
+    put(&kByteOrder, sizeof(kByteOrder));
+    put(&catOff, sizeof(catOff));
+    put(&catLen, sizeof(catLen));
+    put(&catCrc, sizeof(catCrc));
+    const bool ok = out.ok && sysRewind(out.fd) && sysWrite(out.fd, header, kHeader) && sysSync(out.fd);
+    const int e = errno;
+    if (!sysClose(out.fd) || !ok) {
+        if (!ok)
+            errno = e;
+        return cannotWrite_.c_str();
+    }
+    if (!renameFile(tmp_.c_str(), path_.c_str())) // the old snapshot stays until the new one is complete
+        return cannotRename_.c_str();
+    return syncDir(dir_.c_str()) ? nullptr : cannotSyncDir_.c_str();
+}
+
+size_t saveSnapshot(Database& db, const std::string& path, const SnapshotProgress& progress) {
+    SnapshotWriter w(db, path);
+    if (const char* err = w.write(progress))
+        throw std::runtime_error(std::string(err) + ": " + std::strerror(errno));
+    return w.tables();
+}
+
+// ----- LOAD -----
+// Verifies every section of m, then copies them into t and rebuilds its indexes.
+static void fillTable(Table& t, const TableMeta& m, const MappedFile& f) {
+    const size_t n = m.rows;
+    for (const auto& c : m.columns) {
+        if (crc32c(f.data() + c.off, c.len) != c.crc)
+            throw std::runtime_error("Snapshot checksum mismatch in " + m.name + "." + c.name);
+        if (c.type != ColType::STR)
+            continue;
+        // the heap follows the n + 1 offsets; every string must lie inside it
+        const auto* offs = reinterpret_cast<const uint64_t*>(f.data() + c.off);
+        bool ok = offs[0] == 0 && offs[n] <= c.len - (n + 1) * sizeof(uint64_t);
+        for (size_t r = 0; ok && r < n; ++r)
+            ok = offs[r] <= offs[r + 1];
+        if (!ok)
+            throw std::runtime_error("Snapshot string offsets are damaged in " + m.name + "." + c.name);
+    }
+    if (t.layout == Layout::ROW)
+        t.cells.assign(n * t.columns.size(), Value());
+    for (size_t j = 0; j < m.columns.size(); ++j) {
+        const char* p = f.data() + m.columns[j].off;
+        if (m.columns[j].type == ColType::INT) {
+            const auto* v = reinterpret_cast<const long long*>(p);
+            if (t.layout == Layout::COLUMNAR)
+                t.cols[j].ints.assign(v, v + n);
+            else
+                for (size_t r = 0; r < n; ++r)
+                    t.cells[r * t.columns.size() + j] = Value::makeInt(v[r]);
+            continue;
+        }
+        const auto* offs = reinterpret_cast<const uint64_t*>(p);
+        const char* heap = p + (n + 1) * sizeof(uint64_t);
+        if (t.columns[j].dict) {
+            if (t.layout == Layout::COLUMNAR)
+                t.cols[j].codes.resize(n);
+            for (size_t r = 0; r < n; ++r) {
+                const uint32_t code = t.dicts[j].encode(std::string_view(heap + offs[r], offs[r + 1] - offs[r]));
+                if (t.layout == Layout::COLUMNAR)
+                    t.cols[j].codes[r] = code;
+                else
+                    t.cells[r * t.columns.size() + j] = Value::makeInt(code);
+            }
+            continue;
+        }
+        if (t.layout == Layout::COLUMNAR)
+            t.cols[j].strs.assign(offs, n, std::string_view(heap, offs[n]));
+        else
+            for (size_t r = 0; r < n; ++r)
+                t.cells[r * t.columns.size() + j] = t.storeStr(std::string_view(heap + offs[r], offs[r + 1] - offs[r]));
+    }
+    for (const auto& ix : m.indexes) {
+        const ColType type = t.columns[ix.column].type;
+        if (ix.kind == IndexKind::BTREE)
+            t.addIndex(std::make_unique<BTreeIndex>(ix.name, static_cast<int>(ix.column), type));
+        else
+            t.addIndex(std::make_unique<HashIndex>(ix.name, static_cast<int>(ix.column), type));
+    }
+}
+
+static std::vector<TableMeta> readCatalog(const MappedFile& f, const std::string& path) {
+    In h{f.view()};
+    if (f.size() < kHeader || std::memcmp(h.take(sizeof(kMagic)), kMagic, sizeof(kMagic)) != 0)
+        throw std::runtime_error("Not a snapshot file: " + path);
+    const uint32_t version = h.raw<uint32_t>();
+    if (version != kVersion)
+        throw std::runtime_error("Unsupported snapshot version " + std::to_string(version) + " in " + path);
+    if (h.raw<uint32_t>() != kByteOrder)
+        throw std::runtime_error("Snapshot " + path + " was written with another byte order");
+    const uint64_t off = h.raw<uint64_t>(), len = h.raw<uint64_t>();
+    const uint32_t crc = h.raw<uint32_t>();
+    if (off > f.size() || len > f.size() - off || crc32c(f.data() + off, len) != crc)
+        throw std::runtime_error("Snapshot catalog is damaged in " + path);
+
+    In c{std::string_view(f.data() + off, len)};
+    std::vector<TableMeta> metas(c.raw<uint32_t>());
+    for (auto& m : metas) {
+        m.name = c.str();
+        const uint8_t layout = c.raw<uint8_t>();
+        if (layout > static_cast<uint8_t>(Layout::COLUMNAR))
+            throw std::runtime_error("Bad layout byte " + std::to_string(layout) + " for " + m.name);
+        m.layout = static_cast<Layout>(layout);
+        m.rows = c.raw<uint64_t>();
+        if (m.rows >= std::numeric_limits<uint64_t>::max() / 8) // so (rows + 1) * 8 below cannot wrap
+            throw std::runtime_error("Snapshot row count out of range for " + m.name);
+        m.columns.resize(c.raw<uint32_t>());
+        for (auto& col : m.columns) {
+            col.name = c.str();
+            decodeColType(c.raw<uint8_t>(), col.type, col.dict);
+            col.off = c.raw<uint64_t>();
+            col.len = c.raw<uint64_t>();
+            col.crc = c.raw<uint32_t>();
+            const uint64_t need = col.type == ColType::INT ? m.rows * 8 : (m.rows + 1) * 8;
+            if (col.off > f.size() || col.len > f.size() - col.off || col.len < need)
+                throw std::runtime_error("Snapshot section out of range for " + m.name + "." + col.name);
+        }
+        m.indexes.resize(c.raw<uint32_t>());
+        for (auto& ix : m.indexes) {
+            ix.name = c.str();
+            ix.column = c.raw<uint32_t>();
+            const uint8_t kind = c.raw<uint8_t>();
+            if (kind > static_cast<uint8_t>(IndexKind::BTREE))
+                throw std::runtime_error("Bad index kind byte " + std::to_string(kind) + " for " + ix.name);
+            ix.kind = static_cast<IndexKind>(kind);
+            if (ix.column >= m.columns.size())
+                throw std::runtime_error("Snapshot index " + ix.name + " has a bad column");
+        }
+    }
+    return metas;
+}
+
+size_t loadSnapshot(Database& db, const std::string& path) {
+    auto file = std::make_shared<const MappedFile>(path);
+    std::vector<TableMeta> metas = readCatalog(*file, path);
+    db.tables.clear();
+    db.pending.clear();
+    ++db.epoch;
+    for (auto& m : metas) {
+        Table t;
+        t.name = m.name;
+        t.layout = m.layout;
+        for (size_t j = 0; j < m.columns.size(); ++j) {
+            t.columns.push_back({m.columns[j].name, m.columns[j].type, m.columns[j].dict});
+            t.colIndex.emplace(m.columns[j].name, static_cast<int>(j));
+        }
+        if (t.layout == Layout::COLUMNAR)
+            t.cols.resize(t.columns.size());
+        t.dicts.resize(t.columns.size());
+        const std::string name = m.name;
+        db.tables.emplace(name, std::move(t));
+        db.pending.emplace(name, [file, meta = std::move(m)](Table& tbl) { fillTable(tbl, meta, *file); });
+    }
+    return metas.size();
+}
+
+} // namespace imd
@@ -0,0 +1,120 @@
+﻿#include "imd/stream.hpp"
+#include "imd/parser.hpp"
+#include <cctype>
+#include <memory>
+#include <utility>
+
+namespace imd {
+
+// ----- StatementReader -----
+bool StatementReader::next(std::string& stmt) {
+    for (;;) {
+        for (; scan_ < buf_.size(); ++scan_) {
+            const char c = buf_[scan_];
+            if (c == '"')
+                inStr_ = !inStr_;
+            else if (c == ';' && !inStr_) {
+                ++scan_;
+                stmt.assign(buf_, head_, scan_ - head_);
+                head_ = scan_;
+                return true;
+            }
+        }
+        if (!in_) {
+            size_t i = head_;
+            while (i < buf_.size() && std::isspace(static_cast<unsigned char>(buf_[i])))
+                ++i;
+            if (i == buf_.size())
+                return false;
+            stmt.assign(buf_, head_, std::string::npos);
+            head_ = scan_ = buf_.size();
+            return true;
+        }
+        // drop consumed statements, then append the next chunk
+        buf_.erase(0, head_);
+        scan_ -= head_;
+        head_ = 0;
+        const size_t old = buf_.size();
+        buf_.resize(old + chunk_);
+        in_.read(&buf_[old], static_cast<std::streamsize>(chunk_));
+        buf_.resize(old + static_cast<size_t>(in_.gcount()));
+    }
+}
+
+// Long INSERTs reach the queue batch by batch, ahead of their remainder.
+static bool parseNext(Parser& p, const StatementPipeline::Emit& emit) {
+    p.setInsertSink([&emit](InsertStmt&& batch) { emit(Statement(std::move(batch))); });
+    Statement st;
+    if (!p.next(st))
+        return false;
+    emit(std::move(st));
+    return true;
+}
+
+StatementPipeline::Source readStatements(std::istream& in, size_t chunk) {
+    auto reader = std::make_shared<StatementReader>(in, chunk);
+    auto text = std::make_shared<std::string>();
+    return [reader, text](const StatementPipeline::Emit& emit) {
+        if (!reader->next(*text))
+            return false;
+        Parser p(std::string_view{*text});
+        return parseNext(p, emit);
+    };
+}
+
+StatementPipeline::Source parseStatements(Parser& p) {
+    return [&p](const StatementPipeline::Emit& emit) { return parseNext(p, emit); };
+}
+
+// ----- StatementPipeline -----
+StatementPipeline::StatementPipeline(Source source, size_t depth)
+    : source_(std::move(source)), depth_(depth ? depth : 1), producer_([this] { produce(); }) {}
+
+StatementPipeline::~StatementPipeline() {
+    {
+        std::lock_guard<std::mutex> lk(m_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    producer_.join();
+}
+
+void StatementPipeline::push(Statement&& st) {
+    std::unique_lock<std::mutex> lk(m_);
+    cv_.wait(lk, [&] { return stop_ || queue_.size() < depth_; });
+    if (stop_)
+        throw Stopped{};
+    queue_.push_back(std::move(st));
+    cv_.notify_all();
+}
+
+void StatementPipeline::produce() {
+    try {
+        while (source_([this](Statement&& st) { push(std::move(st)); })) {
+        }
+    } catch (const Stopped&) {
+        return;
+    } catch (...) {
+        std::lock_guard<std::mutex> lk(m_);
+        error_ = std::current_exception();
+    }
+    std::lock_guard<std::mutex> lk(m_);
+    done_ = true;
+    cv_.notify_all();
+}
+
+bool StatementPipeline::next(Statement& out) {
+    std::unique_lock<std::mutex> lk(m_);
+    cv_.wait(lk, [&] { return !queue_.empty() || done_; });
+    if (!queue_.empty()) {
+        out = std::move(queue_.front());
+        queue_.pop_front();
+        cv_.notify_all();
+        return true;
+    }
+    if (error_)
+        std::rethrow_exception(std::exchange(error_, nullptr));
+    return false;
+}
+
+} // namespace imd
@@ -0,0 +1,347 @@
+﻿#include "imd/ast.hpp"
+#include "imd/thread_pool.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace imd {
+
+// ----- StrColumn -----
+void StrColumn::push_back(std::string_view s) {
+    offs_.push_back(heap_.size());
+    lens_.push_back(static_cast<uint32_t>(s.size()));
+    heap_.append(s.data(), s.size());
+}
+
+void StrColumn::assign(const uint64_t* offs, size_t n, std::string_view heap) {
+    offs_.assign(offs, offs + n);
+    lens_.resize(n);
+    for (size_t i = 0; i < n; ++i)
+        lens_[i] = static_cast<uint32_t>(offs[i + 1] - offs[i]);
+    heap_.assign(heap.data(), heap.size());
+    garbage_ = 0;
+}
+
+void StrColumn::set(size_t i, std::string_view s) {
+    if (s.size() <= lens_[i]) {
+        // fits in place; the tail of the old value becomes garbage
+        heap_.replace(offs_[i], s.size(), s.data(), s.size());
+        garbage_ += lens_[i] - s.size();
+    } else {
+        garbage_ += lens_[i];
+        offs_[i] = heap_.size();
+        heap_.append(s.data(), s.size());
+    }
+    lens_[i] = static_cast<uint32_t>(s.size());
+    if (garbage_ > 4096 && garbage_ * 2 > heap_.size())
+        repack();
+}
+
+void StrColumn::clear() {
+    offs_.clear();
+    lens_.clear();
+    heap_.clear();
+    garbage_ = 0;
+}
+
+void StrColumn::compact(const std::vector<uint8_t>& keep, ThreadPool* pool) {
+    for (size_t i = 0; i < lens_.size(); ++i)
+        if (!keep[i])
+            garbage_ += lens_[i];
+    parallelCompact(pool, offs_, keep);
+    parallelCompact(pool, lens_, keep);
+    if (garbage_ * 2 > heap_.size())
+        repack();
+}
+
+void StrColumn::repack() {
+    std::string fresh;
+    fresh.reserve(heap_.size() - garbage_);
+    for (size_t i = 0; i < offs_.size(); ++i) {
+        uint64_t off = fresh.size();
+        fresh.append(heap_, offs_[i], lens_[i]);
+        offs_[i] = off;
+    }
+    heap_.swap(fresh);
+    garbage_ = 0;
+}
+
+// ----- StringArena -----
+std::string_view StringArena::copy(std::string_view s) {
+    if (s.empty())
+        return {};
+    char* p;
+    if (s.size() > kBlock / 4) {
+        // too big to share a block: give it its own, keeping the current one open
+        blocks_.push_back(std::make_unique<char[]>(s.size()));
+        p = blocks_.back().get();
+    } else {
+        if (s.size() > left_) {
+            blocks_.push_back(std::make_unique<char[]>(kBlock));
+            cur_ = blocks_.back().get();
+            left_ = kBlock;
+        }
+        p = cur_;
+        cur_ += s.size();
+        left_ -= s.size();
+    }
+    std::memcpy(p, s.data(), s.size());
+    used_ += s.size();
+    return std::string_view(p, s.size());
+}
+
+void StringArena::clear() {
+    blocks_.clear();
+    cur_ = nullptr;
+    left_ = 0;
+    used_ = 0;
+}
+
+// ----- StrDict -----
+uint32_t StrDict::encode(std::string_view s) {
+    auto it = codes_.find(s);
+    if (it != codes_.end())
+        return it->second;
+    if (strs_.size() == UINT32_MAX)
+        throw std::runtime_error("Dictionary is full");
+    const uint32_t code = static_cast<uint32_t>(strs_.size());
+    strs_.push_back(text_.copy(s));
+    codes_.emplace(strs_.back(), code);
+    stale_.store(true, std::memory_order_relaxed); // writers are exclusive
+    return code;
+}
+
+const uint32_t* StrDict::ranks() const {
+    if (stale_.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lk(sortM_);
+        if (stale_.load(std::memory_order_relaxed)) {
+            sorted_.resize(strs_.size());
+            for (uint32_t c = 0; c < sorted_.size(); ++c)
+                sorted_[c] = c;
+            std::sort(sorted_.begin(), sorted_.end(), [&](uint32_t x, uint32_t y) { return strs_[x] < strs_[y]; });
+            ranks_.resize(strs_.size());
+            for (uint32_t i = 0; i < sorted_.size(); ++i)
+                ranks_[sorted_[i]] = i;
+            stale_.store(false, std::memory_order_release);
+        }
+    }
+    return ranks_.data();
+}
+
+long long StrDict::find(std::string_view s) const {
+    auto it = codes_.find(s);
+    return it == codes_.end() ? -1 : it->second;
+}
+
+uint32_t StrDict::lowerRank(std::string_view s) const {
+    ranks();
+    auto it = std::lower_bound(sorted_.begin(), sorted_.end(), s,
+                               [&](uint32_t c, std::string_view v) { return strs_[c] < v; });
+    return static_cast<uint32_t>(it - sorted_.begin());
+}
+
+uint32_t StrDict::upperRank(std::string_view s) const {
+    ranks();
+    auto it = std::upper_bound(sorted_.begin(), sorted_.end(), s,
+                               [&](std::string_view v, uint32_t c) { return v < strs_[c]; });
+    return static_cast<uint32_t>(it - sorted_.begin());
+}
+
+void StrDict::clear() {
+    text_.clear();
+    strs_.clear();
+    codes_.clear();
+    sorted_.clear();
+    ranks_.clear();
+    stale_.store(false, std::memory_order_relaxed);
+}
+
+StrDict::StrDict(StrDict&& o) noexcept {
+    *this = std::move(o);
+}
+
+StrDict& StrDict::operator=(StrDict&& o) noexcept {
+    if (this == &o)
+        return *this;
+    text_ = std::move(o.text_);
+    strs_ = std::move(o.strs_);
+    codes_ = std::move(o.codes_);
+    sorted_ = std::move(o.sorted_);
+    ranks_ = std::move(o.ranks_);
+    stale_.store(o.stale_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    o.clear();
+    return *this;
+}
+
+// ----- Table -----
+// Bytes a ROW cell keeps in the arena.
+static size_t arenaBytes(const Value& v) {
+    return v.borrowed() ? v.strSize() : 0;
+}
+
+Value Table::storeStr(std::string_view s) {
+    return s.size() <= Value::kInline ? Value::makeStr(s) : Value::borrowStr(arena.copy(s));
+}
+
+void Table::repackArena() {
+    StringArena fresh;
+    for (auto& v : cells)
+        if (v.borrowed())
+            v = Value::borrowStr(fresh.copy(v.asStr()));
+    std::swap(arena, fresh);
+    arenaGarbage = 0;
+}
+
+Value Table::get(size_t r, int j) const {
+    if (columns[j].dict)
+        return Value::makeStr(strAt(r, j));
+    if (layout == Layout::ROW) {
+        const Value& v = cell(r, j);
+        return v.borrowed() ? Value::makeStr(v.asStr()) : v;
+    }
+    if (columns[j].type == ColType::INT)
+        return Value::makeInt(cols[j].ints[r]);
+    return Value::makeStr(cols[j].strs.at(r));
+}
+
+Value Table::peek(size_t r, int j) const {
+    return columns[j].type == ColType::INT ? Value::makeInt(intAt(r, j)) : Value::borrowStr(strAt(r, j));
+}
+
+void Table::set(size_t r, int j, const Value& v) {
+    for (auto& ix : indexes) {
+        if (ix->column() != j)
+            continue;
+        ix->erase(peek(r, j), r); // indexes copy only the keys they keep
+        ix->insert(v, r);
+    }
+    if (layout == Layout::ROW) {
+        Value& c = cells[r * columns.size() + j];
+        if (columns[j].type == ColType::INT) { // touches only the cell, so parallel UPDATEs stay race-free
+            c = v;
+            return;
+        }
+        arenaGarbage += arenaBytes(c);
+        if (columns[j].dict)
+            c = Value::makeInt(dicts[j].encode(v.asStr()));
+        else
+            c = v.isStr() ? storeStr(v.asStr()) : v;
+        if (arenaGarbage > 4096 && arenaGarbage * 2 > arena.bytes())
+            repackArena();
+        return;
+    }
+    if (columns[j].type == ColType::INT)
+        cols[j].ints[r] = v.asInt();
+    else if (columns[j].dict)
+        cols[j].codes[r] = dicts[j].encode(v.asStr());
+    else
+        cols[j].strs.set(r, v.asStr());
+}
+
+void Table::append(Row&& r) {
+    const size_t pos = rowCount();
+    for (auto& ix : indexes)
+        ix->insert(r[ix->column()], pos);
+    if (layout == Layout::ROW) {
+        for (size_t j = 0; j < columns.size(); ++j) {
+            Value& v = r[j];
+            if (columns[j].dict)
+                cells.push_back(Value::makeInt(dicts[j].encode(v.asStr())));
+            else
+                cells.push_back(v.isStr() && v.strSize() > Value::kInline ? storeStr(v.asStr()) : std::move(v));
+        }
+        return;
+    }
+    for (size_t j = 0; j < columns.size(); ++j) {
+        if (columns[j].type == ColType::INT)
+            cols[j].ints.push_back(r[j].asInt());
+        else if (columns[j].dict)
+            cols[j].codes.push_back(dicts[j].encode(r[j].asStr()));
+        else
+            cols[j].strs.push_back(r[j].asStr());
+    }
+}
+
+void Table::reserve(size_t n) {
+    if (layout == Layout::ROW) {
+        cells.reserve(n * columns.size());
+        return;
+    }
+    for (size_t j = 0; j < columns.size(); ++j) {
+        if (columns[j].type == ColType::INT)
+            cols[j].ints.reserve(n);
+        else if (columns[j].dict)
+            cols[j].codes.reserve(n);
+        else
+            cols[j].strs.reserve(n);
+    }
+}
+
+void Table::clear() {
+    for (auto& ix : indexes)
+        ix->clear();
+    cells.clear();
+    arena.clear();
+    arenaGarbage = 0;
+    for (auto& c : cols) {
+        c.ints.clear();
+        c.strs.clear();
+        c.codes.clear();
+    }
+    for (auto& d : dicts)
+        d.clear();
+}
+
+size_t Table::compact(const std::vector<uint8_t>& keep, ThreadPool* pool) {
+    for (auto& ix : indexes)
+        ix->compact(keep);
+    if (layout == Layout::ROW) {
+        const size_t w = columns.size();
+        std::vector<uint8_t> keepCell(cells.size());
+        for (size_t i = 0; i < cells.size(); ++i) {
+            keepCell[i] = keep[i / w];
+            if (!keepCell[i])
+                arenaGarbage += arenaBytes(cells[i]);
+        }
+        parallelCompact(pool, cells, keepCell);
+        if (arenaGarbage * 2 > arena.bytes())
+            repackArena();
+        return rowCount();
+    }
+    for (size_t j = 0; j < columns.size(); ++j) {
+        if (columns[j].type == ColType::INT)
+            parallelCompact(pool, cols[j].ints, keep);
+        else if (columns[j].dict)
+            parallelCompact(pool, cols[j].codes, keep);
+        else
+            cols[j].strs.compact(keep, pool);
+    }
+    return rowCount();
+}
+
+// ----- Database -----
+Table* Database::find(const std::string& name) {
+    auto it = tables.find(name);
+    if (it == tables.end())
+        return nullptr;
+    auto p = pending.find(name);
+    if (p != pending.end()) {
+        p->second(it->second); // throws (leaving the table pending) if the data is damaged
+        pending.erase(p);
+    }
+    return &it->second;
+}
+
+void Database::loadAll() {
+    while (!pending.empty())
+        find(pending.begin()->first);
+}
+
+void Table::addIndex(std::unique_ptr<Index> ix) {
+    const size_t n = rowCount();
+    for (size_t i = 0; i < n; ++i)
+        ix->insert(peek(i, ix->column()), i);
+    indexes.push_back(std::move(ix));
+}
+
+} // namespace imd
@@ -0,0 +1,138 @@
+﻿#include "imd/thread_pool.hpp"
+#include <exception>
+
+namespace imd {
+
+struct ThreadPool::Job {
+    const std::function<void(size_t)>* fn;
+    std::atomic<size_t> remaining;
+    std::mutex m;
+    std::condition_variable done;
+    std::exception_ptr error;
+};
+
+ThreadPool::ThreadPool(unsigned threads) {
+    const unsigned workers = threads > 1 ? threads - 1 : 0;
+    for (unsigned i = 0; i < workers; ++i)
+        queues_.push_back(std::make_unique<Queue>());
+    for (unsigned i = 0; i < workers; ++i)
+        workers_.emplace_back([this, i] { workerLoop(i); });
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lk(sleepM_);
+        stop_ = true;
+    }
+    sleepCv_.notify_all();
+    for (auto& t : workers_)
+        t.join();
+}
+
+bool ThreadPool::runOne(size_t self) {
+    Task task{nullptr, 0};
+    const size_t n = queues_.size();
+    // own queue first (front), then steal from the back of the others
+    for (size_t k = 0; k < n && !task.job; ++k) {
+        const size_t q = (self + k) % n;
+        Queue& qu = *queues_[q];
+        std::lock_guard<std::mutex> lk(qu.m);
+        if (qu.tasks.empty())
+            continue;
+        if (q == self) {
+            task = qu.tasks.front();
+            qu.tasks.pop_front();
+        } else {
+            task = qu.tasks.back();
+            qu.tasks.pop_back();
+        }
+    }
+    if (!task.job)
+        return false;
+    queued_.fetch_sub(1);
+
+    Job& job = *task.job;
+    std::exception_ptr err;
+    try {
+        (*job.fn)(task.index);
+    } catch (...) {
+        err = std::current_exception();
+    }
+    // decrement under the lock: once the owner sees zero it may destroy the job
+    std::lock_guard<std::mutex> lk(job.m);
+    if (err && !job.error)
+        job.error = err;
+    if (job.remaining.fetch_sub(1) == 1)
+        job.done.notify_all();
+    return true;
+}
+
+void ThreadPool::workerLoop(size_t self) {
+    for (;;) {
+        if (runOne(self))
+            continue;
+        std::unique_lock<std::mutex> lk(sleepM_);
+        sleepCv_.wait(lk, [&] { return stop_ || queued_.load() > 0; });
+        if (stop_)
+            return;
+    }
+}
+
+void ThreadPool::parallelFor(size_t n, const std::function<void(size_t)>& fn) {
+    if (n == 0)
+        return;
+    if (queues_.empty() || n == 1) {
+        for (size_t i = 0; i < n; ++i)
+            fn(i);
+        return;
+    }
+
+    Job job;
+    job.fn = &fn;
+    job.remaining = n;
+    for (size_t i = 0; i < n; ++i) {
+        Queue& qu = *queues_[i % queues_.size()];
+        std::lock_guard<std::mutex> lk(qu.m);
+        qu.tasks.push_back({&job, i});
+    }
+    {
+        std::lock_guard<std::mutex> lk(sleepM_);
+        queued_.fetch_add(n);
+    }
+    sleepCv_.notify_all();
+
+    // help until our job is drained; tasks of other jobs are fair game too
+    while (job.remaining.load() > 0) {
+        if (runOne(queues_.size()))
+            continue;
+        std::unique_lock<std::mutex> lk(job.m);
+        job.done.wait(lk, [&] { return job.remaining.load() == 0; });
+    }
+    std::lock_guard<std::mutex> lk(job.m); // the last finisher may still hold it
+    if (job.error)
+        std::rethrow_exception(job.error);
+}
+
+static std::unique_ptr<ThreadPool>& sharedSlot() {
+    static std::unique_ptr<ThreadPool> pool;
+    return pool;
+}
+
+static std::mutex sharedM;
+
+ThreadPool& ThreadPool::shared() {
+    std::lock_guard<std::mutex> lk(sharedM);
+    auto& p = sharedSlot();
+    if (!p) {
+        unsigned hw = std::thread::hardware_concurrency();
+        p = std::make_unique<ThreadPool>(hw ? hw : 1);
+    }
+    return *p;
+}
+
+void ThreadPool::setSharedThreads(unsigned threads) {
+    std::lock_guard<std::mutex> lk(sharedM);
+    sharedSlot() = std::make_unique<ThreadPool>(threads ? threads : 1);
+}
+
+} // namespace imd
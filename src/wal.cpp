@@ -0,0 +1,622 @@
+﻿#include "imd/wal.hpp"
+#include "imd/filter.hpp"
+#include "imd/mapped_file.hpp"
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IMD_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace imd {
+
+// ----- CRC-32C -----
+static const uint32_t* crcTable() {
+    static const auto table = [] {
+        static uint32_t t[256];
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? (c >> 1) ^ 0x82F63B78u : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    return table;
+}
+
+static uint32_t crcScalar(const unsigned char* p, size_t n, uint32_t c) {
+    const uint32_t* t = crcTable();
+    for (size_t i = 0; i < n; ++i)
+        c = t[(c ^ p[i]) & 0xFF] ^ (c >> 8);
+    return c;
+}
+
+#if defined(IMD_X86_SIMD) && defined(__x86_64__)
+__attribute__((target("sse4.2"))) static uint32_t crcSse42(const unsigned char* p, size_t n, uint32_t c) {
+    uint64_t c64 = c;
+    for (; n >= 8; p += 8, n -= 8) {
+        uint64_t w;
+        std::memcpy(&w, p, 8);
+        c64 = _mm_crc32_u64(c64, w);
+    }
+    c = static_cast<uint32_t>(c64);
+    for (; n; ++p, --n)
+        c = _mm_crc32_u8(c, *p);
+    return c;
+}
+#endif
+
+uint32_t crc32c(const void* data, size_t n, uint32_t crc) {
+    const auto* p = static_cast<const unsigned char*>(data);
+#if defined(IMD_X86_SIMD) && defined(__x86_64__)
+    if (simdLevel() != SimdLevel::SCALAR)
+        return ~crcSse42(p, n, ~crc);
+#endif
+    return ~crcScalar(p, n, ~crc);
+}
+
+// ----- Encoding -----
+// INSERT_PART is a piece of a streamed INSERT (its Part follows the kind).
+// Replay holds FIRST and MIDDLE pieces until the LAST one arrives and drops
+// them if the log ends first, or a new FIRST on the table shows it never will.
+enum class RecKind : uint8_t { CREATE = 1, INSERT, DELETE, UPDATE, CREATE_INDEX, DROP_INDEX, LOAD, INSERT_PART };
+
+static void put8(std::string& out, uint8_t v) {
+    out.push_back(static_cast<char>(v));
+}
+static void put32(std::string& out, uint32_t v) {
+    char b[4];
+    for (int i = 0; i < 4; ++i)
+        b[i] = static_cast<char>(v >> (8 * i));
+    out.append(b, 4);
+}
+static void put64(std::string& out, uint64_t v) {
+    char b[8];
+    for (int i = 0; i < 8; ++i)
+        b[i] = static_cast<char>(v >> (8 * i));
+    out.append(b, 8);
+}
+static void putStr(std::string& out, std::string_view s) {
+    put32(out, static_cast<uint32_t>(s.size()));
+    out.append(s);
+}
+static void putValue(std::string& out, const Value& v) {
+    if (v.isInt()) {
+        put8(out, 0);
+        put64(out, static_cast<uint64_t>(v.asInt()));
+    } else {
+        put8(out, 1);
+        putStr(out, v.asStr());
+    }
+}
+static void putExpr(std::string& out, const Expr& e) {
+    put8(out, static_cast<uint8_t>(e.kind));
+    if (e.kind == ExprKind::CMP) {
+        putStr(out, e.cmp.column);
+        put8(out, static_cast<uint8_t>(e.cmp.op));
+        putValue(out, e.cmp.literal);
+        return;
+    }
+    put32(out, static_cast<uint32_t>(e.kids.size()));
+    for (const auto& k : e.kids)
+        putExpr(out, k);
+}
+static void putWhere(std::string& out, const std::optional<Expr>& w) {
+    put8(out, w ? 1 : 0);
+    if (w)
+        putExpr(out, *w);
+}
+
+void encodeStatement(const CreateStmt& s, std::string& out) {
+    put8(out, static_cast<uint8_t>(RecKind::CREATE));
+    putStr(out, s.table);
+    put8(out, static_cast<uint8_t>(s.layout));
+    put32(out, static_cast<uint32_t>(s.columns.size()));
+    for (const auto& c : s.columns) {
+        putStr(out, c.name);
+        put8(out, encodeColType(c.type, c.dict));
+    }
+}
+
+static void putInsertKind(std::string& out, InsertStmt::Part part) {
+    if (part == InsertStmt::Part::WHOLE) {
+        put8(out, static_cast<uint8_t>(RecKind::INSERT));
+    } else {
+        put8(out, static_cast<uint8_t>(RecKind::INSERT_PART));
+        put8(out, static_cast<uint8_t>(part));
+    }
+}
+
+void encodeStatement(const InsertStmt& s, std::string& out) {
+    putInsertKind(out, s.part);
+    putStr(out, s.table);
+    put32(out, static_cast<uint32_t>(s.cols.size()));
+    for (const auto& c : s.cols)
+        putStr(out, c);
+    put32(out, static_cast<uint32_t>(s.rows.size()));
+    for (const auto& r : s.rows) {
+        put32(out, static_cast<uint32_t>(r.size()));
+        for (const auto& v : r)
+            putValue(out, v);
+    }
+}
+
+void encodeAppend(const Table& t, size_t from, size_t to, InsertStmt::Part part, std::string& out) {
+    putInsertKind(out, part);
+    putStr(out, t.name);
+    put32(out, static_cast<uint32_t>(t.columns.size()));
+    for (const auto& c : t.columns)
+        putStr(out, c.name);
+    put32(out, static_cast<uint32_t>(to - from));
+    for (size_t r = from; r < to; ++r) {
+        put32(out, static_cast<uint32_t>(t.columns.size()));
+        for (size_t j = 0; j < t.columns.size(); ++j) {
+            if (t.columns[j].type == ColType::INT) {
+                put8(out, 0);
+                put64(out, static_cast<uint64_t>(t.intAt(r, static_cast<int>(j))));
+            } else {
+                put8(out, 1);
+                putStr(out, t.strAt(r, static_cast<int>(j)));
+            }
+        }
+    }
+}
+
+void encodeStatement(const DeleteStmt& s, std::string& out) {
+    put8(out, static_cast<uint8_t>(RecKind::DELETE));
+    putStr(out, s.table);
+    putWhere(out, s.where);
+}
+
+void encodeStatement(const UpdateStmt& s, std::string& out) {
+    put8(out, static_cast<uint8_t>(RecKind::UPDATE));
+    putStr(out, s.table);
+    put32(out, static_cast<uint32_t>(s.assignments.size()));
+    for (const auto& [col, v] : s.assignments) {
+        putStr(out, col);
+        putValue(out, v);
+    }
+    putWhere(out, s.where);
+}
+
+void encodeStatement(const CreateIndexStmt& s, std::string& out) {
+    put8(out, static_cast<uint8_t>(RecKind::CREATE_INDEX));
+    putStr(out, s.name);
+    putStr(out, s.table);
+    putStr(out, s.column);
+    put8(out, static_cast<uint8_t>(s.kind));
+}
+
+void encodeStatement(const DropIndexStmt& s, std::string& out) {
+    put8(out, static_cast<uint8_t>(RecKind::DROP_INDEX));
+    putStr(out, s.name);
+}
+
+void encodeStatement(const LoadStmt& s, std::string& out) {
+    put8(out, static_cast<uint8_t>(RecKind::LOAD));
+    putStr(out, s.path);
+}
+
+// ----- Decoding -----
+namespace {
+
+struct Reader {
+    std::string_view s;
+    size_t pos = 0;
+
+    const char* take(size_t n) {
+        if (s.size() - pos < n)
+            throw std::runtime_error("Corrupt WAL record: truncated");
+        const char* p = s.data() + pos;
+        pos += n;
+        return p;
+    }
+    uint8_t u8() {
+        return static_cast<uint8_t>(*take(1));
+    }
+    uint32_t u32() {
+        const auto* p = reinterpret_cast<const unsigned char*>(take(4));
+        uint32_t v = 0;
+        for (int i = 0; i < 4; ++i)
+            v |= static_cast<uint32_t>(p[i]) << (8 * i);
+        return v;
+    }
+    uint64_t u64() {
+        const auto* p = reinterpret_cast<const unsigned char*>(take(8));
+        uint64_t v = 0;
+        for (int i = 0; i < 8; ++i)
+            v |= static_cast<uint64_t>(p[i]) << (8 * i);
+        return v;
+    }
+    std::string str() {
+        const uint32_t n = u32();
+        return std::string(take(n), n);
+    }
+    Value value() {
+        if (u8() == 0)
+            return Value::makeInt(static_cast<long long>(u64()));
+        return Value::makeStr(str());
+    }
+    Expr expr() {
+        Expr e;
+        e.kind = static_cast<ExprKind>(u8());
+        if (e.kind == ExprKind::CMP) {
+            e.cmp.column = str();
+            e.cmp.op = static_cast<CmpOp>(u8());
+            e.cmp.literal = value();
+            return e;
+        }
+        const uint32_t n = u32();
+        for (uint32_t i = 0; i < n; ++i)
+            e.kids.push_back(expr());
+        return e;
+    }
+    std::optional<Expr> where() {
+        if (!u8())
+            return std::nullopt;
+        return expr();
+    }
+};
+
+} // namespace
+
+Statement decodeStatement(std::string_view rec) {
+    Reader r{rec};
+    const auto kind = static_cast<RecKind>(r.u8());
+    switch (kind) {
+    case RecKind::CREATE: {
+        CreateStmt s;
+        s.table = r.str();
+        s.layout = static_cast<Layout>(r.u8());
+        const uint32_t n = r.u32();
+        for (uint32_t i = 0; i < n; ++i) {
+            Column c{r.str(), ColType::INT};
+            decodeColType(r.u8(), c.type, c.dict);
+            s.columns.push_back(std::move(c));
+        }
+        return s;
+    }
+    case RecKind::INSERT:
+    case RecKind::INSERT_PART: {
+        InsertStmt s;
+        if (kind == RecKind::INSERT_PART) {
+            s.part = static_cast<InsertStmt::Part>(r.u8());
+            if (s.part == InsertStmt::Part::WHOLE || s.part > InsertStmt::Part::LAST)
+                throw std::runtime_error("Corrupt WAL record: bad INSERT part");
+        }
+        s.table = r.str();
+        const uint32_t nc = r.u32();
+        for (uint32_t i = 0; i < nc; ++i)
+            s.cols.push_back(r.str());
+        const uint32_t nr = r.u32();
+        s.rows.reserve(nr);
+        for (uint32_t i = 0; i < nr; ++i) {
+            const uint32_t w = r.u32();
+            std::vector<Value> row;
+            row.reserve(w);
+            for (uint32_t k = 0; k < w; ++k)
+                row.push_back(r.value());
+            s.rows.push_back(std::move(row));
+        }
+        return s;
+    }
+    case RecKind::DELETE: {
+        DeleteStmt s;
+        s.table = r.str();
+        s.where = r.where();
+        return s;
+    }
+    case RecKind::UPDATE: {
+        UpdateStmt s;
+        s.table = r.str();
+        const uint32_t n = r.u32();
+        for (uint32_t i = 0; i < n; ++i) {
+            std::string col = r.str();
+            s.assignments.emplace_back(std::move(col), r.value());
+        }
+        s.where = r.where();
+        return s;
+    }
+    case RecKind::CREATE_INDEX: {
+        CreateIndexStmt s;
+        s.name = r.str();
+        s.table = r.str();
+        s.column = r.str();
+        s.kind = static_cast<IndexKind>(r.u8());
+        return s;
+    }
+    case RecKind::DROP_INDEX:
+        return DropIndexStmt{r.str()};
+    case RecKind::LOAD:
+        return LoadStmt{r.str()};
+    }
+    throw std::runtime_error("Corrupt WAL record: unknown kind");
+}
+
+// ----- Log file -----
+static const char kMagic[8] = {'I', 'M', 'D', 'W', 'A', 'L', '0', '1'};
+constexpr size_t kFrame = 8; // u32 length + u32 crc
+
+#ifdef _WIN32
+static int sysOpen(const std::string& p) {
+    return _open(p.c_str(), _O_RDWR | _O_CREAT | _O_BINARY, _S_IREAD | _S_IWRITE);
+}
+static int sysCreate(const std::string& p) {
+    return _open(p.c_str(), _O_RDWR | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+}
+static bool sysWrite(int fd, const char* p, size_t n) {
+    while (n) {
+        const unsigned chunk = n > (1u << 30) ? (1u << 30) : static_cast<unsigned>(n);
+        const int w = _write(fd, p, chunk);
+        if (w <= 0)
+            return false;
+        p += w;
+        n -= static_cast<size_t>(w);
+    }
+    return true;
+}
+static bool sysSync(int fd) {
+    return _commit(fd) == 0;
+}
+static bool sysTruncate(int fd, size_t n) {
+    return _chsize_s(fd, static_cast<long long>(n)) == 0;
+}
+static void sysSeekEnd(int fd) {
+    _lseeki64(fd, 0, SEEK_END);
+}
+static void sysClose(int fd) {
+    _close(fd);
+}
+#else
+static int sysOpen(const std::string& p) {
+    return ::open(p.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+}
+static int sysCreate(const std::string& p) {
+    return ::open(p.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+}
+static bool sysWrite(int fd, const char* p, size_t n) {
+    while (n) {
+        const ssize_t w = ::write(fd, p, n);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return false;
+        p += w;
+        n -= static_cast<size_t>(w);
+    }
+    return true;
+}
+static bool sysSync(int fd) {
+#if defined(__APPLE__)
+    return ::fsync(fd) == 0;
+#else
+    return ::fdatasync(fd) == 0;
+#endif
+}
+static bool sysTruncate(int fd, size_t n) {
+    return ::ftruncate(fd, static_cast<off_t>(n)) == 0;
+}
+static void sysSeekEnd(int fd) {
+    ::lseek(fd, 0, SEEK_END);
+}
+static void sysClose(int fd) {
+    ::close(fd);
+}
+#endif
+
+bool renameFile(const char* from, const char* to) {
+#ifdef _WIN32
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return ::rename(from, to) == 0;
+#endif
+}
+
+bool syncDir(const char* dir) {
+#ifdef _WIN32
+    (void)dir; // MOVEFILE_WRITE_THROUGH already flushed the rename
+    return true;
+#else
+    const int fd = ::open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    const bool ok = ::fsync(fd) == 0;
+    const int e = errno;
+    ::close(fd);
+    errno = e;
+    return ok;
+#endif
+}
+
+std::string parentDir(const std::string& path) {
+    const size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+}
+
+static uint32_t load32(const char* p) {
+    const auto* u = reinterpret_cast<const unsigned char*>(p);
+    return u[0] | (u[1] << 8) | (u[2] << 16) | (static_cast<uint32_t>(u[3]) << 24);
+}
+
+static void putFrame(char* frame, std::string_view rec) {
+    if (rec.size() > UINT32_MAX) // replay would stop at a frame whose length wrapped
+        throw std::runtime_error("WAL record of " + std::to_string(rec.size()) + " bytes is too large");
+    const uint32_t len = static_cast<uint32_t>(rec.size()), crc = crc32c(rec.data(), rec.size());
+    for (int i = 0; i < 4; ++i) {
+        frame[i] = static_cast<char>(len >> (8 * i));
+        frame[4 + i] = static_cast<char>(crc >> (8 * i));
+    }
+}
+
+// Bytes of s (from the start) covered by the magic and whole, valid records.
+static size_t validPrefix(std::string_view s) {
+    size_t pos = sizeof(kMagic);
+    while (s.size() - pos >= kFrame) {
+        const size_t len = load32(s.data() + pos);
+        if (s.size() - pos - kFrame < len || crc32c(s.data() + pos + kFrame, len) != load32(s.data() + pos + 4))
+            break;
+        pos += kFrame + len;
+    }
+    return pos;
+}
+
+Wal::Wal(const std::string& path, std::chrono::microseconds window) : path_(path), window_(window) {
+    fd_ = sysOpen(path);
+    if (fd_ < 0)
+        throw std::runtime_error("Cannot open WAL " + path);
+    try {
+        MappedFile f(path);
+        if (f.size() == 0) {
+            if (!sysWrite(fd_, kMagic, sizeof(kMagic)) || !sysSync(fd_))
+                throw std::runtime_error("Cannot initialize WAL " + path);
+            recovered_ = sizeof(kMagic);
+        } else {
+            if (f.size() < sizeof(kMagic) || std::memcmp(f.data(), kMagic, sizeof(kMagic)) != 0)
+                throw std::runtime_error("Not a WAL file: " + path);
+            recovered_ = validPrefix(f.view());
+            if (recovered_ < f.size() && (!sysTruncate(fd_, recovered_) || !sysSync(fd_)))
+                throw std::runtime_error("Cannot truncate torn WAL tail in " + path);
+        }
+    } catch (...) {
+        sysClose(fd_);
+        throw;
+    }
+    sysSeekEnd(fd_);
+    flusher_ = std::thread([this] { flushLoop(); });
+}
+
+Wal::~Wal() {
+    {
+        std::lock_guard<std::mutex> lk(m_);
+        stop_ = true;
+    }
+    work_.notify_all();
+    flusher_.join();
+    sysClose(fd_);
+}
+
+size_t Wal::replay(const std::function<void(std::string_view rec)>& apply) const {
+    MappedFile f(path_);
+    const std::string_view s = f.view().substr(0, recovered_);
+    size_t n = 0;
+    for (size_t pos = sizeof(kMagic); pos < s.size(); ++n) {
+        const size_t len = load32(s.data() + pos);
+        apply(s.substr(pos + kFrame, len));
+        pos += kFrame + len;
+    }
+    return n;
+}
+
+uint64_t Wal::append(std::string_view rec) {
+    char frame[kFrame];
+    putFrame(frame, rec);
+    std::lock_guard<std::mutex> lk(m_);
+    buf_.append(frame, kFrame);
+    buf_.append(rec);
+    work_.notify_one();
+    return ++appended_;
+}
+
+void Wal::waitDurable(uint64_t lsn) {
+    std::unique_lock<std::mutex> lk(m_);
+    done_.wait(lk, [&] { return durable_ >= lsn || !error_.empty(); });
+    if (!error_.empty())
+        throw std::runtime_error("WAL " + path_ + ": " + error_);
+}
+
+void Wal::restart(std::string_view rec) {
+    sync();
+    std::lock_guard<std::mutex> lk(m_); // callers serialize writes, so the flusher is idle
+    char frame[kFrame];
+    putFrame(frame, rec);
+    const std::string tmp = path_ + ".tmp";
+    const int fd = sysCreate(tmp);
+    const bool ok = fd >= 0 && sysWrite(fd, kMagic, sizeof(kMagic)) && sysWrite(fd, frame, kFrame) &&
+                    sysWrite(fd, rec.data(), rec.size()) && sysSync(fd);
+    if (fd >= 0)
+        sysClose(fd);
+    if (!ok) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("Cannot write WAL checkpoint to " + tmp);
+    }
+    // Both logs are closed across the rename (Windows will not replace an open
+    // file); either way path_ names a complete log to reopen afterwards.
+    sysClose(fd_);
+    const bool renamed = renameFile(tmp.c_str(), path_.c_str());
+    fd_ = sysOpen(path_);
+    if (fd_ >= 0)
+        sysSeekEnd(fd_);
+    if (!renamed) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("Cannot rename " + tmp + " to " + path_);
+    }
+    if (!syncDir(parentDir(path_).c_str()))
+        throw std::runtime_error("Cannot sync directory " + parentDir(path_));
+    if (fd_ < 0) {
+        error_ = "cannot reopen after a checkpoint";
+        throw std::runtime_error("Cannot reopen WAL " + path_);
+    }
+    ++syncs_;
+}
+
+uint64_t Wal::appended() const {
+    std::lock_guard<std::mutex> lk(m_);
+    return appended_;
+}
+
+uint64_t Wal::durable() const {
+    std::lock_guard<std::mutex> lk(m_);
+    return durable_;
+}
+
+uint64_t Wal::syncs() const {
+    std::lock_guard<std::mutex> lk(m_);
+    return syncs_;
+}
+
+// Waits for a first record, lets the group-commit window fill, then writes
+// and syncs the whole group at once.
+void Wal::flushLoop() {
+    std::unique_lock<std::mutex> lk(m_);
+    for (;;) {
+        work_.wait(lk, [&] { return stop_ || !buf_.empty(); });
+        if (buf_.empty())
+            return; // stopping, nothing left
+        if (!stop_ && window_.count() > 0) {
+            const auto until = std::chrono::steady_clock::now() + window_;
+            work_.wait_until(lk, until, [&] { return stop_; });
+        }
+        std::string group;
+        group.swap(buf_);
+        const uint64_t upto = appended_;
+        lk.unlock();
+        const bool ok = sysWrite(fd_, group.data(), group.size()) && sysSync(fd_);
+        lk.lock();
+        if (!ok && error_.empty())
+            error_ = "write or fsync failed";
+        durable_ = upto;
+        ++syncs_;
+        done_.notify_all();
+    }
+}
+
+} // namespace imd